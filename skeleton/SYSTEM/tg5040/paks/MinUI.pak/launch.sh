@@ -152,13 +152,19 @@ fi
 
 cd $(dirname "$0")
 
+# fill the on-disk game art cache while on the charger, see nextui.c
+if [ "$(cat /sys/class/power_supply/axp2202-usb/online 2>/dev/null)" = "1" ]; then
+	nice -n 19 nextui.elf --build-thumbs &> $LOGS_PATH/thumbs.txt &
+fi
+
 #######################################
 
 EXEC_PATH="/tmp/nextui_exec"
 NEXT_PATH="/tmp/next"
 touch "$EXEC_PATH"  && sync
 while [ -f $EXEC_PATH ]; do
-	nextui.elf &> $LOGS_PATH/nextui.txt
+	# games run from inside nextui and return to it, everything else comes through /tmp/next
+	nextui.elf --resident &> $LOGS_PATH/nextui.txt
 	echo $CPU_SPEED_PERF > $CPU_PATH
 	
 	if [ -f $NEXT_PATH ]; then
@@ -0,0 +1,280 @@
+// headless audio/video sync simulation for tuning the rate control in
+// audiosync.h, drives the real AudioRing + AudioSync code with a synthetic
+// core and a jittery audio callback in simulated time (runs in a blink)
+//
+//	avsync -m dynamic -c 60.0988 -d 60 -t 600
+//	avsync -m fixed -c 59.73 -i 32040 -j 2 -v > occupancy.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "audioring.h"
+#include "audiosync.h"
+
+// mirrored from api.c/platform.h so the simulation matches the device
+#define SCREEN_FPS 60.235
+#define FPS_BUFFER_SIZE 50
+#define SAMPLES 512
+
+enum {
+	MODE_DYNAMIC, // SND_batchSamples, core paced by GFX_flip
+	MODE_FIXED,   // SND_batchSamples_fixed_rate, core paced by GFX_flip_fixed_rate
+};
+
+static struct {
+	int mode;
+	double rate_in;		// core sample rate
+	double rate_out;	// audio device sample rate
+	double core_fps;	// fps the core reports
+	double display_fps;	// actual vsync rate (dynamic mode)
+	double frame_jitter;	// ms, flip/frame timing noise
+	double callback_jitter; // ms, audio callback timing noise
+	int callback_frames;	// frames pulled per audio callback
+	int buffer_frames;	// ring size, 0 uses the SND_init formula
+	double seconds;
+	unsigned seed;
+	int verbose;
+} opt = {
+	.mode = MODE_DYNAMIC,
+	.rate_in = 48000,
+	.rate_out = 48000,
+	.core_fps = 60.0988,
+	.display_fps = SCREEN_FPS,
+	.frame_jitter = 1.0,
+	.callback_jitter = 1.0,
+	.callback_frames = SAMPLES,
+	.buffer_frames = 0,
+	.seconds = 120,
+	.seed = 1,
+	.verbose = 0,
+};
+
+///////////////////////////////
+
+static uint32_t rng_state;
+static double jitter(double ms) { // uniform in [-ms,ms], in seconds
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return ((rng_state / 4294967295.0) * 2.0 - 1.0) * ms / 1000.0;
+}
+
+static int compareFloat(const void* a, const void* b) {
+	float x = *(const float*)a;
+	float y = *(const float*)b;
+	return (x > y) - (x < y);
+}
+
+///////////////////////////////
+
+static void printUsage(void) {
+	printf("usage: avsync [options]\n");
+	printf("  -m dynamic|fixed  rate controller to simulate (default dynamic)\n");
+	printf("  -i <hz>           core sample rate (default %.0f)\n", opt.rate_in);
+	printf("  -o <hz>           output sample rate (default %.0f)\n", opt.rate_out);
+	printf("  -c <fps>          core fps (default %.4f)\n", opt.core_fps);
+	printf("  -d <fps>          display refresh rate, dynamic only (default %.3f)\n", opt.display_fps);
+	printf("  -f <ms>           frame timing jitter (default %.1f)\n", opt.frame_jitter);
+	printf("  -j <ms>           audio callback jitter (default %.1f)\n", opt.callback_jitter);
+	printf("  -s <frames>       frames per audio callback (default %i)\n", opt.callback_frames);
+	printf("  -b <frames>       ring size (default 6 frames worth at SCREEN_FPS)\n");
+	printf("  -t <seconds>      simulated duration (default %.0f)\n", opt.seconds);
+	printf("  -r <seed>         jitter seed (default %u)\n", opt.seed);
+	printf("  -v                print a time,occupancy,ratio,latency_ms csv line every 100ms\n");
+}
+
+int main(int argc, char* argv[]) {
+	int c;
+	while ((c = getopt(argc, argv, "m:i:o:c:d:f:j:s:b:t:r:vh")) != -1) {
+		switch (c) {
+			case 'm': opt.mode = strcmp(optarg, "fixed")==0 ? MODE_FIXED : MODE_DYNAMIC; break;
+			case 'i': opt.rate_in = atof(optarg); break;
+			case 'o': opt.rate_out = atof(optarg); break;
+			case 'c': opt.core_fps = atof(optarg); break;
+			case 'd': opt.display_fps = atof(optarg); break;
+			case 'f': opt.frame_jitter = atof(optarg); break;
+			case 'j': opt.callback_jitter = atof(optarg); break;
+			case 's': opt.callback_frames = atoi(optarg); break;
+			case 'b': opt.buffer_frames = atoi(optarg); break;
+			case 't': opt.seconds = atof(optarg); break;
+			case 'r': opt.seed = strtoul(optarg, NULL, 10); break;
+			case 'v': opt.verbose = 1; break;
+			default: printUsage(); return c=='h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (opt.rate_in<=0 || opt.rate_out<=0 || opt.core_fps<=0 || opt.display_fps<=0 || opt.callback_frames<=0 || opt.seconds<=0) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	rng_state = opt.seed ? opt.seed : 1;
+
+	// same sizing as SND_init
+	int frame_count = opt.buffer_frames ? opt.buffer_frames : (int)((float)opt.rate_out/SCREEN_FPS*6);
+	AudioRing ring = {0};
+	AudioSync sync;
+	AudioSync_reset(&sync);
+	if (AudioRing_init(&ring, frame_count - 1, sizeof(int32_t)) != 0) {
+		fprintf(stderr, "avsync: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	int scratch_frames = opt.rate_in; // a second worth, more than any single core frame
+	if (opt.callback_frames > scratch_frames) scratch_frames = opt.callback_frames;
+	int32_t* scratch = calloc(scratch_frames, sizeof(int32_t));
+
+	// fps estimation as in GFX_flip
+	double fps_buffer[FPS_BUFFER_SIZE];
+	for (int i=0; i<FPS_BUFFER_SIZE; i++) fps_buffer[i] = 60.1;
+	int fps_index = 0;
+	int fps_counter = 0;
+	double current_fps = SCREEN_FPS;
+
+	// the core's pacing and the audio device's clock are independent
+	double frame_interval = opt.mode==MODE_DYNAMIC ? 1.0 / opt.display_fps : 1.0 / opt.core_fps;
+	double callback_interval = opt.callback_frames / opt.rate_out;
+	double next_frame = frame_interval;
+	double next_callback = callback_interval;
+	double last_frame = 0;
+	int frame_index = 0;
+	int callback_index = 0;
+
+	double in_carry = 0;	// fractional core samples
+	double out_carry = 0;	// fractional resampled frames
+
+	int latency_count = 0;
+	int latency_capacity = (int)(opt.seconds / callback_interval) + 16;
+	float* latency = malloc(latency_capacity * sizeof(float));
+
+	double ratio = 1.0;
+	double ratio_sum = 0, ratio_min = 1e9, ratio_max = 0;
+	double occupancy_sum = 0, occupancy_min = 1, occupancy_max = 0;
+	int occupancy_histogram[10] = {0};
+	size_t produced = 0;
+	double next_report = 0;
+
+	// the ring starts out empty so the first callbacks always underrun,
+	// only glitches after this are counted against the controller
+	#define WARMUP_SECONDS 1.0
+	size_t warmup_underruns = 0;
+	size_t warmup_overruns = 0;
+	int warmed_up = 0;
+
+	if (opt.verbose) printf("time,occupancy,ratio,latency_ms\n");
+
+	while (1) {
+		double now = next_frame < next_callback ? next_frame : next_callback;
+		if (now > opt.seconds) break;
+		if (!warmed_up && now >= WARMUP_SECONDS) {
+			warmup_underruns = ring.underruns;
+			warmup_overruns = ring.overruns;
+			warmed_up = 1;
+		}
+
+		if (now == next_frame) {
+			// GFX_flip measures the time between flips
+			if (opt.mode==MODE_DYNAMIC) {
+				double tempfps = 1.0 / (now - last_frame);
+				if (tempfps < SCREEN_FPS * 0.8 || tempfps > SCREEN_FPS * 1.2) tempfps = SCREEN_FPS;
+				fps_buffer[fps_index] = tempfps;
+				fps_index = (fps_index + 1) % FPS_BUFFER_SIZE;
+				if (++fps_counter > 100) {
+					double average_fps = 0;
+					int size = fps_counter < FPS_BUFFER_SIZE ? fps_counter : FPS_BUFFER_SIZE;
+					for (int i=0; i<size; i++) average_fps += fps_buffer[i];
+					current_fps = average_fps / size;
+				}
+			}
+			last_frame = now;
+
+			// one retro_run worth of audio
+			in_carry += opt.rate_in / opt.core_fps;
+			int in_frames = (int)in_carry;
+			in_carry -= in_frames;
+
+			float remaining_space = AudioRing_space(&ring) + 1;
+			if (opt.mode==MODE_DYNAMIC) {
+				ratio = AudioSync_dynamicRatio(&sync, remaining_space, frame_count, opt.core_fps, current_fps);
+			}
+			else {
+				float occupancy = (frame_count - remaining_space) / frame_count;
+				ratio = AudioSync_fixedRatio(&sync, occupancy);
+			}
+
+			// ideal resampler, what matters here is the number of frames
+			out_carry += in_frames * (opt.rate_out / opt.rate_in) * ratio;
+			int out_frames = (int)out_carry;
+			out_carry -= out_frames;
+			if (out_frames > scratch_frames) out_frames = scratch_frames;
+			produced += AudioRing_write(&ring, scratch, out_frames);
+
+			ratio_sum += ratio;
+			if (ratio < ratio_min) ratio_min = ratio;
+			if (ratio > ratio_max) ratio_max = ratio;
+
+			frame_index += 1;
+			next_frame = (frame_index + 1) * frame_interval + jitter(opt.frame_jitter);
+			if (next_frame <= now) next_frame = now + 1e-6;
+		}
+		else {
+			// SND_audioCallback, queue depth at this point is the latency the
+			// next sample written will see
+			size_t used = AudioRing_used(&ring);
+			if (latency_count < latency_capacity) latency[latency_count++] = used * 1000.0 / opt.rate_out;
+
+			float occupancy = (float)used / frame_count;
+			occupancy_sum += occupancy;
+			if (occupancy < occupancy_min) occupancy_min = occupancy;
+			if (occupancy > occupancy_max) occupancy_max = occupancy;
+			int bucket = (int)(occupancy * 10);
+			occupancy_histogram[bucket > 9 ? 9 : bucket] += 1;
+
+			AudioRing_read(&ring, scratch, opt.callback_frames);
+
+			if (opt.verbose && now >= next_report) {
+				printf("%.3f,%.4f,%.6f,%.2f\n", now, occupancy, ratio, used * 1000.0 / opt.rate_out);
+				next_report += 0.1;
+			}
+
+			callback_index += 1;
+			next_callback = (callback_index + 1) * callback_interval + jitter(opt.callback_jitter);
+			if (next_callback <= now) next_callback = now + 1e-6;
+		}
+	}
+
+	qsort(latency, latency_count, sizeof(float), compareFloat);
+	#define PERCENTILE(p) (latency_count ? latency[(int)((latency_count - 1) * (p))] : 0)
+
+	double ideal_ratio = opt.mode==MODE_DYNAMIC ? opt.core_fps / opt.display_fps : 1.0;
+	double mean_ratio = frame_index ? ratio_sum / frame_index : 0;
+	FILE* out = opt.verbose ? stderr : stdout;
+	fprintf(out, "mode:        %s, %.0fHz -> %.0fHz, core %.4ffps, display %.3ffps\n",
+		opt.mode==MODE_DYNAMIC ? "dynamic" : "fixed", opt.rate_in, opt.rate_out, opt.core_fps, opt.display_fps);
+	fprintf(out, "simulated:   %.0fs, %i frames, %i callbacks of %i, ring %i frames\n",
+		opt.seconds, frame_index, callback_index, opt.callback_frames, frame_count);
+	fprintf(out, "ratio:       mean %.6f min %.6f max %.6f final %.6f (ideal %.6f, drift %+.6f)\n",
+		mean_ratio, ratio_min, ratio_max, ratio, ideal_ratio, mean_ratio - ideal_ratio);
+	fprintf(out, "occupancy:   mean %.1f%% min %.1f%% max %.1f%%\n",
+		callback_index ? occupancy_sum / callback_index * 100 : 0, occupancy_min * 100, occupancy_max * 100);
+	fprintf(out, "histogram:  ");
+	for (int i=0; i<10; i++) fprintf(out, " %i0%%:%.1f", i, callback_index ? occupancy_histogram[i] * 100.0 / callback_index : 0);
+	fprintf(out, "\n");
+	fprintf(out, "latency ms:  p50 %.1f p95 %.1f p99 %.1f max %.1f\n",
+		PERCENTILE(0.50), PERCENTILE(0.95), PERCENTILE(0.99), PERCENTILE(1.0));
+	size_t underruns = ring.underruns - warmup_underruns;
+	size_t overruns = ring.overruns - warmup_overruns;
+	fprintf(out, "underruns:   %zu frames (%.3f%% of played, %zu more during warm up)\n",
+		underruns, callback_index ? underruns * 100.0 / ((size_t)callback_index * opt.callback_frames) : 0, warmup_underruns);
+	fprintf(out, "overruns:    %zu frames (%.3f%% of produced, %zu more during warm up)\n",
+		overruns, produced + ring.overruns ? overruns * 100.0 / (produced + ring.overruns) : 0, warmup_overruns);
+
+	free(latency);
+	free(scratch);
+	AudioRing_free(&ring);
+
+	// non-zero when audio glitched so it can gate regressions in a script
+	return underruns || overruns ? 2 : EXIT_SUCCESS;
+}
@@ -15,9 +15,15 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #include "utils.h"
 #include "config.h"
+#include "audioring.h"
+#include "audiosync.h"
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 #include <pthread.h>
 
@@ -173,13 +179,9 @@ static struct SND_Context {
 	int sample_rate_in;
 	int sample_rate_out;
 	
-	SND_Frame* buffer;		// buf
+	AudioRing ring;			// lock free, written by SND_batchSamples*, read by SND_audioCallback
 	size_t frame_count; 	// buf_len
 	
-	int frame_in;     // buf_w
-	int frame_out;    // buf_r
-	int frame_filled; // max_buf_w
-	
 } snd = {0};
 
 ///////////////////////////////
@@ -200,6 +202,8 @@ int currentshaderdstw = 0;
 int currentshaderdsth = 0;
 int currentshadertexw = 0;
 int currentshadertexh = 0;
+double currentuploadms = 0;
+int currentglcalls = 0;
 
 int currentbuffersize = 0;
 int currentsampleratein = 0;
@@ -211,6 +215,13 @@ FALLBACK_IMPLEMENTATION void *PLAT_cpu_monitor(void *arg) {
 	return NULL; 
 }
 
+FALLBACK_IMPLEMENTATION void PLAT_setCustomCPUSpeed(int speed) { }
+FALLBACK_IMPLEMENTATION void PLAT_resetCPUSpeed(void) { }
+FALLBACK_IMPLEMENTATION int PLAT_getCPUFrequencies(const int** freqs) {
+	*freqs = NULL;
+	return 0;
+}
+
 FALLBACK_IMPLEMENTATION void PLAT_getCPUTemp() {
 	currentcputemp = 0;
 }
@@ -420,98 +431,110 @@ void chmodfile(const char *file, int writable)
     }
 }
 
-uint32_t GFX_extract_average_color(const void *data, unsigned width, unsigned height, size_t pitch) {
-	if (!data) {
-        return 0;
-    }
-
-    const uint16_t *pixels = (const uint16_t *)data;
-    int pixel_count = width * height;
-
-    uint64_t total_r = 0;
-    uint64_t total_g = 0;
-    uint64_t total_b = 0;
-    uint32_t colorful_pixel_count = 0;
-
-    for (unsigned y = 0; y < height; y++) {
-        for (unsigned x = 0; x < width; x++) {
-            uint16_t pixel = pixels[y * (pitch / 2) + x];
-
-            uint8_t r = ((pixel & 0xF800) >> 11) << 3;
-            uint8_t g = ((pixel & 0x07E0) >> 5) << 2;
-            uint8_t b = (pixel & 0x001F) << 3;
+#define AMBIENT_GRID 64 // samples per axis
+#define AMBIENT_INTERVAL 4 // frames between samples
+#define AMBIENT_THRESHOLD 24 // summed rgb difference before the leds are rewritten
 
-            r |= r >> 5;
-            g |= g >> 6;
-            b |= b >> 5;
-
-            uint8_t max_c = fmaxf(fmaxf(r, g), b);
-            uint8_t min_c = fminf(fminf(r, g), b);
-            uint8_t saturation = max_c == 0 ? 0 : (max_c - min_c) * 255 / max_c;
-
-            if (saturation > 50 && max_c > 50) {
-                total_r += r;
-                total_g += g;
-                total_b += b;
-                colorful_pixel_count++;
-            }
-        }
+// averages the colourful pixels of a grid sampled from the middle of evenly
+// sized cells, or all of them if nothing stands out. only an estimate of the
+// whole frame, fine detail between samples is missed. format is CONVERT_RGB565
+// or CONVERT_XRGB8888, what the core hands to video_refresh_callback
+uint32_t GFX_extract_average_color(const void *data, unsigned width, unsigned height, size_t pitch, int format) {
+	if (!data || !width || !height) {
+        return 0;
     }
 
-    if (colorful_pixel_count == 0) {
-
-        colorful_pixel_count = pixel_count;
-        total_r = total_g = total_b = 0;
-        for (unsigned y = 0; y < height; y++) {
-            for (unsigned x = 0; x < width; x++) {
-                uint16_t pixel = pixels[y * (pitch / 2) + x];
-                uint8_t r = ((pixel & 0xF800) >> 11) << 3;
-                uint8_t g = ((pixel & 0x07E0) >> 5) << 2;
-                uint8_t b = (pixel & 0x001F) << 3;
-
-                r |= r >> 5;
-                g |= g >> 6;
-                b |= b >> 5;
+	unsigned cols = width < AMBIENT_GRID ? width : AMBIENT_GRID;
+	unsigned rows = height < AMBIENT_GRID ? height : AMBIENT_GRID;
+
+	uint32_t total_r = 0, total_g = 0, total_b = 0;
+	uint32_t colorful_r = 0, colorful_g = 0, colorful_b = 0;
+	uint32_t colorful_pixel_count = 0;
+
+	for (unsigned j = 0; j < rows; j++) {
+		const uint8_t* line = (const uint8_t*)data + (size_t)((j * 2 + 1) * height / (rows * 2)) * pitch;
+		for (unsigned i = 0; i < cols; i++) {
+			unsigned x = (i * 2 + 1) * width / (cols * 2);
+			uint32_t r, g, b;
+			if (format == CONVERT_XRGB8888) {
+				uint32_t pixel = ((const uint32_t*)line)[x];
+				r = (pixel >> 16) & 0xFF;
+				g = (pixel >> 8) & 0xFF;
+				b = pixel & 0xFF;
+			}
+			else {
+				uint16_t pixel = ((const uint16_t*)line)[x];
+				r = (pixel >> 11) & 0x1F;
+				g = (pixel >> 5) & 0x3F;
+				b = pixel & 0x1F;
+				r = (r << 3) | (r >> 2);
+				g = (g << 2) | (g >> 4);
+				b = (b << 3) | (b >> 2);
+			}
 
-                total_r += r;
-                total_g += g;
-                total_b += b;
-            }
-        }
-    }
+			total_r += r;
+			total_g += g;
+			total_b += b;
+
+			// saturation above 50 of 255, without the divide
+			uint32_t max_c = r > g ? (r > b ? r : b) : (g > b ? g : b);
+			uint32_t min_c = r < g ? (r < b ? r : b) : (g < b ? g : b);
+			if (max_c > 50 && (max_c - min_c) * 255 >= 51 * max_c) {
+				colorful_r += r;
+				colorful_g += g;
+				colorful_b += b;
+				colorful_pixel_count++;
+			}
+		}
+	}
 
-    uint8_t avg_r = total_r / colorful_pixel_count;
-    uint8_t avg_g = total_g / colorful_pixel_count;
-    uint8_t avg_b = total_b / colorful_pixel_count;
+	if (colorful_pixel_count) {
+		return (colorful_r / colorful_pixel_count << 16) | (colorful_g / colorful_pixel_count << 8) | colorful_b / colorful_pixel_count;
+	}
+	uint32_t count = rows * cols;
+	return (total_r / count << 16) | (total_g / count << 8) | total_b / count;
+}
 
-    return (avg_r << 16) | (avg_g << 8) | avg_b;
+static int ambientColorChanged(LightSettings* light, uint32_t color) {
+	if (light->effect != 4 || light->brightness != 100) return 1;
+	int distance = 0;
+	for (int shift = 0; shift <= 16; shift += 8) {
+		distance += abs((int)((light->color1 >> shift) & 0xFF) - (int)((color >> shift) & 0xFF));
+	}
+	return distance >= AMBIENT_THRESHOLD;
 }
 
+// samples every few frames and only touches the leds the mode drives when
+// their colour moved far enough to notice. compares against the lights
+// themselves so anything that reset them (like the menu) gets them rewritten.
+// returns 1 if LEDS_updateLeds should push the change out
+int GFX_setAmbientColor(const void *data, unsigned width, unsigned height, size_t pitch, int format, int mode) {
+	static unsigned frame = 0;
+	if (mode == 0 || frame++ % AMBIENT_INTERVAL) return 0;
 
+	int leds[4];
+	int count = 0;
+	if (mode == 1 || mode == 3) {
+		leds[count++] = 0;
+		leds[count++] = 1;
+	}
+	if (mode == 1 || mode == 2 || mode == 5) leds[count++] = 2;
+	if (mode == 1 || mode == 4 || mode == 5) leds[count++] = 3;
 
-void GFX_setAmbientColor(const void *data, unsigned width, unsigned height, size_t pitch,int mode) {
-	if(mode==0) return;
+	uint32_t dominant_color = GFX_extract_average_color(data, width, height, pitch, format);
 
-	uint32_t dominant_color = GFX_extract_average_color(data, width, height,pitch);
-   
-	if(mode==1 || mode==2 || mode==5) {
-		(*lights)[2].color1 = dominant_color;
-		(*lights)[2].effect = 4;
-		(*lights)[2].brightness = 100;
+	int changed = 0;
+	for (int i = 0; i < count && !changed; i++) {
+		changed = ambientColorChanged(&(*lights)[leds[i]], dominant_color);
 	}
-	if(mode==1 || mode==3) {
-		(*lights)[0].color1 = dominant_color;
-		(*lights)[0].effect = 4;
-		(*lights)[0].brightness = 100;
-		(*lights)[1].color1 = dominant_color;
-		(*lights)[1].effect = 4;
-		(*lights)[1].brightness = 100;
-	}
-	if(mode==1 || mode==4 || mode==5) {
-		(*lights)[3].color1 = dominant_color;
-		(*lights)[3].effect = 4;
-		(*lights)[3].brightness = 100;
+	if (!changed) return 0;
+
+	for (int i = 0; i < count; i++) {
+		(*lights)[leds[i]].color1 = dominant_color;
+		(*lights)[leds[i]].effect = 4;
+		(*lights)[leds[i]].brightness = 100;
 	}
+	return 1;
 }
 
 void GFX_flip(SDL_Surface* screen) {
@@ -1911,13 +1934,168 @@ SDL_Color GFX_mapColor(uint32_t c)
 
 ///////////////////////////////
 
+// lock free trace ring, TRACE_end claims a slot with an atomic increment so
+// any thread can record without blocking, the oldest events get overwritten.
+// durations also go into per type histograms so percentiles cover the whole
+// session and not just what's still in the ring
+
+#define TRACE_CAPACITY 16384	// events, must be a power of 2
+#define TRACE_BUCKET_US 50		// histogram resolution
+#define TRACE_BUCKETS 2000		// up to 100ms, anything slower lands in the last bucket
+
+typedef struct TraceEvent {
+	uint64_t start;		// ns, CLOCK_MONOTONIC
+	uint32_t duration;	// ns
+	uint16_t type;
+	int16_t arg;
+} TraceEvent;
+
+static struct TRACE_Context {
+	TraceEvent events[TRACE_CAPACITY];
+	atomic_uint head;
+	atomic_uint histogram[TRACE_COUNT][TRACE_BUCKETS];
+	uint64_t last_frame;
+} trace;
+
+int trace_enabled = 0;
+
+static const char* trace_names[TRACE_COUNT] = {
+	[TRACE_FRAME]		= "frame",
+	[TRACE_CORE_RUN]	= "core.run",
+	[TRACE_CONVERT]		= "convert",
+	[TRACE_BLIT]		= "blit",
+	[TRACE_FLIP]		= "flip",
+	[TRACE_UPLOAD]		= "upload",
+	[TRACE_SHADER_PASS]	= "shader",
+	[TRACE_SWAP]		= "swap",
+	[TRACE_AUDIO]		= "audio",
+};
+
+static uint64_t TRACE_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void TRACE_enable(int enable) {
+	if (enable && !trace_enabled) {
+		memset(&trace, 0, sizeof(trace));
+		LOG_info("TRACE_enable\n");
+	}
+	trace_enabled = enable;
+}
+
+uint64_t TRACE_begin(void) {
+	return trace_enabled ? TRACE_now() : 0;
+}
+void TRACE_end(int type, int arg, uint64_t start) {
+	if (!start || !trace_enabled) return;
+	uint64_t duration = TRACE_now() - start;
+	if (duration > UINT32_MAX) duration = UINT32_MAX;
+
+	unsigned slot = atomic_fetch_add_explicit(&trace.head, 1, memory_order_relaxed) & (TRACE_CAPACITY - 1);
+	TraceEvent* event = &trace.events[slot];
+	event->start = start;
+	event->duration = duration;
+	event->type = type;
+	event->arg = arg;
+
+	int bucket = duration / (TRACE_BUCKET_US * 1000);
+	if (bucket >= TRACE_BUCKETS) bucket = TRACE_BUCKETS - 1;
+	atomic_fetch_add_explicit(&trace.histogram[type][bucket], 1, memory_order_relaxed);
+}
+void TRACE_frame(void) {
+	if (!trace_enabled) {
+		trace.last_frame = 0;
+		return;
+	}
+	uint64_t now = TRACE_now();
+	if (trace.last_frame) TRACE_end(TRACE_FRAME, 0, trace.last_frame);
+	trace.last_frame = now;
+}
+
+double TRACE_percentile(int type, double p) {
+	uint64_t total = 0;
+	for (int i=0; i<TRACE_BUCKETS; i++) total += atomic_load_explicit(&trace.histogram[type][i], memory_order_relaxed);
+	if (!total) return 0;
+
+	uint64_t target = (uint64_t)(total * p);
+	if (target >= total) target = total - 1;
+	uint64_t seen = 0;
+	for (int i=0; i<TRACE_BUCKETS; i++) {
+		seen += atomic_load_explicit(&trace.histogram[type][i], memory_order_relaxed);
+		if (seen > target) return (i + 1) * TRACE_BUCKET_US / 1000.0; // upper edge of the bucket
+	}
+	return TRACE_BUCKETS * TRACE_BUCKET_US / 1000.0;
+}
+static uint64_t TRACE_count(int type) {
+	uint64_t total = 0;
+	for (int i=0; i<TRACE_BUCKETS; i++) total += atomic_load_explicit(&trace.histogram[type][i], memory_order_relaxed);
+	return total;
+}
+
+void TRACE_logStats(const char* label) {
+	LOG_info("trace stats %s\n", label ? label : "");
+	for (int i=0; i<TRACE_COUNT; i++) {
+		uint64_t count = TRACE_count(i);
+		if (!count) continue;
+		LOG_info("  %-9s n=%-7llu p50 %6.2fms p95 %6.2fms p99 %6.2fms\n", trace_names[i], (unsigned long long)count,
+			TRACE_percentile(i, 0.50), TRACE_percentile(i, 0.95), TRACE_percentile(i, 0.99));
+	}
+}
+
+int TRACE_dump(const char* path, const char* label) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		LOG_error("TRACE_dump: couldn't open %s\n", path);
+		return -1;
+	}
+
+	unsigned head = atomic_load_explicit(&trace.head, memory_order_acquire);
+	unsigned count = head < TRACE_CAPACITY ? head : TRACE_CAPACITY;
+	unsigned first = head - count;
+
+	// chrome trace wants microseconds, keep them relative to the oldest event
+	uint64_t origin = UINT64_MAX;
+	for (unsigned i=0; i<count; i++) {
+		TraceEvent* event = &trace.events[(first + i) & (TRACE_CAPACITY - 1)];
+		if (event->start < origin) origin = event->start;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"%s\"}}", label ? label : "minarch");
+	for (unsigned i=0; i<count; i++) {
+		TraceEvent* event = &trace.events[(first + i) & (TRACE_CAPACITY - 1)];
+		if (event->type >= TRACE_COUNT) continue;
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+			trace_names[event->type], (event->start - origin) / 1000.0, event->duration / 1000.0);
+		if (event->type==TRACE_SHADER_PASS) fprintf(file, ",\"args\":{\"pass\":%i}", event->arg);
+		else if (event->type==TRACE_CORE_RUN) fprintf(file, ",\"args\":{\"mhz\":%i}", event->arg);
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n],\"otherData\":{\"label\":\"%s\"", label ? label : "");
+	for (int i=0; i<TRACE_COUNT; i++) {
+		uint64_t total = TRACE_count(i);
+		if (!total) continue;
+		fprintf(file, ",\"%s\":\"n=%llu p50=%.2fms p95=%.2fms p99=%.2fms\"", trace_names[i], (unsigned long long)total,
+			TRACE_percentile(i, 0.50), TRACE_percentile(i, 0.95), TRACE_percentile(i, 0.99));
+	}
+	fprintf(file, "}}\n");
+	fclose(file);
+
+	LOG_info("TRACE_dump: %u events to %s\n", count, path);
+	TRACE_logStats(label);
+	return 0;
+}
+
+///////////////////////////////
+
 // based on picoarch's audio 
 // implementation, rewritten 
 // to (try to) understand it 
 // better
 
 #define MAX_SAMPLE_RATE 48000
-#define BATCH_SIZE 100
 #ifndef SAMPLES
 	#define SAMPLES 512 // default
 #endif
@@ -1926,33 +2104,16 @@ SDL_Color GFX_mapColor(uint32_t c)
 
 
 
-pthread_mutex_t audio_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 static void SND_audioCallback(void *userdata, uint8_t *stream, int len) {
 	if (snd.frame_count == 0)
 		return;
 
-	int16_t *out = (int16_t *)stream;
-	len /= (sizeof(int16_t) * 2);
-
-	// Lock the mutex before accessing shared resources
-	
+	SND_Frame *out = (SND_Frame *)stream;
+	int frames = len / sizeof(SND_Frame);
 
-	while (snd.frame_out != snd.frame_in && len > 0) {
-		
-		*out++ = snd.buffer[snd.frame_out].left;
-		*out++ = snd.buffer[snd.frame_out].right;
-		pthread_mutex_lock(&audio_mutex);
-		snd.frame_out += 1;
-		len -= 1;
-		if (snd.frame_out >= snd.frame_count)
-			snd.frame_out = 0;
-		pthread_mutex_unlock(&audio_mutex);
-	}
-	
-
-	if (len > 0) {
-		memset(out, 0, len * (sizeof(int16_t) * 2));
+	int copied = AudioRing_read(&snd.ring, out, frames);
+	if (copied < frames) {
+		memset(out + copied, 0, (frames - copied) * sizeof(SND_Frame));
 	}
 }
 static void SND_resizeBuffer(void) { // plat_sound_resize_buffer
@@ -1962,13 +2123,11 @@ static void SND_resizeBuffer(void) { // plat_sound_resize_buffer
 
 	SDL_LockAudio();
 
-	int buffer_bytes = snd.frame_count * sizeof(SND_Frame);
-	snd.buffer = (SND_Frame*)realloc(snd.buffer, buffer_bytes);
-
-	memset(snd.buffer, 0, buffer_bytes);
-
-	snd.frame_in = 0;
-	snd.frame_out = 0;
+	// one slot is kept free, same usable size as before
+	if (AudioRing_init(&snd.ring, snd.frame_count - 1, sizeof(SND_Frame)) != 0) {
+		LOG_error("Failed to allocate audio ring buffer\n");
+		snd.frame_count = 0;
+	}
 
 	SDL_UnlockAudio();
 }
@@ -1979,181 +2138,170 @@ void SND_setQuality(int quality) {
 	soundQuality = qualityLevels[quality];
 	resetSrcState = 1;
 }
-ResampledFrames resample_audio(const SND_Frame *input_frames,
-	int input_frame_count, int input_sample_rate,
-	int output_sample_rate, double ratio) {
-
-	int error;
-	static double previous_ratio = 1.0;
-	static SRC_STATE *src_state = NULL;
-
-	double final_ratio = ((double)output_sample_rate / input_sample_rate) * ratio;
-
-	if (!src_state || resetSrcState) {
-		resetSrcState = 0;
-		src_state = src_new(soundQuality, 2, &error);
-		if (src_state == NULL) {
-			fprintf(stderr, "Error initializing SRC state: %s\n",
-				src_strerror(error));
-			exit(1);
-		}
-	}
-
-	if (previous_ratio != final_ratio) {
-		if (src_set_ratio(src_state, final_ratio) != 0) {
-			fprintf(stderr, "Error setting resampling ratio: %s\n",
-				src_strerror(src_error(src_state)));
-			exit(1);
-		}
-		previous_ratio = final_ratio;
-	}
-
-	int max_output_frames = (int)(input_frame_count * final_ratio + 1);
-
-	float *input_buffer = (float*)malloc(input_frame_count * 2 * sizeof(float));
-	float *output_buffer = (float*)malloc(max_output_frames * 2 * sizeof(float));
-	if (!input_buffer || !output_buffer) {
-		fprintf(stderr, "Error allocating buffers\n");
-		free(input_buffer);
-		free(output_buffer);
-		src_delete(src_state);
-		exit(1);
+// libsamplerate state plus float scratch buffers, allocated once in SND_init
+// so the audio path never touches malloc, a core batch larger than the
+// scratch is processed in a few src_process calls instead of reallocating
+#define RESAMPLER_MAX_RATIO 1.5 // same limit as the ratio clamp in SND_batchSamples
+#define RESAMPLER_SLACK 16 // sinc converters can emit a couple of frames more than in*ratio
+
+static struct SND_Resampler {
+	SRC_STATE* state;
+	float* in;
+	float* out;
+	int in_frames;	// scratch capacity
+	int out_frames; // scratch capacity
+	double ratio;	// last ratio handed to src_set_ratio
+} resampler = {0};
+
+static void SND_toFloat(const SND_Frame* src, float* dst, int frames) {
+	const int16_t* s = (const int16_t*)src;
+	int samples = frames * 2;
+	int i = 0;
+#ifdef __ARM_NEON
+	const float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+	for (; i + 8 <= samples; i += 8) {
+		int16x8_t v = vld1q_s16(s + i);
+		vst1q_f32(dst + i,     vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+		vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
 	}
-
-	for (int i = 0; i < input_frame_count; i++) {
-		input_buffer[2 * i] = input_frames[i].left / 32768.0f;
-		input_buffer[2 * i + 1] = input_frames[i].right / 32768.0f;
+#endif
+	for (; i < samples; i++) {
+		dst[i] = s[i] * (1.0f / 32768.0f);
+	}
+}
+static void SND_fromFloat(const float* src, SND_Frame* dst, int frames) {
+	int16_t* d = (int16_t*)dst;
+	int samples = frames * 2;
+	int i = 0;
+#ifdef __ARM_NEON
+	const float32x4_t lo = vdupq_n_f32(-1.0f);
+	const float32x4_t hi = vdupq_n_f32(1.0f);
+	const float32x4_t scale = vdupq_n_f32(32767.0f);
+	for (; i + 8 <= samples; i += 8) {
+		float32x4_t a = vmulq_f32(vminq_f32(vmaxq_f32(vld1q_f32(src + i), lo), hi), scale);
+		float32x4_t b = vmulq_f32(vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), lo), hi), scale);
+		vst1q_s16(d + i, vcombine_s16(vmovn_s32(vcvtq_s32_f32(a)), vmovn_s32(vcvtq_s32_f32(b))));
 	}
-
-	SRC_DATA src_data = {
-		.data_in = input_buffer,
-		.data_out = output_buffer,
-		.input_frames = input_frame_count,
-		.output_frames = max_output_frames,
-		.src_ratio = final_ratio,
-		.end_of_input = 0
-	};
-
-	if (src_process(src_state, &src_data) != 0) {
-		fprintf(stderr, "Error resampling: %s\n",
-			src_strerror(src_error(src_state)));
-		free(input_buffer);
-		free(output_buffer);
-		exit(1);
+#endif
+	// written so gcc can vectorize it on other targets
+	for (; i < samples; i++) {
+		float v = src[i];
+		v = v < -1.0f ? -1.0f : v;
+		v = v > 1.0f ? 1.0f : v;
+		d[i] = (int16_t)(v * 32767.0f);
+	}
+}
+
+static void SND_quitResampler(void) {
+	if (resampler.state) src_delete(resampler.state);
+	free(resampler.in);
+	free(resampler.out);
+	memset(&resampler, 0, sizeof(resampler));
+}
+static int SND_initResampler(int sample_rate_in, int sample_rate_out) {
+	SND_quitResampler();
+
+	// about 100ms of input, most cores hand over a single video frame worth
+	resampler.in_frames = sample_rate_in / 10;
+	if (resampler.in_frames < 1024) resampler.in_frames = 1024;
+	double max_ratio = ((double)sample_rate_out / sample_rate_in) * RESAMPLER_MAX_RATIO;
+	resampler.out_frames = (int)(resampler.in_frames * max_ratio) + RESAMPLER_SLACK;
+
+	resampler.in = malloc(resampler.in_frames * 2 * sizeof(float));
+	resampler.out = malloc(resampler.out_frames * 2 * sizeof(float));
+	if (!resampler.in || !resampler.out) {
+		LOG_error("Error allocating resampler buffers\n");
+		SND_quitResampler();
+		return -1;
 	}
+	return 0;
+}
 
-	int output_frame_count = src_data.output_frames_gen;
+// resamples frames straight into the ring's free space, returns the number
+// of frames written, anything that doesn't fit is dropped
+static size_t SND_resample(const SND_Frame* frames, size_t frame_count, double ratio) {
+	if (!resampler.in) return 0;
 
-	SND_Frame *output_frames = (SND_Frame*)malloc(output_frame_count * sizeof(SND_Frame));
-	if (!output_frames) {
-		fprintf(stderr, "Error allocating output frames\n");
-		free(input_buffer);
-		free(output_buffer);
-		exit(1);
+	if (!resampler.state || resetSrcState) {
+		int error;
+		resetSrcState = 0;
+		if (resampler.state) src_delete(resampler.state);
+		resampler.state = src_new(soundQuality, 2, &error);
+		resampler.ratio = 0;
+		if (!resampler.state) {
+			LOG_error("Error initializing SRC state: %s\n", src_strerror(error));
+			return 0;
+		}
 	}
 
-	for (int i = 0; i < output_frame_count; i++) {
-		float left = output_buffer[2 * i];
-		float right = output_buffer[2 * i + 1];
+	double final_ratio = ((double)snd.sample_rate_out / snd.sample_rate_in) * ratio;
+	if (resampler.ratio != final_ratio) {
+		if (src_set_ratio(resampler.state, final_ratio) != 0) {
+			LOG_error("Error setting resampling ratio: %s\n", src_strerror(src_error(resampler.state)));
+			return 0;
+		}
+		resampler.ratio = final_ratio;
+	}
+
+	size_t written = 0;
+	while (frame_count > 0) {
+		int amount = frame_count < (size_t)resampler.in_frames ? (int)frame_count : resampler.in_frames;
+		SND_toFloat(frames, resampler.in, amount);
+
+		SRC_DATA src_data = {
+			.data_in = resampler.in,
+			.data_out = resampler.out,
+			.input_frames = amount,
+			.output_frames = resampler.out_frames,
+			.src_ratio = final_ratio,
+			.end_of_input = 0
+		};
+		if (src_process(resampler.state, &src_data) != 0) {
+			LOG_error("Error resampling: %s\n", src_strerror(src_error(resampler.state)));
+			resetSrcState = 1;
+			break;
+		}
 
-		left = fmaxf(-1.0f, fminf(1.0f, left));
-		right = fmaxf(-1.0f, fminf(1.0f, right));
+		int generated = src_data.output_frames_gen;
+		void* span[2];
+		size_t span_count[2];
+		size_t space = AudioRing_prepare(&snd.ring, &span[0], &span_count[0], &span[1], &span_count[1]);
+		int fits = (size_t)generated < space ? generated : (int)space;
+		int first = (size_t)fits < span_count[0] ? fits : (int)span_count[0];
+		if (first) SND_fromFloat(resampler.out, span[0], first);
+		if (fits > first) SND_fromFloat(resampler.out + first * 2, span[1], fits - first);
+		AudioRing_commit(&snd.ring, fits);
+		snd.ring.overruns += generated - fits;
+		written += fits;
 
-		output_frames[i].left = (int16_t)(left * 32767.0f);
-		output_frames[i].right = (int16_t)(right * 32767.0f);
+		int used = src_data.input_frames_used;
+		if (used <= 0) break; // shouldn't happen with the scratch sized for the max ratio
+		frames += used;
+		frame_count -= used;
 	}
 
-	free(input_buffer);
-	free(output_buffer);
-
-	ResampledFrames resampled;
-	resampled.frames = output_frames;
-	resampled.frame_count = output_frame_count;
-
-	return resampled;
+	return written;
 }
 
 
-#define ROLLING_AVERAGE_WINDOW_SIZE 5
-static float adjustment_history[ROLLING_AVERAGE_WINDOW_SIZE] = {0.0f};
-static int adjustment_index = 0;
-
-float calculateBufferAdjustment(float remaining_space, float targetbuffer_over, float targetbuffer_under, int batchsize) {
-
-    float midpoint = (targetbuffer_over + targetbuffer_under) / 2.0f;
-
-    float normalizedDistance;
-    if (remaining_space < midpoint) {
-        normalizedDistance = (midpoint - remaining_space) / (midpoint - targetbuffer_over);
-    } else {
-        normalizedDistance = (remaining_space - midpoint) / (targetbuffer_under - midpoint);
-    }
-	// I make crazy small adjustments, mooore tiny is mooore stable :D But don't come neir the limits cuz imma hit ya with that 0.005 ratio adjustment, pow pow!
-    // I wonder if staying in the middle of 0 to 4000 with 512 samples per batch playing at tiny different speeds each iteration is like the smallest I can get
-	// lets say hovering around 2000 means 2000 samples queue, about 4 frames, so at 17ms(60fps) thats  68ms delay right?
-	// Should have payed attention when my math teacher was talking dammit
-	// Also I chose 3 for pow, but idk if that really the best nr, anyone good in maths looking at my code?
-	float adjustment = 0.000001f + (0.005f - 0.000001f) * pow(normalizedDistance, 3);
-
-    if (remaining_space < midpoint) {
-        adjustment = -adjustment;
-    }
-
-    adjustment_history[adjustment_index] = adjustment;
-    adjustment_index = (adjustment_index + 1) % ROLLING_AVERAGE_WINDOW_SIZE;
-
-    // Calculate the rolling average
-    float rolling_average = 0.0f;
-    for (int i = 0; i < ROLLING_AVERAGE_WINDOW_SIZE; ++i) {
-        rolling_average += adjustment_history[i];
-    }
-    rolling_average /= ROLLING_AVERAGE_WINDOW_SIZE;
-
-    return rolling_average;
-}
-
-
-
-
-static SND_Frame tmpbuffer[BATCH_SIZE];
-static SND_Frame *unwritten_frames = NULL;
-static int unwritten_frame_count = 0;
+static AudioSync snd_sync = {.ratio = 1.0};
 
 float currentratio = 0.0;
 int currentbufferfree = 0;
 int currentframecount = 0;
-static double ratio = 1.0;
 
 size_t SND_batchSamples(const SND_Frame *frames, size_t frame_count) {
-    int framecount = (int)frame_count;
-    int consumed = 0;
-    int total_consumed_frames = 0;
-
 	if (snd.frame_count <= 0) {
-		snd.frame_count = 4096; // idk some random samples nr this should never hit tho, just to be safe
+		return 0; // SND_init failed or hasn't run yet, nothing to write into
 	}
+	uint64_t trace_start = TRACE_begin();
 
-	if (snd.frame_in < 0 || snd.frame_in >= snd.frame_count) {
-		snd.frame_in = 0;
-	}
-
-	if (snd.frame_out < 0 || snd.frame_out >= snd.frame_count) {
-		snd.frame_out = 0;
-	}
-
-	float remaining_space = 0.0f;
-	if (snd.frame_in >= snd.frame_out) {
-		remaining_space = snd.frame_count - (snd.frame_in - snd.frame_out);
-	} else {
-		remaining_space = snd.frame_out - snd.frame_in;
-	}
+	float remaining_space = AudioRing_space(&snd.ring) + 1;
 	currentbufferfree = remaining_space;
 
     float tempdelay = ((snd.frame_count - remaining_space) / snd.sample_rate_out) * 1000.0f;
     currentbufferms = tempdelay;
 
-    float tempratio = 1.0f;
-
     // do some checks
     if (current_fps <= 0.0f || !isfinite(current_fps)) {
         current_fps = 0.01f;
@@ -2162,167 +2310,40 @@ size_t SND_batchSamples(const SND_Frame *frames, size_t frame_count) {
         snd.frame_rate = 60.0f;
     }
 
-    float bufferadjustment = calculateBufferAdjustment(remaining_space, snd.frame_count * 0.5f, snd.frame_count, frame_count);
-
-    if (!isfinite(bufferadjustment)) {
-        bufferadjustment = 0.0f;
-    }
-    float safe_ratio = snd.frame_rate / current_fps;
-    if (!isfinite(safe_ratio)) {
-        safe_ratio = 1.0f;
-    }
-    float target_ratio = tempratio * safe_ratio + bufferadjustment;
-    if (!isfinite(target_ratio)) {
-        target_ratio = 1.0f;
-    }
-    if (!isfinite(ratio)) {
-        ratio = 1.0;
-    }
-
-	// add some interpolation so the audio hardware has some time to recover itself no need to immediately react with big drops!
-    ratio = 0.999 * ratio + 0.001 * target_ratio;
-
-    if (!isfinite(ratio)) {
-        ratio = 1.0;
-    }
-
-	// limit ratio so it wont go crazy for some reason
-    if (ratio > 1.5)
-        ratio = 1.5;
-    else if (ratio < 0.5)
-        ratio = 0.5;
+    double ratio = AudioSync_dynamicRatio(&snd_sync, remaining_space, snd.frame_count, snd.frame_rate, current_fps);
 
     currentratio = (ratio > 0.0) ? ratio : current_fps;
 
-    while (framecount > 0) {
-        int amount = MIN(BATCH_SIZE, framecount);
-
-        // Copy frames to tmpbuffer for resampling
-        for (int i = 0; i < amount; i++) {
-            tmpbuffer[i] = frames[consumed + i];
-        }
-        consumed += amount;
-        framecount -= amount;
-
-        ResampledFrames resampled = resample_audio(
-            tmpbuffer, amount, snd.sample_rate_in, snd.sample_rate_out, ratio);
-
-        int written_frames = 0;
-        for (int i = 0; i < resampled.frame_count; i++) {
-            // Check if buffer full (leave one slot free)
-            if ((snd.frame_in + 1) % snd.frame_count == snd.frame_out) {
-                // Buffer full, break early
-                break;
-            }
-            pthread_mutex_lock(&audio_mutex);
-            snd.buffer[snd.frame_in] = resampled.frames[i];
-            snd.frame_in = (snd.frame_in + 1) % snd.frame_count;
-            pthread_mutex_unlock(&audio_mutex);
-            written_frames++;
-        }
-
-        total_consumed_frames += written_frames;
-        free(resampled.frames);
-    }
-
-    return total_consumed_frames;
+    size_t written = SND_resample(frames, frame_count, ratio);
+    TRACE_end(TRACE_AUDIO, 0, trace_start);
+    return written;
 }
 
 
-enum {
-	SND_FF_ON_TIME,
-	SND_FF_LATE,
-	SND_FF_VERY_LATE
-};
-
 size_t SND_batchSamples_fixed_rate(const SND_Frame *frames, size_t frame_count) {
-	static int current_mode = SND_FF_ON_TIME;
-
-	int framecount = (int)frame_count;
-
-	int consumed = 0;
-	int total_consumed_frames = 0;
-
 	//printf("received %d audio frames\n", frame_count);
 
 	//int full = 0;
 
-	float remaining_space=snd.frame_count;
-	if (snd.frame_in >= snd.frame_out) {
-		remaining_space = snd.frame_count - (snd.frame_in - snd.frame_out);
-	}
-	else {
-		remaining_space = snd.frame_out - snd.frame_in;
+	if (snd.frame_count <= 0) {
+		return 0;
 	}
+	uint64_t trace_start = TRACE_begin();
+
+	float remaining_space = AudioRing_space(&snd.ring) + 1;
 	//printf("    actual free: %g\n", remaining_space);
 	currentbufferfree = remaining_space;
 	float tempdelay = ((snd.frame_count - remaining_space) / snd.sample_rate_out) * 1000;
 	currentbufferms = tempdelay;
 
 	float occupancy = (float) (snd.frame_count - currentbufferfree) / snd.frame_count;
-	switch(current_mode) {
-		case SND_FF_ON_TIME:
-			if (occupancy > 0.65) {
-				current_mode = SND_FF_LATE;
-			}
-			break;
-		case SND_FF_LATE:
-			if (occupancy > 0.85) {
-				current_mode = SND_FF_VERY_LATE;
-			}
-			else if (occupancy < 0.25) {
-				current_mode = SND_FF_ON_TIME;
-			}
-			break;
-		case SND_FF_VERY_LATE:
-			if (occupancy < 0.50) {
-				current_mode = SND_FF_LATE;
-			}
-			break;
-	}
-
-	switch(current_mode) {
-		case SND_FF_ON_TIME:   ratio = 1.0; break;
-		case SND_FF_LATE:      ratio = 0.995; break;
-		case SND_FF_VERY_LATE: ratio = 0.980; break;
-		default: ratio = 1.0;
-	}
+	double ratio = AudioSync_fixedRatio(&snd_sync, occupancy);
 	currentratio = ratio;
 
-	while (framecount > 0) {
-		
-		int amount = MIN(BATCH_SIZE, framecount);
-
-		for (int i = 0; i < amount; i++) {
-			tmpbuffer[i] = frames[consumed + i];
-		}
-		consumed += amount;
-		framecount -= amount;
-
-		ResampledFrames resampled = resample_audio(
-			tmpbuffer, amount, snd.sample_rate_in, snd.sample_rate_out, ratio);
-
-		// Write resampled frames to the buffer
-		int written_frames = 0;
-		
-		for (int i = 0; i < resampled.frame_count; i++) {
-			if ((snd.frame_in + 1) % snd.frame_count == snd.frame_out) {
-				// Buffer is full, break. This should never happen tho, but just to be safe
-				break;
-			}
-			pthread_mutex_lock(&audio_mutex);
-			snd.buffer[snd.frame_in] = resampled.frames[i];
-			snd.frame_in = (snd.frame_in + 1) % snd.frame_count;
-			pthread_mutex_unlock(&audio_mutex);
-			written_frames++;
-			
-		}
-		
-		total_consumed_frames += written_frames;
-		free(resampled.frames);
-	}
-
-	return total_consumed_frames;
+	// Buffer full should never happen tho, but anything that doesn't fit is dropped
+	size_t written = SND_resample(frames, frame_count, ratio);
+	TRACE_end(TRACE_AUDIO, 0, trace_start);
+	return written;
 }
 
 void SND_init(double sample_rate, double frame_rate) { // plat_sound_init
@@ -2363,6 +2384,7 @@ void SND_init(double sample_rate, double frame_rate) { // plat_sound_init
 	currentsamplerateout = snd.sample_rate_out;
 	
 	SND_resizeBuffer();
+	SND_initResampler(snd.sample_rate_in, snd.sample_rate_out);
 	
 	SDL_PauseAudio(0);
 
@@ -2375,10 +2397,8 @@ void SND_quit(void) { // plat_sound_finish
 	SDL_PauseAudio(1);
 	SDL_CloseAudio();
 	
-	if (snd.buffer) {
-		free(snd.buffer);
-		snd.buffer = NULL;
-	}
+	AudioRing_free(&snd.ring);
+	SND_quitResampler();
 }
 
 void SND_resetAudio(double sample_rate, double frame_rate) {
@@ -2895,7 +2915,8 @@ void PWR_update(int* _dirty, int* _show_setting, PWR_callback_t before_sleep, PW
 	}
 
 	uint32_t now = SDL_GetTicks();
-	if (was_charging || PAD_anyPressed() || last_input_at==0) last_input_at = now;
+	// ticks start over if SDL is shut down and brought back up, see nextui's Resident_run
+	if (was_charging || PAD_anyPressed() || last_input_at==0 || now<last_input_at) last_input_at = now;
 	
 	#define CHARGE_DELAY 1000
 	if (dirty || now-checked_charge_at>=CHARGE_DELAY) {
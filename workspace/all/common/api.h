@@ -96,6 +96,8 @@ extern int currentshaderdstw;
 extern int currentshaderdsth;
 extern int currentshadertexw;
 extern int currentshadertexh;
+extern double currentuploadms;
+extern int currentglcalls;
 extern double currentcpuse;
 extern int currentcputemp;
 extern int should_rotate;
@@ -171,6 +173,11 @@ enum {
 	EFFECT_COUNT,
 };
 
+enum {
+	RENDERER_SRC_RGBA8888,
+	RENDERER_SRC_RGB565, // uploaded to the GL texture as-is, no conversion
+};
+
 typedef struct GFX_Renderer {
 	void* src;
 	void* dst;
@@ -187,6 +194,8 @@ typedef struct GFX_Renderer {
 	int src_w;
 	int src_h;
 	int src_p;
+	int src_fmt; // RENDERER_SRC_*
+	int src_dupe; // src is NULL, present what was uploaded last
 	
 	// TODO: I think this is overscaled
 	int dst_x;
@@ -342,7 +351,7 @@ int GFX_blitButtonGroup(char** hints, int primary, SDL_Surface* dst, int align_r
 void GFX_assetRect(int asset, SDL_Rect* dst_rect);
 void GFX_sizeText(TTF_Font* font, const char* str, int leading, int* w, int* h);
 void GFX_blitText(TTF_Font* font, const char* str, int leading, SDL_Color color, SDL_Surface* dst, SDL_Rect* dst_rect);
-void GFX_setAmbientColor(const void *data, unsigned width, unsigned height, size_t pitch,int mode);
+int GFX_setAmbientColor(const void *data, unsigned width, unsigned height, size_t pitch, int format, int mode);
 
 void GFX_ApplyRoundedCorners(SDL_Surface* surface, SDL_Rect* rect, int radius);
 void GFX_ApplyRoundedCorners16(SDL_Surface* surface, SDL_Rect* rect, int radius);
@@ -351,16 +360,36 @@ void GFX_ApplyRoundedCorners_RGBA8888(SDL_Surface* surface, SDL_Rect* rect, int
 void BlitRGBA4444toRGB565(SDL_Surface* src, SDL_Surface* dest, SDL_Rect* dest_rect);
 ///////////////////////////////
 
+// frame tracing, TRACE_begin returns 0 while disabled and TRACE_end ignores that
+enum {
+	TRACE_FRAME,		// frame to frame time, recorded by TRACE_frame
+	TRACE_CORE_RUN,		// arg is the cpu speed in MHz
+	TRACE_CONVERT,
+	TRACE_BLIT,
+	TRACE_FLIP,			// includes waiting for vsync or the frame pacing delay
+	TRACE_UPLOAD,		// source frame to texture, cpu side only
+	TRACE_SHADER_PASS,	// arg is the pass index
+	TRACE_SWAP,
+	TRACE_AUDIO,
+	TRACE_COUNT,
+};
+
+extern int trace_enabled;
+void TRACE_enable(int enable);
+uint64_t TRACE_begin(void);
+void TRACE_end(int type, int arg, uint64_t start);
+void TRACE_frame(void);
+double TRACE_percentile(int type, double p); // ms
+void TRACE_logStats(const char* label);
+int TRACE_dump(const char* path, const char* label); // chrome trace json, 0 on success
+
+///////////////////////////////
+
 typedef struct SND_Frame {
 	int16_t left;
 	int16_t right;
 } SND_Frame;
 
-typedef struct {
-	SND_Frame* frames;
-	int frame_count;
-} ResampledFrames;
-
 void SND_init(double sample_rate, double frame_rate);
 size_t SND_batchSamples(const SND_Frame* frames, size_t frame_count);
 size_t SND_batchSamples_fixed_rate(const SND_Frame* frames, size_t frame_count);
@@ -602,6 +631,7 @@ void PLAT_setShader2(const char* filename);
 void PLAT_setShader3(const char* filename);
 void PLAT_updateShader(int i, const char *filename, int *scale, int *filter, int *scaletype, int *inputtype);
 void PLAT_initShaders();
+int PLAT_warmShaderCache(void);
 ShaderParam* PLAT_getShaderPragmas(int i);
 int PLAT_supportsOverscan(void);
 
@@ -619,7 +649,9 @@ void PLAT_powerOff(int reboot);
 
 void *PLAT_cpu_monitor(void *arg);
 void PLAT_setCPUSpeed(int speed); // enum
-void PLAT_setCustomCPUSpeed(int speed);
+void PLAT_setCustomCPUSpeed(int speed); // kHz
+void PLAT_resetCPUSpeed(void); // forget the cached speed after another process changed it
+int PLAT_getCPUFrequencies(const int** freqs); // MHz, ascending, returns the count or 0 if speed can't be set freely
 void PLAT_setRumble(int strength);
 int PLAT_pickSampleRate(int requested, int max);
 
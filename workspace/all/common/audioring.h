@@ -0,0 +1,148 @@
+#ifndef __AUDIORING_H__
+#define __AUDIORING_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+//	single producer / single consumer lock free ring buffer for audio frames
+//
+//	the producer (core thread) only calls AudioRing_write and the consumer
+//	(audio callback) only calls AudioRing_read, both copy in at most two
+//	memcpy spans. read/write indices are atomics, everything else is owned
+//	by one side. AudioRing_init/reset/free must only be called while the
+//	consumer is stopped (eg. inside SDL_LockAudio).
+//
+//	has no SDL dependency so it can be exercised on a desktop build:
+//		AudioRing ring;
+//		AudioRing_init(&ring, 8, sizeof(int32_t));
+//		AudioRing_write(&ring, in, 10); // returns 7, overruns == 3
+//		AudioRing_read(&ring, out, 10); // returns 7, underruns == 3
+//
+
+typedef struct AudioRing {
+	uint8_t* data;
+	size_t frame_size;	// bytes
+	size_t frame_count;	// slots, one is always kept free to tell full from empty
+
+	_Atomic size_t frame_in;	// written by producer
+	_Atomic size_t frame_out;	// written by consumer
+
+	size_t overruns;	// frames dropped by AudioRing_write, producer owned
+	size_t underruns;	// frames missing in AudioRing_read, consumer owned
+} AudioRing;
+
+static inline void AudioRing_reset(AudioRing* ring) {
+	if (ring->data) memset(ring->data, 0, ring->frame_count * ring->frame_size);
+	atomic_store(&ring->frame_in, 0);
+	atomic_store(&ring->frame_out, 0);
+	ring->overruns = 0;
+	ring->underruns = 0;
+}
+static inline int AudioRing_init(AudioRing* ring, size_t frame_count, size_t frame_size) {
+	frame_count += 1; // for the free slot
+	uint8_t* data = realloc(ring->data, frame_count * frame_size);
+	if (!data) return -1;
+	ring->data = data;
+	ring->frame_count = frame_count;
+	ring->frame_size = frame_size;
+	AudioRing_reset(ring);
+	return 0;
+}
+static inline void AudioRing_free(AudioRing* ring) {
+	free(ring->data);
+	ring->data = NULL;
+	ring->frame_count = 0;
+}
+
+// frames queued, exact for the consumer, a lower bound for the producer
+static inline size_t AudioRing_used(AudioRing* ring) {
+	if (!ring->frame_count) return 0;
+	size_t in = atomic_load_explicit(&ring->frame_in, memory_order_acquire);
+	size_t out = atomic_load_explicit(&ring->frame_out, memory_order_acquire);
+	return in>=out ? in-out : ring->frame_count-(out-in);
+}
+// frames that can be written, exact for the producer, a lower bound for the consumer
+static inline size_t AudioRing_space(AudioRing* ring) {
+	if (!ring->frame_count) return 0;
+	return ring->frame_count - 1 - AudioRing_used(ring);
+}
+// usable capacity in frames
+static inline size_t AudioRing_capacity(const AudioRing* ring) {
+	return ring->frame_count ? ring->frame_count - 1 : 0;
+}
+
+// producer only, returns the number of frames queued, the rest is dropped
+static inline size_t AudioRing_write(AudioRing* ring, const void* frames, size_t count) {
+	if (!ring->frame_count) return 0;
+	size_t in = atomic_load_explicit(&ring->frame_in, memory_order_relaxed);
+	size_t out = atomic_load_explicit(&ring->frame_out, memory_order_acquire);
+	size_t space = ring->frame_count - 1 - (in>=out ? in-out : ring->frame_count-(out-in));
+
+	size_t todo = count<space ? count : space;
+	ring->overruns += count - todo;
+	if (!todo) return 0;
+
+	size_t first = ring->frame_count - in;
+	if (first>todo) first = todo;
+	memcpy(ring->data + in * ring->frame_size, frames, first * ring->frame_size);
+	if (todo>first) memcpy(ring->data, (const uint8_t*)frames + first * ring->frame_size, (todo - first) * ring->frame_size);
+
+	in += todo;
+	if (in>=ring->frame_count) in -= ring->frame_count;
+	atomic_store_explicit(&ring->frame_in, in, memory_order_release);
+	return todo;
+}
+
+// producer only, exposes the free space as (up to) two spans so it can be
+// filled in place, publish what was actually filled with AudioRing_commit
+static inline size_t AudioRing_prepare(AudioRing* ring, void** first, size_t* first_count, void** second, size_t* second_count) {
+	*first = *second = NULL;
+	*first_count = *second_count = 0;
+	if (!ring->frame_count) return 0;
+	size_t in = atomic_load_explicit(&ring->frame_in, memory_order_relaxed);
+	size_t out = atomic_load_explicit(&ring->frame_out, memory_order_acquire);
+	size_t space = ring->frame_count - 1 - (in>=out ? in-out : ring->frame_count-(out-in));
+	if (!space) return 0;
+
+	*first = ring->data + in * ring->frame_size;
+	*first_count = ring->frame_count - in;
+	if (*first_count>=space) *first_count = space;
+	else {
+		*second = ring->data;
+		*second_count = space - *first_count;
+	}
+	return space;
+}
+static inline void AudioRing_commit(AudioRing* ring, size_t count) {
+	size_t in = atomic_load_explicit(&ring->frame_in, memory_order_relaxed);
+	in += count;
+	if (in>=ring->frame_count) in -= ring->frame_count;
+	atomic_store_explicit(&ring->frame_in, in, memory_order_release);
+}
+
+// consumer only, returns the number of frames copied, the caller fills the rest with silence
+static inline size_t AudioRing_read(AudioRing* ring, void* frames, size_t count) {
+	if (!ring->frame_count) return 0;
+	size_t out = atomic_load_explicit(&ring->frame_out, memory_order_relaxed);
+	size_t in = atomic_load_explicit(&ring->frame_in, memory_order_acquire);
+	size_t used = in>=out ? in-out : ring->frame_count-(out-in);
+
+	size_t todo = count<used ? count : used;
+	ring->underruns += count - todo;
+	if (!todo) return 0;
+
+	size_t first = ring->frame_count - out;
+	if (first>todo) first = todo;
+	memcpy(frames, ring->data + out * ring->frame_size, first * ring->frame_size);
+	if (todo>first) memcpy((uint8_t*)frames + first * ring->frame_size, ring->data, (todo - first) * ring->frame_size);
+
+	out += todo;
+	if (out>=ring->frame_count) out -= ring->frame_count;
+	atomic_store_explicit(&ring->frame_out, out, memory_order_release);
+	return todo;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef __AUDIOSYNC_H__
+#define __AUDIOSYNC_H__
+
+#include <math.h>
+#include <string.h>
+
+//
+//	audio rate control used by SND_batchSamples (dynamic rate, core paced
+//	by the display) and SND_batchSamples_fixed_rate (core paced by its own
+//	fps), it picks the resampling ratio from the audio ring fill level
+//
+//	kept free of SDL so the avsync tool can drive the exact same code
+//	headless when tuning these numbers
+//
+
+#define AUDIOSYNC_WINDOW 5 // rolling average of buffer adjustments
+
+enum {
+	AUDIOSYNC_ON_TIME,
+	AUDIOSYNC_LATE,
+	AUDIOSYNC_VERY_LATE
+};
+
+typedef struct AudioSync {
+	double ratio;
+	float adjustment_history[AUDIOSYNC_WINDOW];
+	int adjustment_index;
+	int fixed_mode; // AUDIOSYNC_*
+} AudioSync;
+
+static inline void AudioSync_reset(AudioSync* sync) {
+	memset(sync, 0, sizeof(AudioSync));
+	sync->ratio = 1.0;
+}
+
+static inline float AudioSync_bufferAdjustment(AudioSync* sync, float remaining_space, float targetbuffer_over, float targetbuffer_under) {
+
+    float midpoint = (targetbuffer_over + targetbuffer_under) / 2.0f;
+
+    float normalizedDistance;
+    if (remaining_space < midpoint) {
+        normalizedDistance = (midpoint - remaining_space) / (midpoint - targetbuffer_over);
+    } else {
+        normalizedDistance = (remaining_space - midpoint) / (targetbuffer_under - midpoint);
+    }
+	// I make crazy small adjustments, mooore tiny is mooore stable :D But don't come neir the limits cuz imma hit ya with that 0.005 ratio adjustment, pow pow!
+    // I wonder if staying in the middle of 0 to 4000 with 512 samples per batch playing at tiny different speeds each iteration is like the smallest I can get
+	// lets say hovering around 2000 means 2000 samples queue, about 4 frames, so at 17ms(60fps) thats  68ms delay right?
+	// Should have payed attention when my math teacher was talking dammit
+	// Also I chose 3 for pow, but idk if that really the best nr, anyone good in maths looking at my code?
+	float adjustment = 0.000001f + (0.005f - 0.000001f) * pow(normalizedDistance, 3);
+
+    if (remaining_space < midpoint) {
+        adjustment = -adjustment;
+    }
+
+    sync->adjustment_history[sync->adjustment_index] = adjustment;
+    sync->adjustment_index = (sync->adjustment_index + 1) % AUDIOSYNC_WINDOW;
+
+    // Calculate the rolling average
+    float rolling_average = 0.0f;
+    for (int i = 0; i < AUDIOSYNC_WINDOW; ++i) {
+        rolling_average += sync->adjustment_history[i];
+    }
+    rolling_average /= AUDIOSYNC_WINDOW;
+
+    return rolling_average;
+}
+
+// core runs at the display rate so audio has to be stretched by
+// core_fps/display_fps, nudged towards keeping the buffer 1/4 full
+static inline double AudioSync_dynamicRatio(AudioSync* sync, float remaining_space, float buffer_size, double core_fps, double display_fps) {
+    float tempratio = 1.0f;
+
+    float bufferadjustment = AudioSync_bufferAdjustment(sync, remaining_space, buffer_size * 0.5f, buffer_size);
+
+    if (!isfinite(bufferadjustment)) {
+        bufferadjustment = 0.0f;
+    }
+    float safe_ratio = core_fps / display_fps;
+    if (!isfinite(safe_ratio)) {
+        safe_ratio = 1.0f;
+    }
+    float target_ratio = tempratio * safe_ratio + bufferadjustment;
+    if (!isfinite(target_ratio)) {
+        target_ratio = 1.0f;
+    }
+    if (!isfinite(sync->ratio)) {
+        sync->ratio = 1.0;
+    }
+
+	// add some interpolation so the audio hardware has some time to recover itself no need to immediately react with big drops!
+    sync->ratio = 0.999 * sync->ratio + 0.001 * target_ratio;
+
+    if (!isfinite(sync->ratio)) {
+        sync->ratio = 1.0;
+    }
+
+	// limit ratio so it wont go crazy for some reason
+    if (sync->ratio > 1.5)
+        sync->ratio = 1.5;
+    else if (sync->ratio < 0.5)
+        sync->ratio = 0.5;
+
+    return sync->ratio;
+}
+
+// core paces itself, only slow the audio down a notch when the buffer runs full
+static inline double AudioSync_fixedRatio(AudioSync* sync, float occupancy) {
+	switch(sync->fixed_mode) {
+		case AUDIOSYNC_ON_TIME:
+			if (occupancy > 0.65) {
+				sync->fixed_mode = AUDIOSYNC_LATE;
+			}
+			break;
+		case AUDIOSYNC_LATE:
+			if (occupancy > 0.85) {
+				sync->fixed_mode = AUDIOSYNC_VERY_LATE;
+			}
+			else if (occupancy < 0.25) {
+				sync->fixed_mode = AUDIOSYNC_ON_TIME;
+			}
+			break;
+		case AUDIOSYNC_VERY_LATE:
+			if (occupancy < 0.50) {
+				sync->fixed_mode = AUDIOSYNC_LATE;
+			}
+			break;
+	}
+
+	switch(sync->fixed_mode) {
+		case AUDIOSYNC_ON_TIME:   sync->ratio = 1.0; break;
+		case AUDIOSYNC_LATE:      sync->ratio = 0.995; break;
+		case AUDIOSYNC_VERY_LATE: sync->ratio = 0.980; break;
+		default: sync->ratio = 1.0;
+	}
+	return sync->ratio;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef __CPUGOV_H__
+#define __CPUGOV_H__
+
+#include <stdint.h>
+#include <string.h>
+
+//
+//	predictive cpu frequency governor used by minarch's Auto overclock
+//
+//	fed once per frame with how long the core took to emulate it (flip and
+//	vsync waits excluded) and the frequency it ran at. their product is the
+//	frame's work in cycles which predicts how long that frame would take at
+//	any other frequency, so it can pick the lowest frequency whose p99 over
+//	the last CPUGOV_WINDOW frames still fits the frame budget instead of
+//	stepping one notch at a time after the fact.
+//
+//	scaling up is immediate, scaling down needs CPUGOV_HOLD frames in a row
+//	that fit a lower frequency with some extra margin
+//
+//	kept free of SDL and sysfs so the govsim tool can replay recorded
+//	traces through the exact same code
+//
+
+#define CPUGOV_WINDOW 120			// frames in the rolling p99, about 2 seconds
+#define CPUGOV_HOLD 60				// frames a lower frequency has to fit before stepping down
+#define CPUGOV_HEADROOM 0.80		// share of the frame budget the core may use, the rest is flip, audio and the os
+#define CPUGOV_MARGIN 0.90			// applied on top of the headroom when stepping down
+#define CPUGOV_BUCKETS 256
+#define CPUGOV_BUCKET_KCYCLES 250	// session histogram resolution, up to 64M cycles per frame
+#define CPUGOV_MIN_FRAMES 600		// don't learn from sessions shorter than this
+
+typedef struct CPUGovernor {
+	const int* freqs;	// MHz, ascending
+	int freq_count;
+	int index;			// into freqs
+	double budget_us;
+
+	uint32_t work[CPUGOV_WINDOW]; // kcycles
+	int work_index;
+	int work_count;
+	int hold;
+
+	uint32_t histogram[CPUGOV_BUCKETS]; // whole session, see CPUGov_sessionP99
+	uint32_t frames;
+	uint32_t misses;	// frames that took longer than the budget
+	uint32_t switches;
+} CPUGovernor;
+
+// lowest frequency that runs kcycles in share of the budget
+static inline int CPUGov_fit(CPUGovernor* gov, uint32_t kcycles, double share) {
+	for (int i=0; i<gov->freq_count; i++) {
+		if (kcycles * 1000.0 / gov->freqs[i] <= gov->budget_us * share) return i;
+	}
+	return gov->freq_count - 1;
+}
+
+// learned is the p99 work of previous sessions in kcycles, 0 if unknown
+static inline void CPUGov_init(CPUGovernor* gov, const int* freqs, int freq_count, double fps, uint32_t learned) {
+	memset(gov, 0, sizeof(CPUGovernor));
+	gov->freqs = freqs;
+	gov->freq_count = freq_count;
+	gov->budget_us = 1000000.0 / (fps>0 ? fps : 60.0);
+	gov->index = learned ? CPUGov_fit(gov, learned, CPUGOV_HEADROOM) : freq_count - 1;
+}
+
+static inline void CPUGov_setFPS(CPUGovernor* gov, double fps) {
+	gov->budget_us = 1000000.0 / (fps>0 ? fps : 60.0);
+}
+
+static inline int CPUGov_getFrequency(CPUGovernor* gov) {
+	return gov->freqs[gov->index];
+}
+
+// p99 of the rolling window, the k-th largest sample
+static inline uint32_t CPUGov_p99(CPUGovernor* gov) {
+	uint32_t top[CPUGOV_WINDOW / 100 + 1] = {0};
+	int k = gov->work_count / 100 + 1;
+	for (int i=0; i<gov->work_count; i++) {
+		uint32_t value = gov->work[i];
+		for (int j=0; j<k; j++) {
+			if (value > top[j]) {
+				uint32_t tmp = top[j];
+				top[j] = value;
+				value = tmp;
+			}
+		}
+	}
+	return top[k-1];
+}
+
+// call once per emulated frame, returns the frequency to run the next one at in MHz
+static inline int CPUGov_frame(CPUGovernor* gov, double work_us, int mhz) {
+	if (work_us < 0) work_us = 0;
+	double kcycles = work_us * mhz / 1000.0;
+	if (kcycles > UINT32_MAX) kcycles = UINT32_MAX;
+
+	gov->work[gov->work_index] = kcycles;
+	gov->work_index = (gov->work_index + 1) % CPUGOV_WINDOW;
+	if (gov->work_count < CPUGOV_WINDOW) gov->work_count++;
+
+	int bucket = kcycles / CPUGOV_BUCKET_KCYCLES;
+	if (bucket >= CPUGOV_BUCKETS) bucket = CPUGOV_BUCKETS - 1;
+	gov->histogram[bucket]++;
+	gov->frames++;
+	if (work_us > gov->budget_us) gov->misses++;
+
+	uint32_t p99 = CPUGov_p99(gov);
+	int up = CPUGov_fit(gov, p99, CPUGOV_HEADROOM);
+	int down = CPUGov_fit(gov, p99, CPUGOV_HEADROOM * CPUGOV_MARGIN);
+
+	int index = gov->index;
+	if (up > index) {
+		index = up;
+		gov->hold = 0;
+	}
+	else if (down < index && gov->work_count >= CPUGOV_HOLD) {
+		if (++gov->hold >= CPUGOV_HOLD) {
+			index = down;
+			gov->hold = 0;
+		}
+	}
+	else gov->hold = 0;
+
+	if (index != gov->index) {
+		gov->index = index;
+		gov->switches++;
+	}
+	return gov->freqs[gov->index];
+}
+
+// p99 work of the whole session in kcycles, 0 if there's too little to go on
+static inline uint32_t CPUGov_sessionP99(CPUGovernor* gov) {
+	if (gov->frames < CPUGOV_MIN_FRAMES) return 0;
+	uint32_t target = gov->frames - gov->frames / 100;
+	uint32_t seen = 0;
+	for (int i=0; i<CPUGOV_BUCKETS; i++) {
+		seen += gov->histogram[i];
+		if (seen >= target) return (i + 1) * CPUGOV_BUCKET_KCYCLES; // upper edge of the bucket
+	}
+	return CPUGOV_BUCKETS * CPUGOV_BUCKET_KCYCLES;
+}
+
+// blends this session into a previously learned value
+static inline uint32_t CPUGov_learn(CPUGovernor* gov, uint32_t learned) {
+	uint32_t session = CPUGov_sessionP99(gov);
+	if (!session) return learned;
+	if (!learned) return session;
+	return (learned + session) / 2;
+}
+
+#endif
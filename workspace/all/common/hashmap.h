@@ -0,0 +1,125 @@
+#ifndef __HASHMAP_H__
+#define __HASHMAP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+//	string to string map with open addressing (linear probing), keys and
+//	values are copied into an arena that HashMap_free releases in one go
+//
+//	there's no delete, nextui only fills these from map.txt and friends,
+//	looks things up and throws the whole map away
+//
+//	has no SDL dependency so the hashbench tool can build it on a desktop:
+//		HashMap* map = HashMap_new();
+//		HashMap_set(map, "Tetris (World).gb", "Tetris");
+//		HashMap_get(map, "Tetris (World).gb"); // "Tetris"
+//		HashMap_free(map);
+//
+
+#define HASHMAP_MIN_CAPACITY 16 // slots, always a power of 2
+#define HASHMAP_ARENA_BLOCK (16 * 1024)
+
+typedef struct HashMapSlot {
+	uint32_t hash;
+	char* key; // NULL if empty
+	char* value;
+} HashMapSlot;
+
+typedef struct HashMapBlock {
+	struct HashMapBlock* next;
+	size_t used;
+	size_t size;
+	char data[];
+} HashMapBlock;
+
+typedef struct HashMap {
+	HashMapSlot* slots;
+	uint32_t capacity;
+	uint32_t count;
+	HashMapBlock* arena;
+} HashMap;
+
+// FNV-1a
+static inline uint32_t HashMap_hash(const char* str) {
+	uint32_t hash = 2166136261u;
+	while (*str) hash = (hash ^ (uint8_t)*str++) * 16777619u;
+	return hash;
+}
+
+static inline char* HashMap_copy(HashMap* self, const char* str) {
+	size_t len = strlen(str) + 1;
+	HashMapBlock* block = self->arena;
+	if (!block || block->used+len>block->size) {
+		size_t size = len>HASHMAP_ARENA_BLOCK ? len : HASHMAP_ARENA_BLOCK;
+		block = malloc(sizeof(HashMapBlock) + size);
+		block->next = self->arena;
+		block->used = 0;
+		block->size = size;
+		self->arena = block;
+	}
+	char* copy = block->data + block->used;
+	memcpy(copy, str, len);
+	block->used += len;
+	return copy;
+}
+
+static inline HashMap* HashMap_new(void) {
+	HashMap* self = malloc(sizeof(HashMap));
+	self->capacity = HASHMAP_MIN_CAPACITY;
+	self->count = 0;
+	self->slots = calloc(self->capacity, sizeof(HashMapSlot));
+	self->arena = NULL;
+	return self;
+}
+static inline void HashMap_free(HashMap* self) {
+	HashMapBlock* block = self->arena;
+	while (block) {
+		HashMapBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+	free(self->slots);
+	free(self);
+}
+
+static inline HashMapSlot* HashMap_find(HashMap* self, const char* key, uint32_t hash) {
+	uint32_t mask = self->capacity - 1;
+	for (uint32_t i=hash&mask;; i=(i+1)&mask) {
+		HashMapSlot* slot = &self->slots[i];
+		if (!slot->key || (slot->hash==hash && strcmp(slot->key, key)==0)) return slot;
+	}
+}
+static inline void HashMap_grow(HashMap* self) {
+	HashMapSlot* slots = self->slots;
+	uint32_t capacity = self->capacity;
+
+	self->capacity *= 2;
+	self->slots = calloc(self->capacity, sizeof(HashMapSlot));
+	for (uint32_t i=0; i<capacity; i++) {
+		if (!slots[i].key) continue;
+		*HashMap_find(self, slots[i].key, slots[i].hash) = slots[i];
+	}
+	free(slots);
+}
+
+// replaces the value if key is already set
+static inline void HashMap_set(HashMap* self, const char* key, const char* value) {
+	if ((self->count+1)*4 > self->capacity*3) HashMap_grow(self); // keep under 75% full
+
+	uint32_t hash = HashMap_hash(key);
+	HashMapSlot* slot = HashMap_find(self, key, hash);
+	if (!slot->key) {
+		slot->hash = hash;
+		slot->key = HashMap_copy(self, key);
+		self->count++;
+	}
+	slot->value = HashMap_copy(self, value);
+}
+static inline char* HashMap_get(HashMap* self, const char* key) {
+	return HashMap_find(self, key, HashMap_hash(key))->value;
+}
+
+#endif
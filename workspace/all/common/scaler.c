@@ -3,6 +3,10 @@
 #include <string.h>
 
 #include "platform.h" // for HAS_NEON
+#include "scaler.h"
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 //
 //	arm NEON / C integer scalers for ARMv7 devices
@@ -3070,4 +3074,138 @@ void scale3x_grid(void* __restrict src, void* __restrict dst, uint32_t sw, uint3
 			dst_row += 3;
 		}
 	}
-}
\ No newline at end of file
+}
+//
+//	pixel format converters
+//
+
+static inline uint32_t convert_rgb565_px(uint16_t p) {
+	uint32_t r = ((p >> 11) & 0x1F) << 3;
+	uint32_t g = ((p >> 5) & 0x3F) << 2;
+	uint32_t b = (p & 0x1F) << 3;
+	return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+static inline uint32_t convert_xrgb8888_px(uint32_t p) {
+	return 0xFF000000 | ((p & 0xFF) << 16) | (p & 0xFF00) | ((p >> 16) & 0xFF);
+}
+
+void convert_rgb565_rgba8888_c(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp) {
+	if (!sp) sp = w * sizeof(uint16_t);
+	if (!dp) dp = w * sizeof(uint32_t);
+	for (uint32_t y=0; y<h; y++) {
+		const uint16_t* s = (const uint16_t*)((const uint8_t*)src + y * sp);
+		uint32_t* d = (uint32_t*)((uint8_t*)dst + y * dp);
+		for (uint32_t x=0; x<w; x++) d[x] = convert_rgb565_px(s[x]);
+	}
+}
+void convert_xrgb8888_rgba8888_c(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp) {
+	if (!sp) sp = w * sizeof(uint32_t);
+	if (!dp) dp = w * sizeof(uint32_t);
+	for (uint32_t y=0; y<h; y++) {
+		const uint32_t* s = (const uint32_t*)((const uint8_t*)src + y * sp);
+		uint32_t* d = (uint32_t*)((uint8_t*)dst + y * dp);
+		for (uint32_t x=0; x<w; x++) d[x] = convert_xrgb8888_px(s[x]);
+	}
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+// 128-bit gcc vector extensions, lowered to SSE2/NEON/etc by the compiler
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+void convert_rgb565_rgba8888_v(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp) {
+	if (!sp) sp = w * sizeof(uint16_t);
+	if (!dp) dp = w * sizeof(uint32_t);
+	const v8u16 lo_mask = {0,8,1,9,2,10,3,11};
+	const v8u16 hi_mask = {4,12,5,13,6,14,7,15};
+	for (uint32_t y=0; y<h; y++) {
+		const uint16_t* s = (const uint16_t*)((const uint8_t*)src + y * sp);
+		uint32_t* d = (uint32_t*)((uint8_t*)dst + y * dp);
+		uint32_t x = 0;
+		for (; x+8<=w; x+=8) {
+			v8u16 p;
+			memcpy(&p, s+x, sizeof(p));
+			// low half of each output pixel is r|g<<8, high half is b|a<<8
+			v8u16 rg = ((p >> 8) & 0xF8) | (((p >> 3) & 0xFC) << 8);
+			v8u16 ba = ((p << 3) & 0xF8) | 0xFF00;
+			v8u16 lo = __builtin_shuffle(rg, ba, lo_mask);
+			v8u16 hi = __builtin_shuffle(rg, ba, hi_mask);
+			memcpy(d+x, &lo, sizeof(lo));
+			memcpy(d+x+4, &hi, sizeof(hi));
+		}
+		for (; x<w; x++) d[x] = convert_rgb565_px(s[x]);
+	}
+}
+void convert_xrgb8888_rgba8888_v(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp) {
+	if (!sp) sp = w * sizeof(uint32_t);
+	if (!dp) dp = w * sizeof(uint32_t);
+	for (uint32_t y=0; y<h; y++) {
+		const uint32_t* s = (const uint32_t*)((const uint8_t*)src + y * sp);
+		uint32_t* d = (uint32_t*)((uint8_t*)dst + y * dp);
+		uint32_t x = 0;
+		for (; x+4<=w; x+=4) {
+			v4u32 p;
+			memcpy(&p, s+x, sizeof(p));
+			v4u32 o = ((p & 0xFF) << 16) | (p & 0xFF00) | ((p >> 16) & 0xFF) | 0xFF000000;
+			memcpy(d+x, &o, sizeof(o));
+		}
+		for (; x<w; x++) d[x] = convert_xrgb8888_px(s[x]);
+	}
+}
+#endif
+
+#ifdef __ARM_NEON
+void convert_rgb565_rgba8888_n(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp) {
+	if (!sp) sp = w * sizeof(uint16_t);
+	if (!dp) dp = w * sizeof(uint32_t);
+	const uint8x8_t r_mask = vdup_n_u8(0xF8);
+	const uint8x8_t g_mask = vdup_n_u8(0xFC);
+	const uint8x8_t alpha = vdup_n_u8(0xFF);
+	for (uint32_t y=0; y<h; y++) {
+		const uint16_t* s = (const uint16_t*)((const uint8_t*)src + y * sp);
+		uint32_t* d = (uint32_t*)((uint8_t*)dst + y * dp);
+		uint32_t x = 0;
+		for (; x+8<=w; x+=8) {
+			uint16x8_t p = vld1q_u16(s+x);
+			uint8x8x4_t o;
+			o.val[0] = vand_u8(vshrn_n_u16(p, 8), r_mask);
+			o.val[1] = vand_u8(vshrn_n_u16(p, 3), g_mask);
+			o.val[2] = vshl_n_u8(vmovn_u16(p), 3);
+			o.val[3] = alpha;
+			vst4_u8((uint8_t*)(d+x), o);
+		}
+		for (; x<w; x++) d[x] = convert_rgb565_px(s[x]);
+	}
+}
+void convert_xrgb8888_rgba8888_n(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp) {
+	if (!sp) sp = w * sizeof(uint32_t);
+	if (!dp) dp = w * sizeof(uint32_t);
+	const uint8x16_t alpha = vdupq_n_u8(0xFF);
+	for (uint32_t y=0; y<h; y++) {
+		const uint32_t* s = (const uint32_t*)((const uint8_t*)src + y * sp);
+		uint32_t* d = (uint32_t*)((uint8_t*)dst + y * dp);
+		uint32_t x = 0;
+		for (; x+16<=w; x+=16) {
+			// little endian XRGB8888 is b,g,r,x in memory
+			uint8x16x4_t p = vld4q_u8((const uint8_t*)(s+x));
+			uint8x16x4_t o;
+			o.val[0] = p.val[2];
+			o.val[1] = p.val[1];
+			o.val[2] = p.val[0];
+			o.val[3] = alpha;
+			vst4q_u8((uint8_t*)(d+x), o);
+		}
+		for (; x<w; x++) d[x] = convert_xrgb8888_px(s[x]);
+	}
+}
+#endif
+
+convert_t convert_getRGBA8888(int src_format) {
+#if defined(__ARM_NEON)
+	return src_format==CONVERT_XRGB8888 ? convert_xrgb8888_rgba8888_n : convert_rgb565_rgba8888_n;
+#elif defined(__GNUC__) && !defined(__clang__)
+	return src_format==CONVERT_XRGB8888 ? convert_xrgb8888_rgba8888_v : convert_rgb565_rgba8888_v;
+#else
+	return src_format==CONVERT_XRGB8888 ? convert_xrgb8888_rgba8888_c : convert_rgb565_rgba8888_c;
+#endif
+}
@@ -187,4 +187,37 @@ void scale4x_line(void* __restrict src, void* __restrict dst, uint32_t sw, uint3
 void scale2x_grid(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp);
 void scale3x_grid(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp);
 
+//
+//	pixel format converters, output is RGBA8888 in memory byte order (GL_RGBA/GL_UNSIGNED_BYTE)
+//	args/	src :	src address
+//		dst :	dst address
+//		w   :	width			pixels
+//		h   :	height			pixels
+//		sp  :	src pitch (stride)	bytes	if 0, (w * [2|4]) is used
+//		dp  :	dst pitch (stride)	bytes	if 0, (w * 4) is used
+//
+//	n/v/c	= neon intrinsics (aarch64), gcc vector extensions or plain c
+//	convert_get* returns the fastest one available for this build
+//
+
+typedef void (*convert_t)(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+
+enum {
+	CONVERT_RGB565,
+	CONVERT_XRGB8888,
+};
+
+convert_t convert_getRGBA8888(int src_format);
+
+#ifdef __ARM_NEON
+void convert_rgb565_rgba8888_n(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+void convert_xrgb8888_rgba8888_n(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+#endif
+#if defined(__GNUC__) && !defined(__clang__)
+void convert_rgb565_rgba8888_v(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+void convert_xrgb8888_rgba8888_v(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+#endif
+void convert_rgb565_rgba8888_c(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+void convert_xrgb8888_rgba8888_c(const void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t sp, uint32_t dp);
+
 #endif
@@ -28,7 +28,8 @@ int main(int argc, char *argv[])
         if (strcmp(argv[i], "start") == 0) {
             if (i + 1 < argc) {
                 LOG_info("Start tracking: %s\n", argv[i+1]);
-                play_activity_start(argv[++i]);
+                if (play_activity_start(argv[++i]) != 0)
+                    return EXIT_FAILURE;
             }
             else {
                 printf("Error: Missing rom_path argument\n");
@@ -43,7 +44,8 @@ int main(int argc, char *argv[])
         else if (strcmp(argv[i], "stop") == 0) {
             if (i + 1 < argc) {
                 LOG_info("Stop tracking: %s\n", argv[i+1]);
-                play_activity_stop(argv[++i]);
+                if (play_activity_stop(argv[++i]) != 0)
+                    return EXIT_FAILURE;
             }
             else {
                 printf("Error: Missing rom_path argument\n");
@@ -0,0 +1,198 @@
+// replays recorded frame times through the cpu governor in cpugov.h to
+// see which frequencies it would pick and whether frames would still make
+// their budget, without touching a device
+//
+// input is a trace saved by minarch's Save Trace shortcut (core.run events
+// carry the speed they ran at, flip events inside them are waiting, not
+// work) or plain text with one "work_us mhz" pair per line
+//
+//	govsim -c 60.0988 trace-GBA-20240101-120000.json
+//	govsim -l 9000 -v frames.txt > governor.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpugov.h"
+
+// mirrored from tg5040's platform.c
+static int default_freqs[] = {408,450,500,550,  600,650,700,750, 800,850,900,950, 1000,1050,1100,1150, 1200,1250,1300,1350, 1400,1450,1500,1550, 1600,1650,1700,1750, 1800,1850,1900,1950, 2000};
+
+#define MAX_FREQS 64
+
+static struct {
+	double fps;
+	int freqs[MAX_FREQS];
+	int freq_count;
+	uint32_t learned; // kcycles
+	int verbose;
+} opt = {
+	.fps = 60.0,
+	.learned = 0,
+	.verbose = 0,
+};
+
+typedef struct Frame {
+	double work; // kcycles
+} Frame;
+
+static Frame* frames = NULL;
+static int frame_count = 0;
+static int frame_capacity = 0;
+
+static void addFrame(double work_us, int mhz) {
+	if (frame_count==frame_capacity) {
+		frame_capacity = frame_capacity ? frame_capacity * 2 : 4096;
+		frames = realloc(frames, frame_capacity * sizeof(Frame));
+		if (!frames) {
+			fprintf(stderr, "govsim: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	frames[frame_count++].work = (work_us>0 ? work_us : 0) * mhz / 1000.0;
+}
+
+static double getNumber(const char* line, const char* key) {
+	const char* tmp = strstr(line, key);
+	return tmp ? atof(tmp + strlen(key)) : -1;
+}
+
+///////////////////////////////
+
+// TRACE_dump writes one event per line in the order they ended so the
+// flips of a frame always come before its core.run
+static int loadFrames(FILE* file) {
+	char line[512];
+	double flip_start[64];
+	double flip_duration[64];
+	int flips = 0;
+
+	while (fgets(line, sizeof(line), file)) {
+		if (strstr(line, "\"name\":")) {
+			if (strstr(line, "\"name\":\"flip\"")) {
+				if (flips<64) {
+					flip_start[flips] = getNumber(line, "\"ts\":");
+					flip_duration[flips] = getNumber(line, "\"dur\":");
+					flips++;
+				}
+			}
+			else if (strstr(line, "\"name\":\"core.run\"")) {
+				double start = getNumber(line, "\"ts\":");
+				double work = getNumber(line, "\"dur\":");
+				int mhz = getNumber(line, "\"mhz\":");
+				for (int i=0; i<flips; i++) {
+					if (flip_start[i]>=start) work -= flip_duration[i];
+				}
+				flips = 0;
+				if (mhz>0) addFrame(work, mhz);
+			}
+		}
+		else {
+			double work;
+			int mhz;
+			if (sscanf(line, "%lf %i", &work, &mhz)==2 && mhz>0) addFrame(work, mhz);
+		}
+	}
+	return frame_count;
+}
+
+static int compareDouble(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void printUsage(void) {
+	printf("usage: govsim [options] <trace.json|frames.txt|->\n");
+	printf("  -c <fps>          core fps, sets the frame budget (default %.4f)\n", opt.fps);
+	printf("  -F <mhz,mhz,...>  available frequencies, ascending (default tg5040's)\n");
+	printf("  -l <kcycles>      learned profile to start from, as in <game>.cpu (default none)\n");
+	printf("  -v                print a frame,work_kcycles,mhz,time_us csv line per frame\n");
+}
+
+int main(int argc, char* argv[]) {
+	memcpy(opt.freqs, default_freqs, sizeof(default_freqs));
+	opt.freq_count = sizeof(default_freqs) / sizeof(default_freqs[0]);
+
+	int c;
+	while ((c = getopt(argc, argv, "c:F:l:vh")) != -1) {
+		switch (c) {
+			case 'c': opt.fps = atof(optarg); break;
+			case 'F': {
+				opt.freq_count = 0;
+				for (char* tmp=strtok(optarg, ","); tmp && opt.freq_count<MAX_FREQS; tmp=strtok(NULL, ",")) {
+					opt.freqs[opt.freq_count++] = atoi(tmp);
+				}
+				break;
+			}
+			case 'l': opt.learned = strtoul(optarg, NULL, 10); break;
+			case 'v': opt.verbose = 1; break;
+			default: printUsage(); return c=='h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (optind>=argc || opt.fps<=0 || !opt.freq_count) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	for (int i=0; i<opt.freq_count; i++) {
+		if (opt.freqs[i]<=0 || (i && opt.freqs[i]<=opt.freqs[i-1])) {
+			fprintf(stderr, "govsim: frequencies must be positive and ascending\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	FILE* file = strcmp(argv[optind], "-")==0 ? stdin : fopen(argv[optind], "r");
+	if (!file) {
+		fprintf(stderr, "govsim: couldn't open %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	loadFrames(file);
+	if (file!=stdin) fclose(file);
+	if (!frame_count) {
+		fprintf(stderr, "govsim: no frames in %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	CPUGovernor gov;
+	CPUGov_init(&gov, opt.freqs, opt.freq_count, opt.fps, opt.learned);
+
+	double* times = malloc(frame_count * sizeof(double));
+	uint32_t residency[MAX_FREQS] = {0};
+	double mhz_sum = 0;
+	double max_work = 0;
+
+	if (opt.verbose) printf("frame,work_kcycles,mhz,time_us\n");
+	for (int i=0; i<frame_count; i++) {
+		// the recorded work takes this long at whatever the governor picked
+		int mhz = CPUGov_getFrequency(&gov);
+		double time_us = frames[i].work * 1000.0 / mhz;
+		times[i] = time_us;
+		residency[gov.index]++;
+		mhz_sum += mhz;
+		if (frames[i].work>max_work) max_work = frames[i].work;
+		if (opt.verbose) printf("%i,%.0f,%i,%.1f\n", i, frames[i].work, mhz, time_us);
+		CPUGov_frame(&gov, time_us, mhz);
+	}
+	if (opt.verbose) return EXIT_SUCCESS;
+
+	qsort(times, frame_count, sizeof(double), compareDouble);
+	double p50 = times[frame_count / 2];
+	double p99 = times[frame_count - 1 - frame_count / 100];
+
+	printf("frames        %i at %.4f fps, budget %.0fus, core may use %.0fus\n", frame_count, opt.fps, gov.budget_us, gov.budget_us * CPUGOV_HEADROOM);
+	printf("core time     p50 %.0fus p99 %.0fus max %.0fus\n", p50, p99, times[frame_count-1]);
+	printf("over budget   %u frames (%.2f%%)\n", gov.misses, 100.0 * gov.misses / frame_count);
+	printf("average speed %.0fMHz, %u switches\n", mhz_sum / frame_count, gov.switches);
+	printf("max work      %.0f kcycles, fits %iMHz\n", max_work, opt.freqs[CPUGov_fit(&gov, max_work, CPUGOV_HEADROOM)]);
+	printf("learned       %u kcycles (session p99), would start at %iMHz\n", CPUGov_learn(&gov, opt.learned), opt.freqs[CPUGov_fit(&gov, CPUGov_learn(&gov, opt.learned), CPUGOV_HEADROOM)]);
+	printf("residency\n");
+	for (int i=0; i<opt.freq_count; i++) {
+		if (residency[i]) printf("  %4iMHz %6.2f%%\n", opt.freqs[i], 100.0 * residency[i] / frame_count);
+	}
+
+	free(times);
+	free(frames);
+	return p99>gov.budget_us ? 2 : EXIT_SUCCESS;
+}
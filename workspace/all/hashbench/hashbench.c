@@ -0,0 +1,171 @@
+// times applying map.txt aliases to a big synthetic folder with nextui's
+// old array backed Hash (a linear scan per lookup, done twice per entry)
+// against the HashMap in hashmap.h it was replaced with
+//
+//	hashbench -n 5000 -m 5000
+//	hashbench -n 20000 -m 2000 -r 10
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+
+static struct {
+	int files;
+	int aliases;
+	int runs;
+} opt = {
+	.files = 5000,
+	.aliases = 5000,
+	.runs = 5,
+};
+
+static double getMilliseconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+///////////////////////////////
+
+// what nextui had, minus the Array type
+typedef struct Hash {
+	char** keys;
+	char** values;
+	int count;
+} Hash;
+
+static Hash* Hash_new(int capacity) {
+	Hash* self = malloc(sizeof(Hash));
+	self->keys = malloc(capacity * sizeof(char*));
+	self->values = malloc(capacity * sizeof(char*));
+	self->count = 0;
+	return self;
+}
+static void Hash_free(Hash* self) {
+	for (int i=0; i<self->count; i++) {
+		free(self->keys[i]);
+		free(self->values[i]);
+	}
+	free(self->keys);
+	free(self->values);
+	free(self);
+}
+static void Hash_set(Hash* self, char* key, char* value) {
+	self->keys[self->count] = strdup(key);
+	self->values[self->count] = strdup(value);
+	self->count++;
+}
+static char* Hash_get(Hash* self, char* key) {
+	for (int i=0; i<self->count; i++) {
+		if (strcmp(self->keys[i], key)==0) return self->values[i];
+	}
+	return NULL;
+}
+
+///////////////////////////////
+
+// no-intro style names so keys share long prefixes like real sets do
+static char* makeName(int i) {
+	static const char* regions[] = {"USA", "Europe", "Japan", "World", "USA, Europe"};
+	char name[256];
+	sprintf(name, "Some Fairly Long Game Title %05i (%s) (Rev %i).gba", i, regions[i % 5], i % 3);
+	return strdup(name);
+}
+
+static void shuffle(int* items, int count) {
+	for (int i=count-1; i>0; i--) {
+		int j = rand() % (i + 1);
+		int tmp = items[i];
+		items[i] = items[j];
+		items[j] = tmp;
+	}
+}
+
+static void printUsage(void) {
+	printf("usage: hashbench [options]\n");
+	printf("  -n <count>  files in the folder (default %i)\n", opt.files);
+	printf("  -m <count>  lines in map.txt (default %i)\n", opt.aliases);
+	printf("  -r <count>  runs, the fastest is reported (default %i)\n", opt.runs);
+}
+
+int main(int argc, char* argv[]) {
+	int c;
+	while ((c = getopt(argc, argv, "n:m:r:h")) != -1) {
+		switch (c) {
+			case 'n': opt.files = atoi(optarg); break;
+			case 'm': opt.aliases = atoi(optarg); break;
+			case 'r': opt.runs = atoi(optarg); break;
+			default: printUsage(); return c=='h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (opt.files<=0 || opt.aliases<0 || opt.runs<=0) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+	char** files = malloc(opt.files * sizeof(char*));
+	for (int i=0; i<opt.files; i++) files[i] = makeName(i);
+
+	// map.txt is rarely in folder order and may name files that are gone
+	int* order = malloc(opt.aliases * sizeof(int));
+	for (int i=0; i<opt.aliases; i++) order[i] = (int)((int64_t)i * 5 / 4 % (opt.files * 5 / 4 + 1));
+	shuffle(order, opt.aliases);
+	char** keys = malloc(opt.aliases * sizeof(char*));
+	for (int i=0; i<opt.aliases; i++) keys[i] = makeName(order[i]);
+
+	double linear_ms = 0;
+	double hashed_ms = 0;
+	int linear_hits = 0;
+	int hashed_hits = 0;
+
+	for (int run=0; run<opt.runs; run++) {
+		double start = getMilliseconds();
+		Hash* hash = Hash_new(opt.aliases);
+		for (int i=0; i<opt.aliases; i++) Hash_set(hash, keys[i], "Alias");
+		linear_hits = 0;
+		for (int pass=0; pass<2; pass++) { // Directory_index looked every entry up twice
+			for (int i=0; i<opt.files; i++) {
+				if (Hash_get(hash, files[i])) linear_hits++;
+			}
+		}
+		Hash_free(hash);
+		double ms = getMilliseconds() - start;
+		if (!run || ms<linear_ms) linear_ms = ms;
+
+		start = getMilliseconds();
+		HashMap* map = HashMap_new();
+		for (int i=0; i<opt.aliases; i++) {
+			if (!HashMap_get(map, keys[i])) HashMap_set(map, keys[i], "Alias");
+		}
+		hashed_hits = 0;
+		for (int i=0; i<opt.files; i++) {
+			if (HashMap_get(map, files[i])) hashed_hits++;
+		}
+		HashMap_free(map);
+		ms = getMilliseconds() - start;
+		if (!run || ms<hashed_ms) hashed_ms = ms;
+	}
+
+	if (linear_hits!=hashed_hits*2) {
+		fprintf(stderr, "hashbench: lookups disagree (%i vs %i)\n", linear_hits/2, hashed_hits);
+		return EXIT_FAILURE;
+	}
+
+	printf("%i files, %i aliases, %i found, best of %i\n", opt.files, opt.aliases, hashed_hits, opt.runs);
+	printf("  linear  %9.3fms\n", linear_ms);
+	printf("  hashmap %9.3fms\n", hashed_ms);
+	printf("  %.1fx faster\n", hashed_ms>0 ? linear_ms / hashed_ms : 0);
+
+	for (int i=0; i<opt.files; i++) free(files[i]);
+	for (int i=0; i<opt.aliases; i++) free(keys[i]);
+	free(files);
+	free(keys);
+	free(order);
+	return EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
 // heavily modified from the Onion original: https://github.com/OnionUI/Onion/blob/main/src/playActivity/playActivityDB.h
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include <defines.h>
@@ -15,6 +16,72 @@
 #define GAMETIME_LOG_PATH SHARED_USERDATA_PATH
 #define GAMETIME_LOG_FILE GAMETIME_LOG_PATH "/game_logs.sqlite"
 
+// bumped with every entry added to migrations, kept in PRAGMA user_version
+#define GAMETIME_DB_VERSION 1
+
+static const char *migrations[GAMETIME_DB_VERSION] = {
+    // per rom totals kept up to date by triggers as sessions close so the Game
+    // Tracker doesn't GROUP BY the whole history every time it opens. negative
+    // play times (the clock went backwards) are left out, stop_all deletes them.
+    // play_activity is otherwise append only so nothing needs subtracting
+    "CREATE TABLE IF NOT EXISTS rom_summary(rom_id INTEGER PRIMARY KEY, play_count INTEGER, play_time_total INTEGER, first_played_at INTEGER, last_played_at INTEGER);"
+    "CREATE INDEX IF NOT EXISTS rom_summary_play_time_index ON rom_summary(play_time_total);"
+    "DELETE FROM rom_summary;"
+    "INSERT INTO rom_summary SELECT rom_id, COUNT(play_time), SUM(play_time), MIN(created_at), MAX(created_at) FROM play_activity WHERE play_time >= 0 GROUP BY rom_id;"
+    "CREATE TRIGGER IF NOT EXISTS play_activity_closed AFTER UPDATE OF play_time ON play_activity WHEN OLD.play_time IS NULL AND NEW.play_time >= 0 BEGIN"
+    "    INSERT OR IGNORE INTO rom_summary VALUES(NEW.rom_id, 0, 0, NEW.created_at, NEW.created_at);"
+    "    UPDATE rom_summary SET play_count = play_count + 1, play_time_total = play_time_total + NEW.play_time,"
+    "        first_played_at = MIN(first_played_at, NEW.created_at), last_played_at = MAX(last_played_at, NEW.created_at) WHERE rom_id = NEW.rom_id;"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS play_activity_imported AFTER INSERT ON play_activity WHEN NEW.play_time >= 0 BEGIN"
+    "    INSERT OR IGNORE INTO rom_summary VALUES(NEW.rom_id, 0, 0, NEW.created_at, NEW.created_at);"
+    "    UPDATE rom_summary SET play_count = play_count + 1, play_time_total = play_time_total + NEW.play_time,"
+    "        first_played_at = MIN(first_played_at, NEW.created_at), last_played_at = MAX(last_played_at, NEW.created_at) WHERE rom_id = NEW.rom_id;"
+    "END;"
+    // every start and stop looks a rom up by path, stop and stop_all only
+    // touch open sessions and stop_all clears out negative ones
+    "CREATE INDEX IF NOT EXISTS rom_file_path_index ON rom(file_path);"
+    "CREATE INDEX IF NOT EXISTS rom_name_index ON rom(name);"
+    "CREATE INDEX IF NOT EXISTS play_activity_open_index ON play_activity(rom_id) WHERE play_time IS NULL;"
+    "CREATE INDEX IF NOT EXISTS play_activity_negative_index ON play_activity(play_time) WHERE play_time < 0;",
+};
+
+static int __db_get_version(sqlite3 *game_log_db)
+{
+    int version = 0;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(game_log_db, "PRAGMA user_version;", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        version = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+static void __db_migrate(sqlite3 *game_log_db)
+{
+    if (__db_get_version(game_log_db) >= GAMETIME_DB_VERSION)
+        return;
+
+    // another process may be migrating too, check again once we hold the lock
+    if (sqlite3_exec(game_log_db, "BEGIN IMMEDIATE;", NULL, NULL, NULL) != SQLITE_OK)
+        return;
+
+    int rc = SQLITE_OK;
+    for (int version = __db_get_version(game_log_db); version < GAMETIME_DB_VERSION && rc == SQLITE_OK; version++) {
+        char *err = NULL;
+        rc = sqlite3_exec(game_log_db, migrations[version], NULL, NULL, &err);
+        if (rc == SQLITE_OK) {
+            char *sql = sqlite3_mprintf("PRAGMA user_version = %d;", version + 1);
+            rc = sqlite3_exec(game_log_db, sql, NULL, NULL, &err);
+            sqlite3_free(sql);
+        }
+        if (rc != SQLITE_OK)
+            printf("migration %d failed: %s\n", version + 1, err);
+        sqlite3_free(err);
+    }
+
+    sqlite3_exec(game_log_db, rc == SQLITE_OK ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+}
+
 sqlite3* play_activity_db_open(void)
 {
     mkdir(GAMETIME_LOG_PATH, 0777);
@@ -30,6 +97,11 @@ sqlite3* play_activity_db_open(void)
         return NULL;
     }
 
+    // readers like the Game Tracker pak don't block nextui or minarch writing and
+    // vice versa, the setting sticks to the file once the first connection sets it
+    sqlite3_exec(game_log_db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, NULL);
+    sqlite3_busy_timeout(game_log_db, 1000);
+
     if (!db_exists) {
         sqlite3_exec(game_log_db,
                      "DROP TABLE IF EXISTS rom;"
@@ -43,6 +115,8 @@ sqlite3* play_activity_db_open(void)
                      NULL, NULL, NULL);
     }
 
+    __db_migrate(game_log_db);
+
     return game_log_db;
 }
 
@@ -57,6 +131,10 @@ void free_play_activities(PlayActivities *pa_ptr)
     for (int i = 0; i < pa_ptr->count; i++) {
         free(pa_ptr->play_activity[i]->first_played_at);
         free(pa_ptr->play_activity[i]->last_played_at);
+        free(pa_ptr->play_activity[i]->rom->type);
+        free(pa_ptr->play_activity[i]->rom->name);
+        free(pa_ptr->play_activity[i]->rom->file_path);
+        free(pa_ptr->play_activity[i]->rom->image_path);
         free(pa_ptr->play_activity[i]->rom);
         free(pa_ptr->play_activity[i]);
     }
@@ -84,365 +162,513 @@ void get_rom_image_path(char *rom_file, char *out_image_path)
     free(clean_rom_name);
 }
 
-int play_activity_db_transaction(sqlite3* game_log_db, int (*exec_transaction)(sqlite3*))
-{
-    int retval;
-    retval = exec_transaction(game_log_db);
-    return retval;
-}
-
-int play_activity_db_execute(char *sql)
-{
-    //LOG_info("play_activity_db_execute(%s)\n", sql);
-    sqlite3* game_log_db = play_activity_db_open();
-    int rc = sqlite3_exec(game_log_db, sql, NULL, NULL, NULL);
-    play_activity_db_close(game_log_db);
-    return rc;
-}
-
-sqlite3_stmt *play_activity_db_prepare(sqlite3* game_log_db, char *sql)
+void __ensure_rel_path(char *rel_path, const char *rom_path)
 {
-    //LOG_info("play_activity_db_prepare(%s)\n", sql);
-    if (game_log_db == NULL) {
-        printf("DB is not open");
-        return NULL;
-    }
-    sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(game_log_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        printf("%s: %s\n", sqlite3_errmsg(game_log_db), sqlite3_sql(stmt));
+    if (!pathRelativeTo(rel_path, ROMS_PATH, rom_path)) {
+        if (strstr(rom_path, "../../Roms/") != NULL) {
+            strcpy(rel_path, strstr(rom_path, "../../Roms/") + strlen("../../Roms/"));
+        }
+        else {
+            char *tmp = replaceString2(rom_path, ROMS_PATH "/", "");
+            strcpy(rel_path, tmp);
+            free(tmp);
+        }
     }
-    return stmt;
 }
 
-int play_activity_get_total_play_time(void)
+bool _get_active_rom_path(char *rom_path_out)
 {
-    int total_play_time = 0;
-    char *sql =
-        "SELECT SUM(play_time_total) FROM (SELECT SUM(play_time) AS play_time_total FROM play_activity GROUP BY rom_id) "
-        "WHERE play_time_total > 60;";
-    sqlite3_stmt *stmt;
+    char *ptr;
+    char cmd[STR_MAX];
+    getFile(CMD_TO_RUN, cmd, STR_MAX);
+    trimTrailingNewlines(cmd);
 
-    sqlite3* game_log_db = play_activity_db_open();
-    stmt = play_activity_db_prepare(game_log_db, sql);
+    if (strlen(cmd) == 0) {
+        return false;
+    }
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        total_play_time = sqlite3_column_int(stmt, 0);
+    if ((ptr = strrchr(cmd, '"')) != NULL) {
+        *ptr = '\0';
     }
 
-    sqlite3_finalize(stmt);
-    play_activity_db_close(game_log_db);
+    if ((ptr = strrchr(cmd, '"')) != NULL) {
+        strncpy(rom_path_out, ptr + 1, STR_MAX);
+        return true;
+    }
 
-    return total_play_time;
+    return false;
 }
 
-PlayActivities *play_activity_find_all(void)
+///////////////////////////////
+
+// connection shared by everything below, opened on first use and kept for the
+// life of the process so starting or stopping a session is a couple of bound
+// statements instead of opening the database and parsing sql every time
+
+enum {
+    STMT_BEGIN,
+    STMT_COMMIT,
+    STMT_ROLLBACK,
+    STMT_ROM_BY_PATH,
+    STMT_ROM_ORPHAN,
+    STMT_ROM_INSERT,
+    STMT_ROM_UPDATE,
+    STMT_START,
+    STMT_STOP,
+    STMT_STOP_ALL,
+    STMT_DELETE_NEGATIVE,
+    STMT_IS_OPEN,
+    STMT_PLAY_TIME,
+    STMT_TOTAL_PLAY_TIME,
+    STMT_FIND_ALL,
+    STMT_COUNT,
+};
+
+static const char *shared_sql[STMT_COUNT] = {
+    [STMT_BEGIN] = "BEGIN IMMEDIATE;",
+    [STMT_COMMIT] = "COMMIT;",
+    [STMT_ROLLBACK] = "ROLLBACK;",
+    [STMT_ROM_BY_PATH] = "SELECT id FROM rom WHERE file_path=? LIMIT 1;",
+    [STMT_ROM_ORPHAN] = "SELECT id FROM rom WHERE (name=? OR name=?) AND type='ORPHAN' LIMIT 1;",
+    [STMT_ROM_INSERT] = "INSERT INTO rom(type, name, file_path, image_path) VALUES('', ?, ?, '');",
+    [STMT_ROM_UPDATE] = "UPDATE rom SET type = '', name = ?, file_path = ?, image_path = '' WHERE id = ?;",
+    [STMT_START] = "INSERT INTO play_activity(rom_id) VALUES(?);",
+    [STMT_STOP] = "UPDATE play_activity SET play_time = (strftime('%s', 'now')) - created_at, updated_at = (strftime('%s', 'now')) WHERE rom_id = ? AND play_time IS NULL;",
+    [STMT_STOP_ALL] = "UPDATE play_activity SET play_time = (strftime('%s', 'now')) - created_at, updated_at = (strftime('%s', 'now')) WHERE play_time IS NULL;",
+    [STMT_DELETE_NEGATIVE] = "DELETE FROM play_activity WHERE play_time < 0;",
+    [STMT_IS_OPEN] = "SELECT 1 FROM play_activity WHERE rom_id = ? AND play_time IS NULL LIMIT 1;",
+    [STMT_PLAY_TIME] = "SELECT play_time_total FROM rom_summary WHERE rom_id = ?;",
+    [STMT_TOTAL_PLAY_TIME] = "SELECT SUM(play_time_total) FROM rom_summary WHERE play_time_total > 60;",
+    [STMT_FIND_ALL] =
+        "SELECT rom.id, rom.type, rom.name, rom.file_path, "
+        "       rom_summary.play_count, rom_summary.play_time_total, "
+        "       rom_summary.play_time_total/rom_summary.play_count, "
+        "       datetime(rom_summary.first_played_at, 'unixepoch'), "
+        "       datetime(rom_summary.last_played_at, 'unixepoch') "
+        "FROM rom_summary JOIN rom ON rom.id = rom_summary.rom_id "
+        "WHERE rom_summary.play_time_total > 0 "
+        "ORDER BY rom_summary.play_time_total DESC;",
+};
+
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sqlite3 *shared_db = NULL;
+static sqlite3_stmt *shared_stmts[STMT_COUNT];
+
+// with shared_mutex held, NULL if the database couldn't be opened
+static sqlite3_stmt *__shared_stmt(int index)
 {
-    PlayActivities *play_activities = NULL;
-    char *sql =
-        "SELECT * FROM ("
-        "    SELECT rom.id, rom.type, rom.name, rom.file_path, "
-        "           COUNT(play_activity.ROWID) AS play_count_total, "
-        "           SUM(play_activity.play_time) AS play_time_total, "
-        "           SUM(play_activity.play_time)/COUNT(play_activity.ROWID) AS play_time_average, "
-        "           datetime(MIN(play_activity.created_at), 'unixepoch') AS first_played_at, "
-        "           datetime(MAX(play_activity.created_at), 'unixepoch') AS last_played_at "
-        "    FROM rom LEFT JOIN play_activity ON rom.id = play_activity.rom_id "
-        "    GROUP BY rom.id) "
-        "WHERE play_time_total > 0 "
-        "ORDER BY play_time_total DESC;";
-    sqlite3_stmt *stmt;
-
-    sqlite3* game_log_db = play_activity_db_open();
-
-    stmt = play_activity_db_prepare(game_log_db, sql);
-
-    int play_activity_count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        play_activity_count++;
-    }
-    sqlite3_reset(stmt);
-
-    play_activities = (PlayActivities *)malloc(sizeof(PlayActivities));
-    play_activities->count = play_activity_count;
-    play_activities->play_time_total = 0;
-    play_activities->play_activity = (PlayActivity **)malloc(sizeof(PlayActivity *) * play_activities->count);
-
-    for (int i = 0; i < play_activities->count; i++) {
-        if (sqlite3_step(stmt) != SQLITE_ROW)
-            break;
-
-        PlayActivity *entry = play_activities->play_activity[i] = (PlayActivity *)malloc(sizeof(PlayActivity));
-        ROM *rom = play_activities->play_activity[i]->rom = (ROM *)malloc(sizeof(ROM));
-        entry->first_played_at = NULL;
-        entry->last_played_at = NULL;
+    if (!shared_db && !(shared_db = play_activity_db_open()))
+        return NULL;
 
-        rom->id = sqlite3_column_int(stmt, 0);
-        rom->type = strdup((const char *)sqlite3_column_text(stmt, 1));
-        rom->name = strdup((const char *)sqlite3_column_text(stmt, 2));
-        if (sqlite3_column_text(stmt, 3) != NULL) {
-            rom->file_path = strdup((const char *)sqlite3_column_text(stmt, 3));
-            rom->image_path = malloc(STR_MAX * sizeof(char));
-            memset(rom->image_path, 0, STR_MAX);
-            get_rom_image_path(rom->file_path, rom->image_path);
+    if (!shared_stmts[index]) {
+        if (sqlite3_prepare_v2(shared_db, shared_sql[index], -1, &shared_stmts[index], NULL) != SQLITE_OK) {
+            printf("%s: %s\n", sqlite3_errmsg(shared_db), shared_sql[index]);
+            return NULL;
         }
-
-        entry->play_count = sqlite3_column_int(stmt, 4);
-        entry->play_time_total = sqlite3_column_int(stmt, 5);
-        entry->play_time_average = sqlite3_column_int(stmt, 6);
-        if (sqlite3_column_text(stmt, 8) != NULL) {
-            entry->first_played_at = strdup((const char *)sqlite3_column_text(stmt, 7));
-        }
-        if (sqlite3_column_text(stmt, 9) != NULL) {
-            entry->last_played_at = strdup((const char *)sqlite3_column_text(stmt, 8));
-        }
-
-        play_activities->play_time_total += entry->play_time_total;
     }
+    sqlite3_reset(shared_stmts[index]);
+    sqlite3_clear_bindings(shared_stmts[index]);
+    return shared_stmts[index];
+}
 
-    sqlite3_finalize(stmt);
-    play_activity_db_close(game_log_db);
-
-    return play_activities;
+static int __shared_step(sqlite3_stmt *stmt)
+{
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+        printf("%s: %s\n", sqlite3_errmsg(shared_db), sqlite3_sql(stmt));
+    return rc;
 }
 
-void __ensure_rel_path(char *rel_path, const char *rom_path)
+// runs a statement that takes no arguments and returns no rows
+static int __shared_run(int index)
 {
-    if (!pathRelativeTo(rel_path, ROMS_PATH, rom_path)) {
-        if (strstr(rom_path, "../../Roms/") != NULL) {
-            strcpy(rel_path, splitString(strdup((const char *)rom_path), "../../Roms/"));
-        }
-        else {
-            strcpy(rel_path, replaceString2(strdup((const char *)rom_path), ROMS_PATH "/", ""));
-        }
+    int rc = SQLITE_ERROR;
+    sqlite3_stmt *stmt = __shared_stmt(index);
+    if (stmt) {
+        rc = __shared_step(stmt);
+        sqlite3_reset(stmt);
     }
+    return rc;
 }
 
-int __db_insert_rom(sqlite3* game_log_db, const char *rom_type, const char *rom_name, const char *file_path, const char *image_path)
+static int __shared_find_id(sqlite3_stmt *stmt)
 {
     int rom_id = ROM_NOT_FOUND;
-
-    char rel_path[MAX_PATH];
-    __ensure_rel_path(rel_path, file_path);
-
-    char *sql = sqlite3_mprintf("INSERT INTO rom(type, name, file_path, image_path) VALUES(%Q, %Q, %Q, %Q);",
-                                rom_type, rom_name, rel_path, image_path);
-    sqlite3_exec(game_log_db, sql, NULL, NULL, NULL);
-    sqlite3_free(sql);
-
-    sqlite3_stmt *stmt = play_activity_db_prepare(game_log_db, "SELECT id FROM rom WHERE ROWID = last_insert_rowid()");
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
+    if (stmt && __shared_step(stmt) == SQLITE_ROW)
         rom_id = sqlite3_column_int(stmt, 0);
-    }
-    sqlite3_finalize(stmt);
-
+    if (stmt)
+        sqlite3_reset(stmt);
     return rom_id;
 }
 
-void __db_update_rom(sqlite3* game_log_db, int rom_id, const char *rom_type, const char *rom_name, const char *file_path, const char *image_path)
+// writes between begin and end land with a single sync instead of one each,
+// returns whether a transaction was opened for __shared_end to close
+static bool __shared_begin(void)
 {
-    char rel_path[MAX_PATH];
-    __ensure_rel_path(rel_path, file_path);
+    return __shared_run(STMT_BEGIN) == SQLITE_DONE;
+}
 
-    char *sql = sqlite3_mprintf("UPDATE rom SET type = %Q, name = %Q, file_path = %Q, image_path = %Q WHERE id = %d;",
-                                rom_type, rom_name, rel_path, image_path, rom_id);
-    sqlite3_exec(game_log_db, sql, NULL, NULL, NULL);
-    sqlite3_free(sql);
+static void __shared_end(bool began)
+{
+    if (began && __shared_run(STMT_COMMIT) != SQLITE_DONE)
+        __shared_run(STMT_ROLLBACK);
 }
 
-int __db_get_orphan_rom_id(sqlite3* game_log_db, const char *rom_path)
+// looks a rom up by path, falling back to an orphan with the same name that
+// then gets adopted, with shared_mutex held
+static int __shared_rom_find(const char *rom_path, bool create)
 {
-    int rom_id = ROM_NOT_FOUND;
+    char rel_path[MAX_PATH];
+    __ensure_rel_path(rel_path, rom_path);
+
+    sqlite3_stmt *stmt = __shared_stmt(STMT_ROM_BY_PATH);
+    if (!stmt)
+        return ROM_NOT_FOUND;
+    sqlite3_bind_text(stmt, 1, rel_path, -1, SQLITE_STATIC);
+    int rom_id = __shared_find_id(stmt);
+    if (rom_id != ROM_NOT_FOUND)
+        return rom_id;
+
     char *_file_name = strdup(rom_path);
     const char *file_name = baseName(_file_name);
     char *rom_name = removeExtension(file_name);
 
-    char *sql = sqlite3_mprintf("SELECT id FROM rom WHERE (name=%Q OR name=%Q) AND type='ORPHAN' LIMIT 1;", rom_name, file_name);
-    sqlite3_stmt *stmt = play_activity_db_prepare(game_log_db, sql);
-    sqlite3_free(sql);
-    free(rom_name);
-    free(_file_name);
-
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        rom_id = sqlite3_column_int(stmt, 0);
+    if ((stmt = __shared_stmt(STMT_ROM_ORPHAN))) {
+        sqlite3_bind_text(stmt, 1, rom_name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, file_name, -1, SQLITE_STATIC);
+        rom_id = __shared_find_id(stmt);
     }
 
-    sqlite3_finalize(stmt);
+    if (rom_id != ROM_NOT_FOUND) {
+        if ((stmt = __shared_stmt(STMT_ROM_UPDATE))) {
+            sqlite3_bind_text(stmt, 1, rom_name, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, rel_path, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 3, rom_id);
+            __shared_step(stmt);
+            sqlite3_reset(stmt);
+        }
+    }
+    else if (create && (stmt = __shared_stmt(STMT_ROM_INSERT))) {
+        sqlite3_bind_text(stmt, 1, rom_name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, rel_path, -1, SQLITE_STATIC);
+        if (__shared_step(stmt) == SQLITE_DONE)
+            rom_id = (int)sqlite3_last_insert_rowid(shared_db); // id is the rowid
+        sqlite3_reset(stmt);
+    }
 
+    free(rom_name);
+    free(_file_name);
     return rom_id;
 }
 
-int __db_get_rom_id_by_path(sqlite3* game_log_db, const char *rom_path)
+// runs index with rom_id bound, with shared_mutex held
+static int __shared_run_rom(int index, int rom_id)
 {
-    int rom_id = ROM_NOT_FOUND;
+    int rc = -1;
+    sqlite3_stmt *stmt;
+    if (rom_id != ROM_NOT_FOUND && (stmt = __shared_stmt(index))) {
+        sqlite3_bind_int(stmt, 1, rom_id);
+        if (__shared_step(stmt) == SQLITE_DONE)
+            rc = 0;
+        sqlite3_reset(stmt);
+    }
+    return rc;
+}
 
-    char rel_path[MAX_PATH];
-    __ensure_rel_path(rel_path, rom_path);
+static int __shared_start(const char *rom_file_path)
+{
+    return __shared_run_rom(STMT_START, __shared_rom_find(rom_file_path, true));
+}
 
-    char *sql = sqlite3_mprintf("SELECT id FROM rom WHERE file_path=%Q LIMIT 1;", rel_path);
-    sqlite3_stmt *stmt = play_activity_db_prepare(game_log_db, sql);
-    sqlite3_free(sql);
+static int __shared_stop(const char *rom_file_path)
+{
+    // rom_summary is updated by the play_activity_closed trigger
+    return __shared_run_rom(STMT_STOP, __shared_rom_find(rom_file_path, false));
+}
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        rom_id = sqlite3_column_int(stmt, 0);
-    }
+static void __shared_stop_all(void)
+{
+    __shared_run(STMT_STOP_ALL);
+    __shared_run(STMT_DELETE_NEGATIVE);
+}
 
-    sqlite3_finalize(stmt);
+int play_activity_start(const char *rom_file_path)
+{
+    //LOG_info("\n:: play_activity_start(%s)\n", rom_file_path);
+    pthread_mutex_lock(&shared_mutex);
+    bool began = __shared_begin();
+    int rc = __shared_start(rom_file_path);
+    __shared_end(began);
+    pthread_mutex_unlock(&shared_mutex);
+    return rc;
+}
 
-    return rom_id;
+int play_activity_stop(const char *rom_file_path)
+{
+    //LOG_info("\n:: play_activity_stop(%s)\n", rom_file_path);
+    pthread_mutex_lock(&shared_mutex);
+    bool began = __shared_begin();
+    int rc = __shared_stop(rom_file_path);
+    __shared_end(began);
+    pthread_mutex_unlock(&shared_mutex);
+    return rc;
 }
 
-int __db_rom_find_by_file_path(sqlite3* game_log_db, const char *rom_path, bool create_or_update)
+void play_activity_stop_all(void)
 {
-    //LOG_info("rom_find_by_file_path('%s')\n", rom_path);
+    //LOG_info("\n:: play_activity_stop_all()");
+    pthread_mutex_lock(&shared_mutex);
+    bool began = __shared_begin();
+    __shared_stop_all();
+    __shared_end(began);
+    pthread_mutex_unlock(&shared_mutex);
+}
 
-    bool update_orphan = false;
-    int rom_id = __db_get_rom_id_by_path(game_log_db, rom_path);
+void play_activity_resume(void)
+{
+    //LOG_info("\n:: play_activity_resume()");
+    char rom_path[STR_MAX];
+    int rom_id = ROM_NOT_FOUND;
 
-    if (rom_id == ROM_NOT_FOUND) {
-        rom_id = __db_get_orphan_rom_id(game_log_db, rom_path);
-        if (rom_id != ROM_NOT_FOUND) {
-            update_orphan = true;
+    pthread_mutex_lock(&shared_mutex);
+    bool began = __shared_begin();
+    if (_get_active_rom_path(rom_path) && (rom_id = __shared_rom_find(rom_path, false)) != ROM_NOT_FOUND) {
+        //LOG_info("Last closed active rom: %s\n", rom_path);
+        sqlite3_stmt *stmt = __shared_stmt(STMT_IS_OPEN);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, rom_id);
+            if (__shared_step(stmt) == SQLITE_ROW)
+                rom_id = ROM_NOT_FOUND; // Activity is not closed
+            sqlite3_reset(stmt);
         }
+        __shared_run_rom(STMT_START, rom_id);
     }
+    __shared_end(began);
+    pthread_mutex_unlock(&shared_mutex);
 
-    if (update_orphan) {
-        char *rom_name = removeExtension(baseName(rom_path));
-        __db_update_rom(game_log_db, rom_id, "", rom_name, rom_path, "");
-        free(rom_name);
-    }
-    else if (rom_id == ROM_NOT_FOUND && create_or_update) {
-        char *rom_name = removeExtension(baseName(rom_path));
-        rom_id = __db_insert_rom(game_log_db, "", rom_name, rom_path, "");
-        free(rom_name);
+    if (rom_id == ROM_NOT_FOUND) {
+        printf("Error: no active rom\n");
+        exit(1);
     }
-
-    return rom_id;
-}
-
-int play_activity_transaction_rom_find_by_file_path(const char *rom_path, bool create_or_update)
-{
-    int retval;
-    sqlite3* game_log_db = play_activity_db_open();
-    retval = __db_rom_find_by_file_path(game_log_db, rom_path, create_or_update);
-    play_activity_db_close(game_log_db);
-    return retval;
 }
 
 int play_activity_get_play_time(const char *rom_path)
 {
     int play_time = 0;
-    sqlite3* game_log_db = play_activity_db_open();
-    int rom_id = __db_rom_find_by_file_path(game_log_db, rom_path, false);
-    if (rom_id != ROM_NOT_FOUND) {
-        char *sql = sqlite3_mprintf("SELECT SUM(play_time) FROM play_activity WHERE rom_id = %d;", rom_id);
-        sqlite3_stmt *stmt = play_activity_db_prepare(game_log_db, sql);
-        sqlite3_free(sql);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
+    pthread_mutex_lock(&shared_mutex);
+    int rom_id = __shared_rom_find(rom_path, false);
+    sqlite3_stmt *stmt;
+    if (rom_id != ROM_NOT_FOUND && (stmt = __shared_stmt(STMT_PLAY_TIME))) {
+        sqlite3_bind_int(stmt, 1, rom_id);
+        if (__shared_step(stmt) == SQLITE_ROW)
             play_time = sqlite3_column_int(stmt, 0);
-        }
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
     }
-    play_activity_db_close(game_log_db);
+    pthread_mutex_unlock(&shared_mutex);
     return play_time;
 }
 
-bool _get_active_rom_path(char *rom_path_out)
+int play_activity_get_total_play_time(void)
 {
-    char *ptr;
-    char cmd[STR_MAX];
-    getFile(CMD_TO_RUN, cmd, STR_MAX);
-    trimTrailingNewlines(cmd);
-
-    if (strlen(cmd) == 0) {
-        return false;
-    }
-
-    if ((ptr = strrchr(cmd, '"')) != NULL) {
-        *ptr = '\0';
-    }
-
-    if ((ptr = strrchr(cmd, '"')) != NULL) {
-        strncpy(rom_path_out, ptr + 1, STR_MAX);
-        return true;
+    int total_play_time = 0;
+    pthread_mutex_lock(&shared_mutex);
+    sqlite3_stmt *stmt = __shared_stmt(STMT_TOTAL_PLAY_TIME);
+    if (stmt) {
+        if (__shared_step(stmt) == SQLITE_ROW)
+            total_play_time = sqlite3_column_int(stmt, 0);
+        sqlite3_reset(stmt);
     }
+    pthread_mutex_unlock(&shared_mutex);
+    return total_play_time;
+}
 
-    return false;
+static char *__column_strdup(sqlite3_stmt *stmt, int column)
+{
+    const char *text = (const char *)sqlite3_column_text(stmt, column);
+    return text ? strdup(text) : NULL;
 }
 
-int __db_get_active_closed_activity(sqlite3* game_log_db)
+PlayActivities *play_activity_find_all(void)
 {
-    int rom_id = ROM_NOT_FOUND;
+    PlayActivities *play_activities = (PlayActivities *)malloc(sizeof(PlayActivities));
+    play_activities->count = 0;
+    play_activities->play_time_total = 0;
+    play_activities->play_activity = NULL;
+    int capacity = 0;
+
+    pthread_mutex_lock(&shared_mutex);
+    sqlite3_stmt *stmt = __shared_stmt(STMT_FIND_ALL);
+    while (stmt && __shared_step(stmt) == SQLITE_ROW) {
+        if (play_activities->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            play_activities->play_activity = (PlayActivity **)realloc(play_activities->play_activity, sizeof(PlayActivity *) * capacity);
+        }
 
-    char rom_path[STR_MAX];
-    if (!_get_active_rom_path(rom_path)) {
-        return ROM_NOT_FOUND;
-    }
+        PlayActivity *entry = play_activities->play_activity[play_activities->count++] = (PlayActivity *)malloc(sizeof(PlayActivity));
+        ROM *rom = entry->rom = (ROM *)malloc(sizeof(ROM));
 
-    //LOG_info("Last closed active rom: %s\n", rom_path);
+        rom->id = sqlite3_column_int(stmt, 0);
+        rom->type = __column_strdup(stmt, 1);
+        rom->name = __column_strdup(stmt, 2);
+        rom->file_path = __column_strdup(stmt, 3);
+        rom->image_path = calloc(STR_MAX, sizeof(char));
+        if (rom->file_path)
+            get_rom_image_path(rom->file_path, rom->image_path);
 
-    if ((rom_id = __db_rom_find_by_file_path(game_log_db, rom_path, false)) == ROM_NOT_FOUND) {
-        return ROM_NOT_FOUND;
+        entry->play_count = sqlite3_column_int(stmt, 4);
+        entry->play_time_total = sqlite3_column_int(stmt, 5);
+        entry->play_time_average = sqlite3_column_int(stmt, 6);
+        entry->first_played_at = __column_strdup(stmt, 7);
+        entry->last_played_at = __column_strdup(stmt, 8);
+
+        play_activities->play_time_total += entry->play_time_total;
     }
+    if (stmt)
+        sqlite3_reset(stmt);
+    pthread_mutex_unlock(&shared_mutex);
 
-    char *sql = sqlite3_mprintf("SELECT * FROM play_activity WHERE rom_id = %d AND play_time IS NULL;", rom_id);
-    sqlite3_stmt *stmt = play_activity_db_prepare(game_log_db, sql);
+    return play_activities;
+}
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        // Activity is not closed
-        rom_id = ROM_NOT_FOUND;
+///////////////////////////////
+
+// for nextui and minarch, queued and written in order by a single background
+// thread so the ui never waits on the sd card. whatever piles up while a
+// write is in flight goes out together in one transaction
+
+enum {
+    JOB_START,
+    JOB_STOP,
+    JOB_STOP_ALL,
+};
+
+typedef struct PlayActivityJob {
+    struct PlayActivityJob *next;
+    int type;
+    char rom_path[];
+} PlayActivityJob;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static PlayActivityJob *queue_head = NULL;
+static PlayActivityJob *queue_tail = NULL;
+static bool writer_started = false;
+static bool writer_busy = false;
+
+// runs and frees a list of jobs
+static void __run_jobs(PlayActivityJob *job)
+{
+    if (!job)
+        return;
+
+    pthread_mutex_lock(&shared_mutex);
+    bool began = __shared_begin();
+    while (job) {
+        PlayActivityJob *next = job->next;
+        switch (job->type) {
+        case JOB_START:
+            __shared_start(job->rom_path);
+            break;
+        case JOB_STOP:
+            __shared_stop(job->rom_path);
+            break;
+        case JOB_STOP_ALL:
+            __shared_stop_all();
+            break;
+        }
+        free(job);
+        job = next;
     }
+    __shared_end(began);
+    pthread_mutex_unlock(&shared_mutex);
+}
 
-    sqlite3_free(sql);
-    sqlite3_finalize(stmt);
-
-    return rom_id;
+// takes everything queued so far, with queue_mutex held
+static PlayActivityJob *__take_jobs(void)
+{
+    PlayActivityJob *jobs = queue_head;
+    queue_head = NULL;
+    queue_tail = NULL;
+    return jobs;
 }
 
-void play_activity_start(char *rom_file_path)
+static void *__writer_thread(void *arg)
 {
-    //LOG_info("\n:: play_activity_start(%s)\n", rom_file_path);
-    int rom_id = play_activity_transaction_rom_find_by_file_path(rom_file_path, true);
-    if (rom_id == ROM_NOT_FOUND) {
-        exit(1);
+    pthread_mutex_lock(&queue_mutex);
+    while (true) {
+        while (!queue_head) {
+            writer_busy = false;
+            pthread_cond_broadcast(&idle_cond);
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+        PlayActivityJob *jobs = __take_jobs();
+        writer_busy = true;
+        pthread_mutex_unlock(&queue_mutex);
+
+        __run_jobs(jobs);
+
+        pthread_mutex_lock(&queue_mutex);
     }
-    char *sql = sqlite3_mprintf("INSERT INTO play_activity(rom_id) VALUES(%d);", rom_id);
-    play_activity_db_execute(sql);
-    sqlite3_free(sql);
+    return NULL;
 }
 
-void play_activity_resume(void)
+static void __queue(int type, const char *rom_path)
 {
-    //LOG_info("\n:: play_activity_resume()");
-    sqlite3* game_log_db = play_activity_db_open();
-    int rom_id = play_activity_db_transaction(game_log_db, __db_get_active_closed_activity);
-    play_activity_db_close(game_log_db);
-    if (rom_id == ROM_NOT_FOUND) {
-        printf("Error: no active rom\n");
-        exit(1);
+    if (!rom_path)
+        rom_path = "";
+    PlayActivityJob *job = malloc(sizeof(PlayActivityJob) + strlen(rom_path) + 1);
+    job->next = NULL;
+    job->type = type;
+    strcpy(job->rom_path, rom_path);
+
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_started) {
+        pthread_t thread;
+        writer_started = pthread_create(&thread, NULL, __writer_thread, NULL) == 0;
+        if (writer_started)
+            pthread_detach(thread);
     }
-    char *sql = sqlite3_mprintf("INSERT INTO play_activity(rom_id) VALUES(%d);", rom_id);
-    play_activity_db_execute(sql);
-    sqlite3_free(sql);
+    if (queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (!writer_started) // write it ourselves rather than lose it
+        play_activity_flush();
 }
 
-void play_activity_stop(char *rom_file_path)
+void play_activity_queue_start(const char *rom_file_path)
 {
-    //LOG_info("\n:: play_activity_stop(%s)\n", rom_file_path);
-    int rom_id = play_activity_transaction_rom_find_by_file_path(rom_file_path, false);
-    if (rom_id == ROM_NOT_FOUND) {
-        exit(1);
-    }
-    char *sql = sqlite3_mprintf("UPDATE play_activity SET play_time = (strftime('%%s', 'now')) - created_at, updated_at = (strftime('%%s', 'now')) WHERE rom_id = %d AND play_time IS NULL;", rom_id);
-    play_activity_db_execute(sql);
-    sqlite3_free(sql);
+    __queue(JOB_START, rom_file_path);
 }
 
-void play_activity_stop_all(void)
+void play_activity_queue_stop(const char *rom_file_path)
 {
-    //LOG_info("\n:: play_activity_stop_all()");
-    play_activity_db_execute(
-        "UPDATE play_activity SET play_time = (strftime('%s', 'now')) - created_at, updated_at = (strftime('%s', 'now')) WHERE play_time IS NULL;"
-        "DELETE FROM play_activity WHERE play_time < 0;");
+    __queue(JOB_STOP, rom_file_path);
+}
+
+void play_activity_queue_stop_all(void)
+{
+    __queue(JOB_STOP_ALL, NULL);
+}
+
+void play_activity_flush(void)
+{
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_started) {
+        // nothing to wait for, run whatever is queued on this thread
+        PlayActivityJob *jobs = __take_jobs();
+        pthread_mutex_unlock(&queue_mutex);
+        __run_jobs(jobs);
+        pthread_mutex_lock(&queue_mutex);
+    }
+    while (queue_head || writer_busy)
+        pthread_cond_wait(&idle_cond, &queue_mutex);
+    pthread_mutex_unlock(&queue_mutex);
 }
 
 void play_activity_list_all(void)
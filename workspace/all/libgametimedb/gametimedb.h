@@ -31,15 +31,25 @@ sqlite3* play_activity_db_open(void);
 void play_activity_db_close(sqlite3* ctx);
 void free_play_activities(PlayActivities *pa_ptr);
 
-// Main interface functions for read access
+// Main interface functions for read access, these come from the per rom totals
+// in rom_summary so they cost the same however long the history is
 PlayActivities *play_activity_find_all(void);
 //int play_activity_get_play_time(const char *rom_path);
 
-// Main interface functions for write access
-void play_activity_start(char *rom_file_path);
+// Main interface functions for write access, thread safe and on a connection
+// kept open for the life of the process. start and stop return 0 on success
+int play_activity_start(const char *rom_file_path);
 void play_activity_resume(void);
-void play_activity_stop(char *rom_file_path);
+int play_activity_stop(const char *rom_file_path);
 void play_activity_stop_all(void);
 void play_activity_list_all(void);
 
+// Same as above but written in order on a background thread, for nextui and
+// minarch. call play_activity_flush() before exiting or handing over to
+// another process that reads or writes play activity
+void play_activity_queue_start(const char *rom_file_path);
+void play_activity_queue_stop(const char *rom_file_path);
+void play_activity_queue_stop_all(void);
+void play_activity_flush(void);
+
 #endif // __gametime_db_h__
\ No newline at end of file
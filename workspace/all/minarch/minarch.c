@@ -9,9 +9,13 @@
 #include <libgen.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 #include <errno.h>
 #include <zip.h> 
 #include <pthread.h>
+#include <sqlite3.h>
+#include <gametimedb.h>
 
 // libretro-common
 #include "libretro.h"
@@ -24,6 +28,7 @@
 #include "api.h"
 #include "utils.h"
 #include "scaler.h"
+#include "cpugov.h"
 #include <dirent.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL.h>
@@ -70,6 +75,15 @@ static int show_debug = 0;
 static int max_ff_speed = 3; // 4x
 static int ff_audio = 0;
 static int fast_forward = 0;
+static int rewind_enable = 0;
+static int rewind_granularity = 2; // frames between snapshots
+static int rewind_buffer_mb = 4;
+static int rewinding = 0;
+static int runahead_frames = 0;
+static int runahead_instance = 0; // RUNAHEAD_SINGLE or RUNAHEAD_SECOND
+static int skip_video = 0; // set while running frames that won't be shown
+static int skip_audio = 0; // set while running speculative frames
+static int skip_input = 0; // set while running speculative frames
 static int overclock = 3; // auto
 static int has_custom_controllers = 0;
 static int gamepad_type = 0; // index in gamepad_labels/gamepad_values
@@ -165,6 +179,7 @@ static struct Core {
 	int initialized;
 	int need_fullpath;
 	
+	const char path[MAX_PATH]; // eg. /mnt/SDCARD/.system/tg5040/cores/gambatte_libretro.so
 	const char tag[8]; // eg. GBC
 	const char name[128]; // eg. gambatte
 	const char version[128]; // eg. Gambatte (v0.5.0-netlink 7e02df6)
@@ -207,7 +222,7 @@ static struct Core {
 	// retro_audio_buffer_status_callback_t audio_buffer_status;
 } core;
 
-int extract_zip(char** extensions);
+int extract_zip(char** extensions, const char* dir);
 
 static struct Game {
 	char path[MAX_PATH];
@@ -216,8 +231,193 @@ static struct Game {
 	char tmp_path[MAX_PATH]; // location of unzipped file
 	void* data;
 	size_t size;
+	int is_mapped; // data is mmap'd instead of malloc'd
 	int is_open;
 } game;
+
+///////////////////////////////////////
+// zip cache, keeps extracted roms on the sd card so big zips only have
+// to be extracted once instead of after every reboot (/tmp is ram)
+//
+// opt in by creating ZIP_CACHE_ENABLE_PATH, it can hold the size limit in
+// MB. entries are keyed by the zip's path, size and mtime so a replaced
+// zip gets extracted again, least recently used entries are evicted
+
+#define ZIP_CACHE_ENABLE_PATH SHARED_USERDATA_PATH "/enable-zip-cache"
+#define ZIP_CACHE_DIR SHARED_USERDATA_PATH "/.zipcache"
+#define ZIP_CACHE_DEFAULT_MB 1024
+
+static uint64_t ZipCache_getLimit(void) {
+	if (!exists(ZIP_CACHE_ENABLE_PATH)) return 0;
+	int mb = getInt(ZIP_CACHE_ENABLE_PATH);
+	return (uint64_t)(mb>0 ? mb : ZIP_CACHE_DEFAULT_MB) * 1024 * 1024;
+}
+static int ZipCache_getDir(const char* zip_path, char* dir) {
+	struct stat st;
+	if (stat(zip_path, &st)!=0) return 0;
+
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* c=zip_path; *c; c++) hash = (hash ^ (uint8_t)*c) * 1099511628211ull;
+	hash = (hash ^ (uint64_t)st.st_size) * 1099511628211ull;
+	hash = (hash ^ (uint64_t)st.st_mtime) * 1099511628211ull;
+
+	sprintf(dir, "%s/%016llx", ZIP_CACHE_DIR, (unsigned long long)hash);
+	return 1;
+}
+// sets game.tmp_path if dir holds a complete extraction
+static int ZipCache_find(const char* dir) {
+	DIR* dh = opendir(dir);
+	if (!dh) return 0;
+
+	int found = 0;
+	struct dirent* dp;
+	while ((dp = readdir(dh))!=NULL) {
+		if (dp->d_name[0]=='.') continue; // includes unfinished extractions
+		sprintf(game.tmp_path, "%s/%s", dir, dp->d_name);
+		found = 1;
+		break;
+	}
+	closedir(dh);
+
+	if (found) utimes(dir, NULL); // mark as recently used
+	return found;
+}
+
+typedef struct ZipCacheEntry {
+	char name[32];
+	time_t used;
+	uint64_t size;
+} ZipCacheEntry;
+
+static int ZipCacheEntry_compare(const void* a, const void* b) {
+	const ZipCacheEntry* x = a;
+	const ZipCacheEntry* y = b;
+	return (x->used > y->used) - (x->used < y->used);
+}
+static void ZipCache_removeDir(const char* dir) {
+	DIR* dh = opendir(dir);
+	if (!dh) return;
+	struct dirent* dp;
+	char path[MAX_PATH];
+	while ((dp = readdir(dh))!=NULL) {
+		if (exactMatch(dp->d_name, ".") || exactMatch(dp->d_name, "..")) continue;
+		sprintf(path, "%s/%s", dir, dp->d_name);
+		unlink(path);
+	}
+	closedir(dh);
+	rmdir(dir);
+}
+// drops least recently used entries until the cache fits in limit, never keep
+static void ZipCache_evict(uint64_t limit, const char* keep) {
+	DIR* dh = opendir(ZIP_CACHE_DIR);
+	if (!dh) return;
+
+	int count = 0;
+	int capacity = 0;
+	ZipCacheEntry* entries = NULL;
+	uint64_t total = 0;
+
+	char dir[MAX_PATH];
+	char path[MAX_PATH];
+	struct stat st;
+	struct dirent* dp;
+	while ((dp = readdir(dh))!=NULL) {
+		if (dp->d_name[0]=='.' || strlen(dp->d_name)>=sizeof(entries->name)) continue;
+		sprintf(dir, "%s/%s", ZIP_CACHE_DIR, dp->d_name);
+		if (stat(dir, &st)!=0 || !S_ISDIR(st.st_mode)) continue;
+
+		if (count==capacity) {
+			capacity = capacity ? capacity * 2 : 32;
+			ZipCacheEntry* tmp = realloc(entries, capacity * sizeof(ZipCacheEntry));
+			if (!tmp) break;
+			entries = tmp;
+		}
+		ZipCacheEntry* entry = &entries[count++];
+		strcpy(entry->name, dp->d_name);
+		entry->used = st.st_mtime;
+		entry->size = 0;
+
+		DIR* files = opendir(dir);
+		if (!files) continue;
+		struct dirent* fp;
+		while ((fp = readdir(files))!=NULL) {
+			sprintf(path, "%s/%s", dir, fp->d_name);
+			if (stat(path, &st)==0 && S_ISREG(st.st_mode)) entry->size += st.st_size;
+		}
+		closedir(files);
+		total += entry->size;
+	}
+	closedir(dh);
+
+	if (total>limit) {
+		qsort(entries, count, sizeof(ZipCacheEntry), ZipCacheEntry_compare);
+		for (int i=0; i<count && total>limit; i++) {
+			sprintf(dir, "%s/%s", ZIP_CACHE_DIR, entries[i].name);
+			if (exactMatch(dir, (char*)keep)) continue;
+			LOG_info("ZipCache_evict: %s (%llu bytes)\n", dir, (unsigned long long)entries[i].size);
+			ZipCache_removeDir(dir);
+			total -= entries[i].size;
+		}
+	}
+	free(entries);
+}
+
+///////////////////////////////////////
+
+// maps the rom instead of reading it up front, pages are loaded as the core
+// touches them and can be dropped again under memory pressure. private and
+// writable because some cores patch the rom buffer in place, the file is
+// never written to. falls back to reading into memory if mmap fails
+static int Game_load(const char* path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd<0) {
+		LOG_error("Error opening game: %s\n\t%s\n", path, strerror(errno));
+		return 0;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st)!=0) {
+		LOG_error("Error opening game: %s\n\t%s\n", path, strerror(errno));
+		close(fd);
+		return 0;
+	}
+	game.size = st.st_size;
+
+	if (game.size) {
+		void* data = mmap(NULL, game.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (data!=MAP_FAILED) {
+			madvise(data, game.size, MADV_WILLNEED);
+			game.data = data;
+			game.is_mapped = 1;
+			close(fd);
+			return 1;
+		}
+		LOG_info("Couldn't map game, reading it instead: %s\n", strerror(errno));
+	}
+
+	game.data = malloc(game.size ? game.size : 1);
+	if (game.data==NULL) {
+		LOG_error("Couldn't allocate memory for file: %s\n", path);
+		close(fd);
+		return 0;
+	}
+	size_t total = 0;
+	while (total<game.size) {
+		ssize_t len = read(fd, (uint8_t*)game.data + total, game.size - total);
+		if (len<=0) {
+			if (len<0 && errno==EINTR) continue;
+			LOG_error("Error reading game: %s\n", path);
+			free(game.data);
+			game.data = NULL;
+			close(fd);
+			return 0;
+		}
+		total += len;
+	}
+	close(fd);
+	return 1;
+}
 static void Game_open(char* path) {
 	LOG_info("Game_open\n");
 	int skipzip = 0;
@@ -259,11 +459,33 @@ static void Game_open(char* path) {
 	
 		// if the core doesn't support zip files natively
 		if (!supports_zip) {
-			// extract zip file located at game.path to game.tmp_path
-			// game.tmp_path is temp dir generated by mkdtemp
-			LOG_info("Extracting zip file manually: %s\n", game.path);
-			if(!extract_zip(extensions))
-				return;
+			char cache_dir[MAX_PATH];
+			uint64_t cache_limit = ZipCache_getLimit();
+			if (cache_limit && ZipCache_getDir(game.path, cache_dir)) {
+				if (ZipCache_find(cache_dir)) {
+					LOG_info("Using cached zip extraction: %s\n", game.tmp_path);
+				}
+				else {
+					LOG_info("Extracting zip file to cache: %s\n", game.path);
+					mkdir(ZIP_CACHE_DIR, 0755);
+					mkdir(cache_dir, 0755);
+					if (!extract_zip(extensions, cache_dir)) {
+						ZipCache_removeDir(cache_dir);
+						return;
+					}
+					ZipCache_evict(cache_limit, cache_dir);
+				}
+			}
+			else {
+				// extract zip file located at game.path to game.tmp_path
+				LOG_info("Extracting zip file manually: %s\n", game.path);
+				char tmp_dirname[255];
+				mkdir("/tmp/nextarch",0777);
+				snprintf(tmp_dirname, sizeof(tmp_dirname), "%s/%s", "/tmp/nextarch",core.tag);
+				mkdir(tmp_dirname,0777);
+				if(!extract_zip(extensions, tmp_dirname))
+					return;
+			}
 		}
 		else {
 			LOG_info("Core can handle zip file: %s\n", game.path);
@@ -274,26 +496,7 @@ static void Game_open(char* path) {
 	// if the frontend tries to load a 500MB file itself bad things happen
 	if (!core.need_fullpath) {
 		path = game.tmp_path[0]=='\0'?game.path:game.tmp_path;
-
-		FILE *file = fopen(path, "r");
-		if (file==NULL) {
-			LOG_error("Error opening game: %s\n\t%s\n", path, strerror(errno));
-			return;
-		}
-	
-		fseek(file, 0, SEEK_END);
-		game.size = ftell(file);
-	
-		rewind(file);
-		game.data = malloc(game.size);
-		if (game.data==NULL) {
-			LOG_error("Couldn't allocate memory for file: %s\n", path);
-			return;
-		}
-	
-		fread(game.data, sizeof(uint8_t), game.size, file);
-	
-		fclose(file);
+		if (!Game_load(path)) return;
 	}
 	
 	// m3u-based?
@@ -328,7 +531,10 @@ static void Game_open(char* path) {
 	game.is_open = 1;
 }
 static void Game_close(void) {
-	if (game.data) free(game.data);
+	if (game.is_mapped) munmap(game.data, game.size);
+	else if (game.data) free(game.data);
+	game.data = NULL;
+	game.is_mapped = 0;
 	// why delete tempfile? keep it for next time when loading the game its much faster from /tmp ram folder
 	// if (game.tmp_path[0]) remove(game.tmp_path);
 	game.is_open = 0;
@@ -352,9 +558,13 @@ static void Game_changeDisc(char* path) {
 	putFile(CHANGE_DISC_PATH, path); // NextUI still needs to know this to update recents.txt
 }
 
-int extract_zip(char** extensions)
+#define ZIP_BUFFER_SIZE (256 * 1024)
+
+// extracts the first entry matching extensions into dir and points
+// game.tmp_path at it. writes to a hidden .part file first so an
+// interrupted extraction is never mistaken for a complete one
+int extract_zip(char** extensions, const char* dir)
 {
-	char buf[100];
 	struct zip *za;
 	int ze;
 	if ((za = zip_open(game.path, 0, &ze)) == NULL) {
@@ -364,19 +574,20 @@ int extract_zip(char** extensions)
 		return 0;
 	}
 
-	// char tmp_template[MAX_PATH];
-	// strcpy(tmp_template, "/tmp/minarch-XXXXXX");
-	
-	mkdir("/tmp/nextarch",0777);
-	char tmp_dirname[255];
-	snprintf(tmp_dirname, sizeof(tmp_dirname), "%s/%s", "/tmp/nextarch",core.tag);
-	mkdir(tmp_dirname,0777);
+	uint8_t* buf = malloc(ZIP_BUFFER_SIZE);
+	if (!buf) {
+		LOG_error("can't allocate zip buffer\n");
+		zip_close(za);
+		return 0;
+	}
 
+	int result = 0;
 	int i, len;
 	int fd;
 	struct zip_file *zf;
 	struct zip_stat sb;
 	long long sum;
+	char part_path[MAX_PATH];
 	for (i = 0; i < zip_get_num_entries(za, 0); i++) {
 		if (zip_stat_index(za, i, 0, &sb) == 0) {
 			len = strlen(sb.name);
@@ -384,7 +595,7 @@ int extract_zip(char** extensions)
 			//LOG_info("Size: [%llu], ", sb.size);
 			//LOG_info("mtime: [%u]\n", (unsigned int)sb.mtime);
 			if (sb.name[len - 1] == '/') {
-				sprintf(game.tmp_path, "%s/%s", tmp_dirname, basename((char*)sb.name));
+				sprintf(game.tmp_path, "%s/%s", dir, basename((char*)sb.name));
 			} else {
 				int found = 0;
 				char extension[8];
@@ -400,43 +611,55 @@ int extract_zip(char** extensions)
 				zf = zip_fopen_index(za, i, 0);
 				if (!zf) {
 					LOG_error( "zip_fopen_index failed\n");
-					return 0;
+					break;
 				}
 
-				sprintf(game.tmp_path, "%s/%s", tmp_dirname, basename((char*)sb.name));
-				fd = open(game.tmp_path, O_RDWR | O_TRUNC | O_CREAT, 0644);
+				sprintf(game.tmp_path, "%s/%s", dir, basename((char*)sb.name));
+				sprintf(part_path, "%s/.%s.part", dir, basename((char*)sb.name));
+				fd = open(part_path, O_WRONLY | O_TRUNC | O_CREAT, 0644);
 				if (fd < 0) {
 					LOG_error( "open failed\n");
 					zip_fclose(zf);
-					return 0;
+					break;
 				}
 				//LOG_info("Writing: %s\n", game.tmp_path);
 
 				sum = 0;
 				while (sum != sb.size) {
-					len = zip_fread(zf, buf, 100);
-					if (len < 0) {
+					zip_int64_t got = zip_fread(zf, buf, ZIP_BUFFER_SIZE);
+					if (got <= 0) {
 						LOG_error( "zip_fread failed\n");
-						close(fd);
-						zip_fclose(zf);
-						return 0;
+						break;
 					}
-					write(fd, buf, len);
-					sum += len;
+					zip_int64_t written = 0;
+					while (written < got) {
+						ssize_t w = write(fd, buf + written, got - written);
+						if (w < 0 && errno == EINTR) continue;
+						if (w <= 0) break;
+						written += w;
+					}
+					if (written != got) {
+						LOG_error( "write failed: %s\n", strerror(errno));
+						break;
+					}
+					sum += got;
 				}
 				close(fd);
 				zip_fclose(zf);
-				return 1;
+
+				if (sum == sb.size && rename(part_path, game.tmp_path) == 0) result = 1;
+				else unlink(part_path);
+				break;
 			}
 		}
 	}
-	
+
+	free(buf);
 	if (zip_close(za) == -1) {
 		LOG_error("can't close zip archive `%s'\n", game.path);
-		return 0;
 	}
 
-	return 0;
+	return result;
 }
 
 ///////////////////////////////////////
@@ -674,6 +897,186 @@ static void Cheat_getPath(char* filename) {
 	LOG_info("Cheat_getPath %s\n", filename);
 }
 
+///////////////////////////////////////
+// saves are serialized on the core thread into a pooled buffer and handed
+// to a writer thread that compresses, writes to a temp file, fsyncs just
+// that file and renames it over the old one, so the core thread only pays
+// for serialize and a save is never left half written.
+
+enum {
+	SAVER_RAW,
+	SAVER_RZIP,
+};
+
+#define SAVER_QUEUE_SIZE 4
+#define SAVER_POOL_SIZE 4
+
+typedef struct SaverBuffer {
+	void* data;
+	size_t capacity;
+} SaverBuffer;
+
+typedef struct SaverJob {
+	char path[MAX_PATH];
+	SaverBuffer buffer;
+	size_t size;
+	int format;
+} SaverJob;
+
+static struct Saver {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; // signaled when a job is queued or finished
+	int running;
+	int quit;
+	
+	SaverJob jobs[SAVER_QUEUE_SIZE];
+	int head;
+	int count; // includes the job being written
+	
+	SaverBuffer pool[SAVER_POOL_SIZE];
+	int pool_count;
+} saver;
+
+static SaverBuffer Saver_getBuffer(size_t size) {
+	SaverBuffer buffer = {0};
+	pthread_mutex_lock(&saver.mutex);
+	for (int i=0; i<saver.pool_count; i++) {
+		if (saver.pool[i].capacity>=size) {
+			buffer = saver.pool[i];
+			saver.pool[i] = saver.pool[--saver.pool_count];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&saver.mutex);
+	
+	if (!buffer.data) {
+		buffer.data = malloc(size);
+		buffer.capacity = buffer.data ? size : 0;
+	}
+	return buffer;
+}
+static void Saver_releaseBuffer(SaverBuffer buffer) {
+	if (!buffer.data) return;
+	pthread_mutex_lock(&saver.mutex);
+	if (saver.pool_count<SAVER_POOL_SIZE) {
+		saver.pool[saver.pool_count++] = buffer;
+		buffer.data = NULL;
+	}
+	pthread_mutex_unlock(&saver.mutex);
+	if (buffer.data) free(buffer.data);
+}
+
+static int Saver_writeFile(const char* path, const void* data, size_t size, int format) {
+	char tmp_path[MAX_PATH+8];
+	sprintf(tmp_path, "%s.tmp", path);
+	
+#ifdef HAS_SRM
+	if (format==SAVER_RZIP) {
+		if (!rzipstream_write_file(tmp_path, data, size)) {
+			LOG_error("rzipstream: Error writing data to file: %s\n", tmp_path);
+			unlink(tmp_path);
+			return 0;
+		}
+		int fd = open(tmp_path, O_RDONLY);
+		if (fd>=0) {
+			fsync(fd);
+			close(fd);
+		}
+	}
+	else
+#endif
+	{
+		FILE* file = fopen(tmp_path, "w");
+		if (!file) {
+			LOG_error("Error opening file: %s (%s)\n", tmp_path, strerror(errno));
+			return 0;
+		}
+		int ok = size==fwrite(data, 1, size, file);
+		ok = ok && !fflush(file);
+		if (ok) fsync(fileno(file));
+		fclose(file);
+		if (!ok) {
+			LOG_error("Error writing data to file: %s (%s)\n", tmp_path, strerror(errno));
+			unlink(tmp_path);
+			return 0;
+		}
+	}
+	
+	if (rename(tmp_path, path)) {
+		LOG_error("Error renaming %s (%s)\n", tmp_path, strerror(errno));
+		unlink(tmp_path);
+		return 0;
+	}
+	return 1;
+}
+
+static void* Saver_thread(void* arg) {
+	pthread_mutex_lock(&saver.mutex);
+	while (1) {
+		while (!saver.count && !saver.quit) pthread_cond_wait(&saver.cond, &saver.mutex);
+		if (!saver.count) break; // quit and drained
+		
+		SaverJob job = saver.jobs[saver.head];
+		pthread_mutex_unlock(&saver.mutex);
+		
+		Saver_writeFile(job.path, job.buffer.data, job.size, job.format);
+		Saver_releaseBuffer(job.buffer);
+		
+		pthread_mutex_lock(&saver.mutex);
+		saver.head = (saver.head + 1) % SAVER_QUEUE_SIZE;
+		saver.count -= 1;
+		pthread_cond_broadcast(&saver.cond);
+	}
+	pthread_mutex_unlock(&saver.mutex);
+	return NULL;
+}
+
+static void Saver_init(void) {
+	pthread_mutex_init(&saver.mutex, NULL);
+	pthread_cond_init(&saver.cond, NULL);
+	saver.running = !pthread_create(&saver.thread, NULL, Saver_thread, NULL);
+	if (!saver.running) LOG_error("Saver_init: unable to start writer thread, saving synchronously\n");
+}
+static void Saver_queue(const char* path, SaverBuffer buffer, size_t size, int format) { // takes ownership of buffer
+	if (!saver.running) {
+		Saver_writeFile(path, buffer.data, size, format);
+		Saver_releaseBuffer(buffer);
+		return;
+	}
+	
+	pthread_mutex_lock(&saver.mutex);
+	while (saver.count==SAVER_QUEUE_SIZE) pthread_cond_wait(&saver.cond, &saver.mutex);
+	SaverJob* job = &saver.jobs[(saver.head + saver.count) % SAVER_QUEUE_SIZE];
+	strcpy(job->path, path);
+	job->buffer = buffer;
+	job->size = size;
+	job->format = format;
+	saver.count += 1;
+	pthread_cond_broadcast(&saver.cond);
+	pthread_mutex_unlock(&saver.mutex);
+}
+static void Saver_flush(void) { // blocks until every queued save is on disk
+	if (!saver.running) return;
+	pthread_mutex_lock(&saver.mutex);
+	while (saver.count) pthread_cond_wait(&saver.cond, &saver.mutex);
+	pthread_mutex_unlock(&saver.mutex);
+}
+static void Saver_quit(void) {
+	if (saver.running) {
+		pthread_mutex_lock(&saver.mutex);
+		saver.quit = 1;
+		pthread_cond_broadcast(&saver.cond);
+		pthread_mutex_unlock(&saver.mutex);
+		pthread_join(saver.thread, NULL);
+		saver.running = 0;
+	}
+	for (int i=0; i<saver.pool_count; i++) {
+		free(saver.pool[i].data);
+	}
+	saver.pool_count = 0;
+}
+
 ///////////////////////////////////////
 static void formatSavePath(char* work_name, char* filename, const char* suffix) {
 	char* tmp = strrchr(work_name, '.');
@@ -753,29 +1156,18 @@ static void SRAM_write(void) {
 	printf("sav path (write): %s\n", filename);
 	
 	void *sram = core.get_memory_data(RETRO_MEMORY_SAVE_RAM);
-
-#ifdef HAS_SRM
-	// srm, compressed
-	if (CFG_getSaveFormat() == SAVE_FORMAT_SRM) {
-		if(!rzipstream_write_file(filename, sram, sram_size))
-			LOG_error("rzipstream: Error writing SRAM data to file\n");
-	}
-	else {
-		if(!filestream_write_file(filename, sram, sram_size))
-			LOG_error("filestream: Error writing SRAM data to file\n");
-	}
-#else
-	FILE *sram_file = fopen(filename, "w");
-	if (!sram_file) {
-		LOG_error("Error opening SRAM file: %s\n", strerror(errno));
+	if (!sram) {
+		LOG_error("Error writing SRAM data to file\n");
 		return;
 	}
-	if (!sram || sram_size != fwrite(sram, 1, sram_size, sram_file)) {
-		LOG_error("Error writing SRAM data to file\n");
+	
+	SaverBuffer buffer = Saver_getBuffer(sram_size);
+	if (!buffer.data) {
+		LOG_error("Couldn't allocate memory for SRAM\n");
+		return;
 	}
-	fclose(sram_file);
-#endif
-	sync();
+	memcpy(buffer.data, sram, sram_size);
+	Saver_queue(filename, buffer, sram_size, CFG_getSaveFormat()==SAVE_FORMAT_SRM ? SAVER_RZIP : SAVER_RAW);
 }
 
 ///////////////////////////////////////
@@ -809,22 +1201,225 @@ static void RTC_write(void) {
 	char filename[MAX_PATH];
 	RTC_getPath(filename);
 	printf("rtc path (write) size(%u): %s\n", rtc_size, filename);
-		
-	FILE *rtc_file = fopen(filename, "w");
-	if (!rtc_file) {
-		LOG_error("Error opening RTC file: %s\n", strerror(errno));
+
+	void *rtc = core.get_memory_data(RETRO_MEMORY_RTC);
+	if (!rtc) {
+		LOG_error("Error writing RTC data to file\n");
+		return;
+	}
+	
+	SaverBuffer buffer = Saver_getBuffer(rtc_size);
+	if (!buffer.data) {
+		LOG_error("Couldn't allocate memory for RTC\n");
 		return;
 	}
+	memcpy(buffer.data, rtc, rtc_size);
+	Saver_queue(filename, buffer, rtc_size, SAVER_RAW);
+}
 
-	void *rtc = core.get_memory_data(RETRO_MEMORY_RTC);
+///////////////////////////////////////
+// rewind keeps a ring of xor deltas between snapshots taken every
+// rewind_granularity frames. prev always holds the newest snapshot so
+// popping the newest delta and xoring it back into prev yields the
+// snapshot before it. the oldest deltas are simply dropped when full.
+
+#define REWIND_MAX_RUN 0xFFFF
+
+static struct Rewind {
+	size_t state_size;
+	size_t words; // state_size rounded up to 32-bit words
+	uint32_t* prev; // newest snapshot
+	uint32_t* cur; // scratch for the incoming snapshot
+	uint32_t* delta; // scratch for an encoded delta
+	
+	uint8_t* buffer;
+	size_t capacity;
+	size_t head; // next write position
+	size_t tail; // oldest entry
+	size_t used;
+	int count;
+	
+	int frame;
+	int has_state;
+} rewinder;
+
+static void Rewind_quit(void) {
+	if (rewinder.prev) free(rewinder.prev);
+	if (rewinder.cur) free(rewinder.cur);
+	if (rewinder.delta) free(rewinder.delta);
+	if (rewinder.buffer) free(rewinder.buffer);
+	memset(&rewinder, 0, sizeof(rewinder));
+	rewinding = 0;
+}
+static void Rewind_reset(void) {
+	rewinder.head = 0;
+	rewinder.tail = 0;
+	rewinder.used = 0;
+	rewinder.count = 0;
+	rewinder.frame = 0;
+	rewinder.has_state = 0;
+}
+static int Rewind_init(size_t state_size) {
+	Rewind_quit();
+	
+	rewinder.state_size = state_size;
+	rewinder.words = (state_size + 3) / 4;
+	rewinder.capacity = (size_t)rewind_buffer_mb * 1024 * 1024;
+	
+	// worst case every word differs from its neighbour and gets its own run header
+	rewinder.prev = calloc(rewinder.words, sizeof(uint32_t));
+	rewinder.cur = calloc(rewinder.words, sizeof(uint32_t));
+	rewinder.delta = malloc((rewinder.words * 2 + 1) * sizeof(uint32_t));
+	rewinder.buffer = malloc(rewinder.capacity);
+	if (!rewinder.prev || !rewinder.cur || !rewinder.delta || !rewinder.buffer) {
+		LOG_error("Couldn't allocate memory for rewind buffer\n");
+		Rewind_quit();
+		return 0;
+	}
+	
+	LOG_info("Rewind_init state: %zu bytes buffer: %i MB granularity: %i\n", state_size, rewind_buffer_mb, rewind_granularity);
+	Rewind_reset();
+	return 1;
+}
 
-	if (!rtc || rtc_size != fwrite(rtc, 1, rtc_size, rtc_file)) {
-		LOG_error("Error writing RTC data to file\n");
+// each run is a header word (skip << 16 | copy) followed by copy xored words
+static size_t Rewind_encode(const uint32_t* prev, const uint32_t* cur, size_t words, uint32_t* out) {
+	uint32_t* dst = out;
+	size_t i = 0;
+	while (i<words) {
+		uint32_t skip = 0;
+		while (i<words && prev[i]==cur[i] && skip<REWIND_MAX_RUN) {
+			i += 1;
+			skip += 1;
+		}
+		uint32_t* header = dst++;
+		uint32_t copy = 0;
+		while (i<words && prev[i]!=cur[i] && copy<REWIND_MAX_RUN) {
+			*dst++ = prev[i] ^ cur[i];
+			i += 1;
+			copy += 1;
+		}
+		*header = (skip << 16) | copy;
+	}
+	return (dst - out) * sizeof(uint32_t);
+}
+static void Rewind_decode(uint32_t* state, size_t words, const uint32_t* in, size_t size) {
+	const uint32_t* end = in + size / sizeof(uint32_t);
+	size_t i = 0;
+	while (in<end) {
+		uint32_t header = *in++;
+		uint32_t copy = header & REWIND_MAX_RUN;
+		i += header >> 16;
+		if (i+copy>words || in+copy>end) {
+			LOG_error("Rewind_decode: corrupt delta\n");
+			return;
+		}
+		while (copy--) state[i++] ^= *in++;
 	}
+}
 
-	fclose(rtc_file);
+static void Rewind_ringWrite(size_t pos, const void* src, size_t len) {
+	size_t first = rewinder.capacity - pos;
+	if (first>len) first = len;
+	memcpy(rewinder.buffer + pos, src, first);
+	memcpy(rewinder.buffer, (const uint8_t*)src + first, len - first);
+}
+static void Rewind_ringRead(size_t pos, void* dst, size_t len) {
+	size_t first = rewinder.capacity - pos;
+	if (first>len) first = len;
+	memcpy(dst, rewinder.buffer + pos, first);
+	memcpy((uint8_t*)dst + first, rewinder.buffer, len - first);
+}
+static size_t Rewind_ringOffset(size_t pos, size_t len) {
+	return (pos + len) % rewinder.capacity;
+}
 
-	sync();
+// entries are stored as [uint32_t size][delta][uint32_t size] so they can be
+// walked from the tail when evicting and from the head when rewinding
+static void Rewind_evict(void) {
+	uint32_t size;
+	Rewind_ringRead(rewinder.tail, &size, sizeof(size));
+	size_t total = size + 2 * sizeof(uint32_t);
+	rewinder.tail = Rewind_ringOffset(rewinder.tail, total);
+	rewinder.used -= total;
+	rewinder.count -= 1;
+}
+static void Rewind_pushDelta(size_t size) {
+	size_t total = size + 2 * sizeof(uint32_t);
+	if (total>rewinder.capacity) {
+		// a single delta doesn't fit, the chain is broken so start over
+		Rewind_reset();
+		return;
+	}
+	while (rewinder.count && rewinder.used+total>rewinder.capacity) Rewind_evict();
+	
+	uint32_t size32 = size;
+	size_t pos = rewinder.head;
+	Rewind_ringWrite(pos, &size32, sizeof(size32));
+	pos = Rewind_ringOffset(pos, sizeof(size32));
+	Rewind_ringWrite(pos, rewinder.delta, size);
+	pos = Rewind_ringOffset(pos, size);
+	Rewind_ringWrite(pos, &size32, sizeof(size32));
+	rewinder.head = Rewind_ringOffset(pos, sizeof(size32));
+	rewinder.used += total;
+	rewinder.count += 1;
+}
+static size_t Rewind_popDelta(void) {
+	uint32_t size;
+	size_t pos = (rewinder.head + rewinder.capacity - sizeof(size)) % rewinder.capacity;
+	Rewind_ringRead(pos, &size, sizeof(size));
+	pos = (pos + rewinder.capacity - size) % rewinder.capacity;
+	Rewind_ringRead(pos, rewinder.delta, size);
+	rewinder.head = (pos + rewinder.capacity - sizeof(size)) % rewinder.capacity;
+	rewinder.used -= size + 2 * sizeof(uint32_t);
+	rewinder.count -= 1;
+	return size;
+}
+
+static void Rewind_push(void) { // call after core.run()
+	if (!rewind_enable) {
+		if (rewinder.buffer) Rewind_quit();
+		return;
+	}
+	if (rewinding) return;
+	if (rewinder.has_state && ++rewinder.frame<rewind_granularity) return;
+	rewinder.frame = 0;
+	
+	size_t state_size = core.serialize_size();
+	if (!state_size) return;
+	if (!rewinder.buffer || state_size!=rewinder.state_size || rewinder.capacity!=(size_t)rewind_buffer_mb * 1024 * 1024) {
+		if (!Rewind_init(state_size)) {
+			rewind_enable = 0;
+			return;
+		}
+	}
+	
+	if (!rewinder.has_state) {
+		if (core.serialize(rewinder.prev, state_size)) rewinder.has_state = 1;
+		return;
+	}
+	
+	if (!core.serialize(rewinder.cur, state_size)) return;
+	
+	size_t size = Rewind_encode(rewinder.prev, rewinder.cur, rewinder.words, rewinder.delta);
+	Rewind_pushDelta(size);
+	
+	uint32_t* tmp = rewinder.prev;
+	rewinder.prev = rewinder.cur;
+	rewinder.cur = tmp;
+	rewinder.has_state = 1; // a delta too big to store restarts the chain from here
+}
+static int Rewind_step(void) { // call before core.run()
+	if (!rewinding || !rewinder.has_state) return 0;
+	
+	// once history is exhausted keep holding the oldest snapshot
+	if (rewinder.count) {
+		size_t size = Rewind_popDelta();
+		Rewind_decode(rewinder.prev, rewinder.words, rewinder.delta, size);
+	}
+	core.unserialize(rewinder.prev, rewinder.state_size);
+	rewinder.frame = 0;
+	return 1;
 }
 
 ///////////////////////////////////////
@@ -863,6 +1458,8 @@ static void State_getPath(char* filename) {
 static void State_read(void) { // from picoarch
 	size_t state_size = core.serialize_size();
 	if (!state_size) return;
+	
+	Saver_flush(); // the slot may still be queued for writing
 
 	int was_ff = fast_forward;
 	fast_forward = 0;
@@ -954,6 +1551,7 @@ error:
 	if (state) free(state);
 	if (state_file) fclose(state_file);
 #endif
+	Rewind_reset(); // history no longer leads up to the loaded state
 	fast_forward = was_ff;
 }
 
@@ -964,51 +1562,25 @@ static void State_write(void) { // from picoarch
 	int was_ff = fast_forward;
 	fast_forward = 0;
 
-	void *state = calloc(1, state_size);
-	if (!state) {
+	SaverBuffer buffer = Saver_getBuffer(state_size);
+	if (!buffer.data) {
 		LOG_error("Couldn't allocate memory for state\n");
-		goto error;
+		goto finish;
 	}
+	// pooled buffers are reused so clear any padding the core doesn't write
+	memset(buffer.data, 0, state_size);
 
-	if (!core.serialize(state, state_size)) {
+	if (!core.serialize(buffer.data, state_size)) {
 		LOG_error("Error serializing save state\n");
-		goto error;
+		Saver_releaseBuffer(buffer);
+		goto finish;
 	}
 	
 	char filename[MAX_PATH];
 	State_getPath(filename);
-#ifdef HAS_SRM
-	if (CFG_getStateFormat() == STATE_FORMAT_SRM) {
-		if(!rzipstream_write_file(filename, state, state_size)) {
-			LOG_error("rzipstream: Error writing state data to file: %s\n", filename);
-			goto error;
-		}
-	}
-	else {
-		if(!filestream_write_file(filename, state, state_size)) {
-			LOG_error("filestream: Error writing state data to file: %s\n", filename);
-			goto error;
-		}
-	}
+	Saver_queue(filename, buffer, state_size, CFG_getStateFormat()==STATE_FORMAT_SRM ? SAVER_RZIP : SAVER_RAW);
 
-error:
-	if (state) free(state);
-#else
-	FILE *state_file = fopen(filename, "w");
-	if (!state_file) {
-		LOG_error("Error opening state file: %s (%s)\n", filename, strerror(errno));
-		goto error;
-	}
-	if (state_size != fwrite(state, 1, state_size, state_file)) {
-		LOG_error("Error writing state data to file: %s (%s)\n", filename, strerror(errno));
-		goto error;
-	}
-	error:
-	if (state) free(state);
-	if (state_file) fclose(state_file);
-#endif
-
-	sync();
+finish:
 	fast_forward = was_ff;
 }
 
@@ -1135,6 +1707,36 @@ static char* max_ff_values[] = {
 	"8x",
 	NULL,
 };
+static char* rewind_granularity_values[] = {
+	"1",
+	"2",
+	"3",
+	"4",
+	"6",
+	"8",
+	NULL,
+};
+static char* rewind_buffer_values[] = {
+	"2",
+	"4",
+	"8",
+	"16",
+	"32",
+	NULL,
+};
+static char* runahead_values[] = {
+	"Off",
+	"1",
+	"2",
+	"3",
+	"4",
+	NULL,
+};
+static char* runahead_instance_values[] = {
+	"Single",
+	"Second",
+	NULL,
+};
 static char* offset_values[] = {
 	"-64",
 	"-63",
@@ -1277,6 +1879,8 @@ static char* sharpness_labels[3];
 static char* tearing_labels[4];
 static char* sync_ref_labels[4];
 static char* overclock_labels[5];
+static char* runahead_labels[6];
+static char* runahead_instance_labels[3];
 
 static char* nrofshaders_values[] = {
 	"off",
@@ -1329,6 +1933,12 @@ enum {
 	FE_OPT_DEBUG,
 	FE_OPT_MAXFF,
 	FE_OPT_FF_AUDIO,
+	FE_OPT_REWIND,
+	FE_OPT_REWIND_GRANULARITY,
+	FE_OPT_REWIND_BUFFER,
+	FE_OPT_RUNAHEAD,
+	FE_OPT_RUNAHEAD_INSTANCE,
+	FE_OPT_TRACE,
 	FE_OPT_COUNT,
 };
 
@@ -1341,6 +1951,8 @@ enum {
 	SHORTCUT_CYCLE_EFFECT,
 	SHORTCUT_TOGGLE_FF,
 	SHORTCUT_HOLD_FF,
+	SHORTCUT_HOLD_REWIND,
+	SHORTCUT_SAVE_TRACE,
 	SHORTCUT_GAMESWITCHER,
 	// Trimui only
 	SHORTCUT_TOGGLE_TURBO_A,
@@ -1690,6 +2302,66 @@ static struct Config {
 				.values = onoff_values,
 				.labels = onoff_labels,
 			},
+			[FE_OPT_REWIND] = {
+				.key	= "minarch_rewind",
+				// .name	= "Rewind",
+				// .desc	= "Keep a history of recent frames in memory that can be played back with the Hold Rewind shortcut.",
+				.default_value = 0,
+				.value = 0,
+				.count = 2,
+				.values = onoff_values,
+				.labels = onoff_labels,
+			},
+			[FE_OPT_REWIND_GRANULARITY] = {
+				.key	= "minarch_rewind_granularity",
+				// .name	= "Rewind Granularity",
+				// .desc	= "Frames between rewind snapshots. Higher values cost less CPU and reach further back.",
+				.default_value = 1, // 2 frames
+				.value = 1,
+				.count = 6,
+				.values = rewind_granularity_values,
+				.labels = rewind_granularity_values,
+			},
+			[FE_OPT_REWIND_BUFFER] = {
+				.key	= "minarch_rewind_buffer",
+				// .name	= "Rewind Buffer (MB)",
+				// .desc	= "Memory reserved for rewind history.",
+				.default_value = 1, // 4MB
+				.value = 1,
+				.count = 5,
+				.values = rewind_buffer_values,
+				.labels = rewind_buffer_values,
+			},
+			[FE_OPT_RUNAHEAD] = {
+				.key	= "minarch_runahead",
+				// .name	= "Run-Ahead",
+				// .desc	= "Frames to run ahead to hide the game's own input lag. Disabled automatically if the device can't keep up.",
+				.default_value = 0,
+				.value = 0,
+				.count = 5,
+				.values = runahead_values,
+				.labels = runahead_labels,
+			},
+			[FE_OPT_RUNAHEAD_INSTANCE] = {
+				.key	= "minarch_runahead_instance",
+				// .name	= "Run-Ahead Mode",
+				// .desc	= "Second runs ahead in a separate copy of the core, avoiding audio glitches at the cost of memory.",
+				.default_value = 0,
+				.value = 0,
+				.count = 2,
+				.values = runahead_instance_values,
+				.labels = runahead_instance_labels,
+			},
+			[FE_OPT_TRACE] = {
+				.key	= "minarch_trace",
+				// .name	= "Frame Tracing",
+				// .desc	= "Record per frame timings, the Save Trace shortcut writes them to the logs folder.",
+				.default_value = 0,
+				.value = 0,
+				.count = 2,
+				.values = onoff_values,
+				.labels = onoff_labels,
+			},
 			[FE_OPT_COUNT] = {NULL}
 		}
 	},
@@ -1902,6 +2574,8 @@ static struct Config {
 		[SHORTCUT_CYCLE_EFFECT]			= {"Cycle Effect",		-1, BTN_ID_NONE, 0},
 		[SHORTCUT_TOGGLE_FF]			= {"Toggle FF",			-1, BTN_ID_NONE, 0},
 		[SHORTCUT_HOLD_FF]				= {"Hold FF",			-1, BTN_ID_NONE, 0},
+		[SHORTCUT_HOLD_REWIND]			= {"Hold Rewind",		-1, BTN_ID_NONE, 0},
+		[SHORTCUT_SAVE_TRACE]			= {"Save Trace",		-1, BTN_ID_NONE, 0},
 		[SHORTCUT_GAMESWITCHER]			= {"Game Switcher",		-1, BTN_ID_NONE, 0},
 		// Trimui only
 		[SHORTCUT_TOGGLE_TURBO_A]		= {"Toggle Turbo A",	-1, BTN_ID_NONE, 0},
@@ -1940,8 +2614,61 @@ static int Config_getValue(char* cfg, const char* key, char* out_value, int* loc
 
 
 
+///////////////////////////////
+
+// Auto overclock, scales with how long the core takes per frame (see cpugov.h)
+// and remembers what each game needed in <config_dir>/<game>.cpu
+
+static CPUGovernor cpugov;
+static int cpugov_active = 0;
+static int cpugov_mhz = 0; // last speed applied
+static uint64_t flip_us = 0; // spent in screen_flip this frame, waiting is not work
+
+static void CPU_getProfilePath(char* path) {
+	sprintf(path, "%s/%s.cpu", core.config_dir, game.name);
+}
+static void CPU_initGovernor(void) {
+	const int* freqs;
+	int count = PLAT_getCPUFrequencies(&freqs);
+	if (!count) return;
+
+	char path[MAX_PATH];
+	CPU_getProfilePath(path);
+	uint32_t learned = exists(path) ? getInt(path) : 0;
+	CPUGov_init(&cpugov, freqs, count, core.fps, learned);
+	LOG_info("CPU_initGovernor: %.0fus budget, learned %u kcycles, starting at %iMHz\n", cpugov.budget_us, learned, CPUGov_getFrequency(&cpugov));
+}
+static void CPU_updateGovernor(uint64_t run_us) {
+	if (!cpugov_active) return;
+	if (!cpugov.freq_count) CPU_initGovernor();
+	if (!cpugov.freq_count) return;
+
+	int mhz;
+	if (fast_forward) mhz = cpugov.freqs[cpugov.freq_count-1]; // unthrottled, as fast as it goes
+	else if (cpugov_mhz) mhz = CPUGov_frame(&cpugov, run_us>flip_us ? run_us-flip_us : 0, cpugov_mhz);
+	else mhz = CPUGov_getFrequency(&cpugov);
+
+	if (mhz!=cpugov_mhz) {
+		PLAT_setCustomCPUSpeed(mhz * 1000);
+		cpugov_mhz = mhz;
+		currentcpuspeed = mhz;
+	}
+}
+static void CPU_saveProfile(void) {
+	if (!cpugov.freq_count) return;
+
+	char path[MAX_PATH];
+	CPU_getProfilePath(path);
+	uint32_t learned = exists(path) ? getInt(path) : 0;
+	uint32_t updated = CPUGov_learn(&cpugov, learned);
+	LOG_info("CPU_saveProfile: %u frames, %u over budget, %u switches, p99 %u kcycles\n", cpugov.frames, cpugov.misses, cpugov.switches, CPUGov_sessionP99(&cpugov));
+	if (updated!=learned) putInt(path, updated);
+}
+
 static void setOverclock(int i) {
     overclock = i;
+	cpugov_active = 0;
+	cpugov_mhz = 0;
     switch (i) {
         case 0: {
 			useAutoCpu = 0;
@@ -1959,8 +2686,16 @@ static void setOverclock(int i) {
             break;
 		}
         case 3:  {
-            PWR_setCPUSpeed(CPU_SPEED_NORMAL);
-			useAutoCpu = 1;
+			const int* freqs;
+			if (PLAT_getCPUFrequencies(&freqs)) {
+				// the governor takes over on the next frame, picking up where it left off
+				useAutoCpu = 0;
+				cpugov_active = 1;
+			}
+			else {
+				PWR_setCPUSpeed(CPU_SPEED_NORMAL);
+				useAutoCpu = 1;
+			}
             break;
 		}
     }
@@ -2043,6 +2778,31 @@ static void Config_syncFrontend(char* key, int value) {
 		ff_audio = value;
 		i = FE_OPT_FF_AUDIO;
 	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_REWIND].key)) {
+		rewind_enable = value;
+		if (!rewind_enable) rewinding = 0;
+		i = FE_OPT_REWIND;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_REWIND_GRANULARITY].key)) {
+		rewind_granularity = strtol(rewind_granularity_values[value], NULL, 10);
+		i = FE_OPT_REWIND_GRANULARITY;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_REWIND_BUFFER].key)) {
+		rewind_buffer_mb = strtol(rewind_buffer_values[value], NULL, 10);
+		i = FE_OPT_REWIND_BUFFER;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_RUNAHEAD].key)) {
+		runahead_frames = value;
+		i = FE_OPT_RUNAHEAD;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_RUNAHEAD_INSTANCE].key)) {
+		runahead_instance = value;
+		i = FE_OPT_RUNAHEAD_INSTANCE;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_TRACE].key)) {
+		TRACE_enable(value);
+		i = FE_OPT_TRACE;
+	}
 	if (i==-1) return;
 	Option* option = &config.frontend.options[i];
 	option->value = value;
@@ -3204,6 +3964,24 @@ static void Menu_afterSleep();
 static void Menu_saveState(void);
 static void Menu_loadState(void);
 
+// writes the recorded frame timings to the logs folder as a chrome trace
+static void Trace_save(void) {
+	char logs_dir[MAX_PATH];
+	sprintf(logs_dir, "%s/logs", USERDATA_PATH);
+	mkdir(logs_dir, 0755);
+
+	char timestamp[32];
+	time_t now = time(NULL);
+	strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", localtime(&now));
+
+	char path[MAX_PATH];
+	snprintf(path, sizeof(path), "%s/trace-%s-%s.json", logs_dir, core.tag, timestamp);
+
+	char label[256];
+	snprintf(label, sizeof(label), "%s %s, %i shader passes", core.tag, core.name, config.shaders.options[SH_NROFSHADERS].value);
+	TRACE_dump(path, label);
+}
+
 static int setFastForward(int enable) {
 	fast_forward = enable;
 	return enable;
@@ -3212,6 +3990,7 @@ static int setFastForward(int enable) {
 static uint32_t buttons = 0; // RETRO_DEVICE_ID_JOYPAD_* buttons
 static int ignore_menu = 0;
 static void input_poll_callback(void) {
+	if (skip_input) return; // speculative frames reuse the buttons from the real frame
 	PAD_poll();
 
 	int show_setting = 0;
@@ -3241,6 +4020,12 @@ static void input_poll_callback(void) {
 		
 	}
 	
+	if (rewinding) {
+		// MENU+button rewind may be released in either order
+		ButtonMapping* mapping = &config.shortcuts[SHORTCUT_HOLD_REWIND];
+		if (mapping->local==BTN_ID_NONE || !PAD_isPressed(1 << mapping->local)) rewinding = 0;
+	}
+	
 	static int toggled_ff_on = 0; // this logic only works because TOGGLE_FF is before HOLD_FF in the menu...
 	for (int i=0; i<SHORTCUT_COUNT; i++) {
 		ButtonMapping* mapping = &config.shortcuts[i];
@@ -3258,6 +4043,20 @@ static void input_poll_callback(void) {
 					break;
 				}
 			}
+			else if (i==SHORTCUT_HOLD_REWIND) {
+				if (PAD_justPressed(btn) || PAD_justReleased(btn)) {
+					rewinding = rewind_enable && PAD_isPressed(btn);
+					if (mapping->mod) ignore_menu = 1;
+				}
+			}
+			else if (i==SHORTCUT_SAVE_TRACE) {
+				if (PAD_justPressed(btn)) {
+					if (!trace_enabled) Config_syncFrontend(config.frontend.options[FE_OPT_TRACE].key, 1); // start recording, press again to save
+					else Trace_save();
+					if (mapping->mod) ignore_menu = 1;
+					break;
+				}
+			}
 			else if (i==SHORTCUT_HOLD_FF) {
 				// don't allow turn off fast_forward with a release of the hold button 
 				// if it was initially turned on with the toggle button
@@ -3293,7 +4092,10 @@ static void input_poll_callback(void) {
 						Menu_saveState(); 
 						break;
 					case SHORTCUT_LOAD_STATE: Menu_loadState(); break;
-					case SHORTCUT_RESET_GAME: core.reset(); break;
+					case SHORTCUT_RESET_GAME:
+						core.reset();
+						Rewind_reset();
+						break;
 					case SHORTCUT_SAVE_QUIT:
 						newScreenshot = 1;
 						quit = 1;
@@ -3619,8 +4421,8 @@ static bool environment_callback(unsigned cmd, void *data) { // copied from pico
 		int *out_p = (int *)data;
 		if (out_p) {
 			int out = 0;
-			out |= RETRO_AV_ENABLE_VIDEO;
-			out |= RETRO_AV_ENABLE_AUDIO;
+			if (!skip_video) out |= RETRO_AV_ENABLE_VIDEO;
+			if (!skip_audio) out |= RETRO_AV_ENABLE_AUDIO;
 			*out_p = out;
 		}
 		break;
@@ -4139,6 +4941,16 @@ static const char* bitmap_font[] = {
         "1   1"
         "1   1"
         "1   1",
+	['s'] =
+		"     "
+        "     "
+        " 1111"
+        "1    "
+        "1    "
+        " 111 "
+        "    1"
+        "    1"
+        "1111 ",
 
 	};
 
@@ -4652,6 +5464,21 @@ void applyCircleReveal(uint32_t **data, size_t pitch, unsigned width, unsigned h
     *data = temp_buffer;
 }
 
+#define FADEIN_FRAMES 8
+static int fadein_frame = 0;
+
+// what a dupe (NULL) frame shows again. only frontend owned buffers are kept,
+// the core's own framebuffer is only valid during the callback so a zero-copy
+// frame is re-presented from the texture it was uploaded to instead
+const void* lastframe = NULL;
+static size_t lastframe_pitch = 0;
+static int lastframe_on_gpu = 0;
+
+static void lastframe_forget(void) { // when the core that drew it goes away
+	lastframe = NULL;
+	lastframe_on_gpu = 0;
+}
+
 static void video_refresh_callback_main(const void *data, unsigned width, unsigned height, size_t pitch) {
 	// return;
 	
@@ -4677,7 +5504,7 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 	//  8: 60/210 (with optimize text off)
 	// you can squeeze more out of every console by turning prevent tearing off
 	// eg. PS@10 60/240
-	if (!data) {
+	if (!data && !lastframe_on_gpu) {
 		return;
 	}
 
@@ -4694,7 +5521,7 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 	}
 	
 	// debug
-	if (show_debug && !isnan(currentratio) && !isnan(currentfps) && !isnan(currentreqfps)  && !isnan(currentbufferms) &&
+	if (show_debug && renderer.src_fmt==RENDERER_SRC_RGBA8888 && !isnan(currentratio) && !isnan(currentfps) && !isnan(currentreqfps)  && !isnan(currentbufferms) &&
 	currentbuffersize >= 0  && currentbufferfree >= 0 && SDL_GetTicks() > 5000) {
 		int x = 2 + renderer.src_x;
 		int y = 2 + renderer.src_y;
@@ -4716,6 +5543,9 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 		sprintf(debug_text, "%ix%i", renderer.dst_w,renderer.dst_h);
 		blitBitmapText(debug_text,-x,-y,(uint32_t*)data,pitch / 4, width,height);
 
+		sprintf(debug_text, "%.02fms/%i", currentuploadms, currentglcalls); // copying the frame to the gpu, gl calls per frame
+		blitBitmapText(debug_text,-x,-y - 14,(uint32_t*)data,pitch / 4, width,height);
+
 		//want this to overwrite bottom right in case screen is too small this info more important tbh
 		PLAT_getCPUTemp();
 		sprintf(debug_text, "%.01f/%.01f/%.0f%%/%ihz/%ic", currentfps, currentreqfps,currentcpuse,currentcpuspeed,currentcputemp);
@@ -4728,101 +5558,94 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 		drawGauge(x, y + 30, buffer_fill, width / 2, 8, (uint32_t*)data, pitch / 4);
 	}
 	
-	static int frame_counter = 0;
-	const int max_frames = 8; 
-	if(frame_counter<9) {
-		applyFadeIn((uint32_t **) &data, pitch, width, height, &frame_counter, max_frames);
+	if(fadein_frame<FADEIN_FRAMES && renderer.src_fmt==RENDERER_SRC_RGBA8888) {
+		applyFadeIn((uint32_t **) &data, pitch, width, height, &fadein_frame, FADEIN_FRAMES);
 	}
 
 	// LOG_info("video_refresh_callback: %ix%i@%i %ix%i@%i\n",width,height,pitch,screen->w,screen->h,screen->pitch);
 
 
 	renderer.src = (void*)data;
+	renderer.src_dupe = !data;
+	renderer.src_p = pitch;
 	renderer.dst = screen->pixels;
 
 	SDL_PauseAudio(0);
+	uint64_t trace_start = TRACE_begin();
 	GFX_blitRenderer(&renderer);
+	TRACE_end(TRACE_BLIT, 0, trace_start);
 
+	uint64_t flip_start = getMicroseconds();
+	trace_start = TRACE_begin();
 	screen_flip(screen);
+	TRACE_end(TRACE_FLIP, 0, trace_start);
+	flip_us += getMicroseconds() - flip_start;
 	last_flip_time = SDL_GetTicks();
 }
 
-
-const void* lastframe = NULL;
-
 static Uint32* rgbaData = NULL;
 static size_t rgbaDataSize = 0;
 
 static void video_refresh_callback(const void* data, unsigned width, unsigned height, size_t pitch) {
+	if (skip_video) return;
 
 	// I need to check quit here because sometimes quit is true but callback is still called by the core after and it still runs one more frame and it looks ugly :D
 	if(!quit) {
-		if (!rgbaData || rgbaDataSize != width * height) {
-			if (rgbaData) free(rgbaData);
-			rgbaDataSize = width * height;
-			rgbaData = (Uint32*)malloc(rgbaDataSize * sizeof(Uint32));
-			if (!rgbaData) {
-				printf("Failed to allocate memory for RGBA8888 data.\n");
-				return;
-			}
-		}
-
 		if(!fast_forward && data) {
 			if(ambient_mode!=0) {
-				GFX_setAmbientColor(data, width, height,pitch,ambient_mode);
-				LEDS_updateLeds();
+				int format = fmt == RETRO_PIXEL_FORMAT_XRGB8888 ? CONVERT_XRGB8888 : CONVERT_RGB565;
+				if (GFX_setAmbientColor(data, width, height,pitch,format,ambient_mode)) LEDS_updateLeds();
 			}
 		}
 
+		int src_fmt = RENDERER_SRC_RGBA8888;
 		if (!data) {
-			if (lastframe) {
+			if (lastframe_on_gpu) {
+				pitch = lastframe_pitch;
+				src_fmt = RENDERER_SRC_RGB565; // NULL src keeps the texture as it is
+			} else if (lastframe) {
 				data = lastframe;
+				pitch = lastframe_pitch;
 			} else {
 				return; // No data to display
 			}
-		} else if (fmt == RETRO_PIXEL_FORMAT_XRGB8888) {
-			// convert XRGB8888 to RGBA8888
-			const uint32_t* src = (const uint32_t*)data;
-			for (unsigned i = 0; i < width * height; ++i) {
-				uint32_t pixel = src[i];
-				uint8_t r = (pixel >> 16) & 0xFF;
-				uint8_t g = (pixel >> 8) & 0xFF;
-				uint8_t b = (pixel >> 0) & 0xFF;
-				uint8_t a = 0xFF;
-				rgbaData[i] = (a << 24) | (b << 16) | (g << 8) | r;
-			}
-			data = rgbaData;
-
+		} else if (fmt == RETRO_PIXEL_FORMAT_RGB565 && !show_debug && fadein_frame>=FADEIN_FRAMES) {
+			// zero-copy, the core's framebuffer is uploaded to the GL texture as RGB565
+			src_fmt = RENDERER_SRC_RGB565;
 		} else {
-			// convert RGB565 to RGBA8888
-			const uint16_t* srcData = (const uint16_t*)data;
-			unsigned srcPitchInPixels = pitch / sizeof(uint16_t); 
-
-			for (unsigned y = 0; y < height; ++y) {
-				for (unsigned x = 0; x < width; ++x) {
-					uint16_t pixel = srcData[y * srcPitchInPixels + x];
-
-					uint8_t r = ((pixel >> 11) & 0x1F) << 3; 
-					uint8_t g = ((pixel >> 5) & 0x3F) << 2;   
-					uint8_t b = (pixel & 0x1F) << 3;          
-					uint8_t a = 0xFF;
-
-					rgbaData[y * width + x] = (a << 24) | (b << 16) | (g << 8) | r;
+			if (!rgbaData || rgbaDataSize != width * height) {
+				if (rgbaData) free(rgbaData);
+				rgbaDataSize = width * height;
+				rgbaData = (Uint32*)malloc(rgbaDataSize * sizeof(Uint32));
+				if (!rgbaData) {
+					printf("Failed to allocate memory for RGBA8888 data.\n");
+					return;
 				}
 			}
+
+			// debug overlay and fade in draw in RGBA8888 so convert
+			convert_t convert = convert_getRGBA8888(fmt == RETRO_PIXEL_FORMAT_XRGB8888 ? CONVERT_XRGB8888 : CONVERT_RGB565);
+			uint64_t trace_start = TRACE_begin();
+			convert(data, rgbaData, width, height, pitch, width * sizeof(Uint32));
+			TRACE_end(TRACE_CONVERT, 0, trace_start);
 			data = rgbaData;
+			pitch = width * sizeof(Uint32);
+		}
 
+		if (data) {
+			lastframe_on_gpu = src_fmt==RENDERER_SRC_RGB565;
+			lastframe = lastframe_on_gpu ? NULL : data;
+			lastframe_pitch = pitch;
 		}
+		renderer.src_fmt = src_fmt;
 
-		pitch = width * sizeof(Uint32);
-		lastframe = data;
-		
 		video_refresh_callback_main(data,width,height,pitch);
 	}
 }
 ///////////////////////////////
 
 static void audio_sample_callback(int16_t left, int16_t right) {
+	if (rewinding || skip_audio) return;
 	if (!fast_forward || ff_audio) {
 		if (use_core_fps) {
 			SND_batchSamples_fixed_rate(&(const SND_Frame){left,right}, 1);
@@ -4833,6 +5656,7 @@ static void audio_sample_callback(int16_t left, int16_t right) {
 	}
 }
 static size_t audio_sample_batch_callback(const int16_t *data, size_t frames) { 
+	if (rewinding || skip_audio) return frames;
 	if (!fast_forward || ff_audio) {
 		if (use_core_fps) {
 			return SND_batchSamples_fixed_rate((const SND_Frame*)data, frames);
@@ -4897,6 +5721,7 @@ void Core_open(const char* core_path, const char* tag_name) {
 
 	LOG_info("Block Extract: %d\n", info.block_extract);
 
+	strcpy((char*)core.path, core_path);
 	Core_getName((char*)core_path, (char*)core.name);
 	sprintf((char*)core.version, "%s (%s)", info.library_name, info.library_version);
 	strcpy((char*)core.tag, tag_name);
@@ -5004,9 +5829,279 @@ void Core_quit(void) {
 	}
 }
 void Core_close(void) {
+	lastframe_forget();
 	if (core.handle) dlclose(core.handle);
 }
 
+///////////////////////////////////////
+// run-ahead hides the game's own input lag by running the real frame
+// hidden, saving state, running the requested number of frames ahead
+// with the same input, showing the last one and then restoring. the
+// second instance mode runs the speculative frames in a private copy of
+// the core instead so the real instance never has its state reloaded.
+
+enum {
+	RUNAHEAD_SINGLE,
+	RUNAHEAD_SECOND,
+};
+
+#define RUNAHEAD_BUDGET 0.8 // share of the frame budget run-ahead may use
+#define RUNAHEAD_STRIKES 2 // seconds over budget before giving up
+
+static struct RunAhead {
+	void* state;
+	size_t state_size;
+	int disabled; // over budget or unable to serialize
+	
+	uint64_t usage; // microseconds spent running the core this second
+	int frames;
+	int strikes;
+	
+	struct {
+		void* handle;
+		char path[MAX_PATH];
+		int loaded;
+		int device; // controller type it was given
+		void (*init)(void);
+		void (*deinit)(void);
+		void (*set_controller_port_device)(unsigned port, unsigned device);
+		void (*run)(void);
+		bool (*unserialize)(const void *data, size_t size);
+		bool (*load_game)(const struct retro_game_info *game);
+		void (*unload_game)(void);
+	} second;
+} runahead;
+
+static bool RunAhead_environmentCallback(unsigned cmd, void *data) {
+	switch(cmd) {
+	// everything the core registers with the frontend belongs to the real instance
+	case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+	case RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE:
+	case RETRO_ENVIRONMENT_SET_DISK_CONTROL_EXT_INTERFACE:
+	case RETRO_ENVIRONMENT_SET_VARIABLES:
+	case RETRO_ENVIRONMENT_SET_VARIABLE:
+	case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
+	case RETRO_ENVIRONMENT_SET_CORE_OPTIONS:
+	case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL:
+	case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY:
+	case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2:
+	case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL:
+	case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK:
+		return true;
+	// so is the output, the shadow instance mustn't resize, retime or talk over it
+	case RETRO_ENVIRONMENT_SET_MESSAGE:
+		return true;
+	case RETRO_ENVIRONMENT_SET_GEOMETRY:
+	case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO:
+	case RETRO_ENVIRONMENT_SET_ROTATION:
+	case RETRO_ENVIRONMENT_SET_MESSAGE_EXT:
+		return false; // same answer environment_callback gives, it doesn't take these either
+	case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+		return data && *(const enum retro_pixel_format *)data==fmt;
+	case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE: {
+		// option changes close the second instance so it picks them up on reopen
+		bool *out = (bool *)data;
+		if (out) *out = false;
+		return true;
+	}
+	case RETRO_ENVIRONMENT_GET_RUMBLE_INTERFACE:
+		return false;
+	}
+	return environment_callback(cmd, data);
+}
+
+static int RunAhead_device(void) {
+	return has_custom_controllers ? strtol(gamepad_values[gamepad_type], NULL, 0) : RETRO_DEVICE_JOYPAD;
+}
+static void RunAhead_closeSecondary(void) {
+	if (!runahead.second.handle) return;
+	
+	if (runahead.second.loaded) {
+		runahead.second.unload_game();
+		runahead.second.deinit();
+	}
+	lastframe_forget(); // may have been the secondary's framebuffer
+	dlclose(runahead.second.handle);
+	unlink(runahead.second.path);
+	memset(&runahead.second, 0, sizeof(runahead.second));
+}
+static int RunAhead_copyCore(const char* from, const char* to) { // without forking a shell on the render thread
+	int in = open(from, O_RDONLY | O_CLOEXEC);
+	if (in<0) return 0;
+	int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+	if (out<0) {
+		close(in);
+		return 0;
+	}
+	
+	char buffer[64 * 1024];
+	int ok = 1;
+	ssize_t count;
+	while (ok && (count = read(in, buffer, sizeof(buffer)))!=0) {
+		if (count<0) {
+			if (errno==EINTR) continue;
+			ok = 0;
+			break;
+		}
+		for (ssize_t done=0; done<count; ) {
+			ssize_t written = write(out, buffer + done, count - done);
+			if (written<0 && errno==EINTR) continue;
+			if (written<=0) {
+				ok = 0;
+				break;
+			}
+			done += written;
+		}
+	}
+	close(in);
+	if (close(out)!=0) ok = 0;
+	if (!ok) unlink(to); // never dlopen a partial copy
+	return ok;
+}
+static int RunAhead_openSecondary(void) {
+	if (runahead.second.loaded) return 1;
+	if (runahead.second.handle) return 0; // already failed
+	
+	// dlopen returns the existing handle for a path it has already loaded
+	// so the core needs its own copy to get its own globals
+	LOG_info("RunAhead_openSecondary\n");
+	mkdir("/tmp/nextarch", 0777);
+	snprintf(runahead.second.path, sizeof(runahead.second.path), "/tmp/nextarch/runahead-%s.so", core.name);
+	if (!RunAhead_copyCore(core.path, runahead.second.path)) {
+		LOG_error("RunAhead_openSecondary: couldn't copy %s (%s)\n", core.path, strerror(errno));
+		runahead.disabled = 1;
+		return 0;
+	}
+	
+	runahead.second.handle = dlopen(runahead.second.path, RTLD_LAZY | RTLD_LOCAL);
+	if (!runahead.second.handle) {
+		LOG_error("%s\n", dlerror());
+		runahead.disabled = 1;
+		return 0;
+	}
+	
+	void* handle = runahead.second.handle;
+	runahead.second.init = dlsym(handle, "retro_init");
+	runahead.second.deinit = dlsym(handle, "retro_deinit");
+	runahead.second.set_controller_port_device = dlsym(handle, "retro_set_controller_port_device");
+	runahead.second.run = dlsym(handle, "retro_run");
+	runahead.second.unserialize = dlsym(handle, "retro_unserialize");
+	runahead.second.load_game = dlsym(handle, "retro_load_game");
+	runahead.second.unload_game = dlsym(handle, "retro_unload_game");
+	
+	void (*set_environment_callback)(retro_environment_t) = dlsym(handle, "retro_set_environment");
+	void (*set_video_refresh_callback)(retro_video_refresh_t) = dlsym(handle, "retro_set_video_refresh");
+	void (*set_audio_sample_callback)(retro_audio_sample_t) = dlsym(handle, "retro_set_audio_sample");
+	void (*set_audio_sample_batch_callback)(retro_audio_sample_batch_t) = dlsym(handle, "retro_set_audio_sample_batch");
+	void (*set_input_poll_callback)(retro_input_poll_t) = dlsym(handle, "retro_set_input_poll");
+	void (*set_input_state_callback)(retro_input_state_t) = dlsym(handle, "retro_set_input_state");
+	
+	set_environment_callback(RunAhead_environmentCallback);
+	set_video_refresh_callback(video_refresh_callback);
+	set_audio_sample_callback(audio_sample_callback);
+	set_audio_sample_batch_callback(audio_sample_batch_callback);
+	set_input_poll_callback(input_poll_callback);
+	set_input_state_callback(input_state_callback);
+	
+	runahead.second.init();
+	
+	struct retro_game_info game_info = {};
+	game_info.path = game.tmp_path[0]?game.tmp_path:game.path;
+	game_info.data = game.data;
+	game_info.size = game.size;
+	if (!runahead.second.load_game(&game_info)) {
+		LOG_error("RunAhead_openSecondary: core failed to load game\n");
+		runahead.second.deinit();
+		runahead.disabled = 1;
+		return 0;
+	}
+	runahead.second.loaded = 1;
+	
+	runahead.second.device = RunAhead_device();
+	runahead.second.set_controller_port_device(0, runahead.second.device);
+	return 1;
+}
+
+static void RunAhead_quit(void) {
+	RunAhead_closeSecondary();
+	if (runahead.state) free(runahead.state);
+	memset(&runahead, 0, sizeof(runahead));
+}
+static void RunAhead_reset(int options_changed) { // call after leaving the menu
+	// reloading the second instance is a full core and game load, only do it
+	// for what it can't pick up from the state it's handed every frame
+	if (options_changed || runahead.second.device!=RunAhead_device() || !runahead_frames || runahead_instance!=RUNAHEAD_SECOND) {
+		RunAhead_closeSecondary();
+	}
+	runahead.disabled = 0;
+	runahead.strikes = 0;
+}
+
+static int RunAhead_save(void) {
+	size_t state_size = core.serialize_size();
+	if (!state_size) return 0;
+	if (state_size!=runahead.state_size) {
+		if (runahead.state) free(runahead.state);
+		runahead.state = malloc(state_size);
+		runahead.state_size = runahead.state ? state_size : 0;
+		if (!runahead.state) return 0;
+	}
+	return core.serialize(runahead.state, runahead.state_size);
+}
+
+static void RunAhead_run(void) { // replaces core.run()
+	if (!runahead_frames || runahead.disabled || fast_forward || rewinding) {
+		core.run();
+		return;
+	}
+	
+	uint64_t start = getMicroseconds();
+	int second = runahead_instance==RUNAHEAD_SECOND && RunAhead_openSecondary();
+	
+	// the real frame polls input and produces the audio we keep
+	skip_video = 1;
+	core.run();
+	skip_video = 0;
+	
+	if (!RunAhead_save() || (second && !runahead.second.unserialize(runahead.state, runahead.state_size))) {
+		LOG_warn("RunAhead_run: core can't save state, disabling run-ahead\n");
+		runahead.disabled = 1;
+		return;
+	}
+	
+	skip_input = 1;
+	skip_audio = 1;
+	for (int i=0; i<runahead_frames; i++) {
+		skip_video = i<runahead_frames-1;
+		if (second) runahead.second.run();
+		else core.run();
+	}
+	skip_video = 0;
+	skip_audio = 0;
+	skip_input = 0;
+	
+	if (!second) core.unserialize(runahead.state, runahead.state_size);
+	
+	runahead.usage += getMicroseconds() - start;
+	runahead.frames += 1;
+}
+static void RunAhead_checkBudget(void) { // call once a second
+	if (runahead.frames && !runahead.disabled) {
+		double budget = 1000000.0 / core.fps;
+		double average = (double)runahead.usage / runahead.frames;
+		if (average>budget*RUNAHEAD_BUDGET) runahead.strikes += 1;
+		else runahead.strikes = 0;
+		
+		if (runahead.strikes>=RUNAHEAD_STRIKES) {
+			LOG_warn("RunAhead: %.0fus per frame exceeds the %.0fus budget, disabling run-ahead\n", average, budget);
+			runahead.disabled = 1;
+			RunAhead_closeSecondary();
+		}
+	}
+	runahead.usage = 0;
+	runahead.frames = 0;
+}
+
 ///////////////////////////////////////
 
 #define MENU_ITEM_COUNT 5
@@ -5154,6 +6249,30 @@ static void FrontendMenu_InitStrings(void) {
     // FE_OPT_FF_AUDIO
     options[FE_OPT_FF_AUDIO].name = (char*)L("fe_ff_audio_name");
     options[FE_OPT_FF_AUDIO].desc = (char*)L("fe_ff_audio_desc");
+
+    // FE_OPT_REWIND
+    options[FE_OPT_REWIND].name = (char*)L("fe_rewind_name");
+    options[FE_OPT_REWIND].desc = (char*)L("fe_rewind_desc");
+
+    // FE_OPT_REWIND_GRANULARITY
+    options[FE_OPT_REWIND_GRANULARITY].name = (char*)L("fe_rewind_granularity_name");
+    options[FE_OPT_REWIND_GRANULARITY].desc = (char*)L("fe_rewind_granularity_desc");
+
+    // FE_OPT_REWIND_BUFFER
+    options[FE_OPT_REWIND_BUFFER].name = (char*)L("fe_rewind_buffer_name");
+    options[FE_OPT_REWIND_BUFFER].desc = (char*)L("fe_rewind_buffer_desc");
+
+    // FE_OPT_RUNAHEAD
+    options[FE_OPT_RUNAHEAD].name = (char*)L("fe_runahead_name");
+    options[FE_OPT_RUNAHEAD].desc = (char*)L("fe_runahead_desc");
+
+    // FE_OPT_RUNAHEAD_INSTANCE
+    options[FE_OPT_RUNAHEAD_INSTANCE].name = (char*)L("fe_runahead_instance_name");
+    options[FE_OPT_RUNAHEAD_INSTANCE].desc = (char*)L("fe_runahead_instance_desc");
+
+    // FE_OPT_TRACE
+    options[FE_OPT_TRACE].name = (char*)L("fe_trace_name");
+    options[FE_OPT_TRACE].desc = (char*)L("fe_trace_desc");
 }
 static void GlobalLabels_InitStrings(void) {
     // On/Off
@@ -5218,6 +6337,18 @@ static void GlobalLabels_InitStrings(void) {
     overclock_labels[2] = (char*)L("val_oc_performance");
     overclock_labels[3] = (char*)L("val_auto");
     overclock_labels[4] = NULL;
+
+    // Run-Ahead
+    runahead_labels[0] = (char*)L("val_off");
+    runahead_labels[1] = "1";
+    runahead_labels[2] = "2";
+    runahead_labels[3] = "3";
+    runahead_labels[4] = "4";
+    runahead_labels[5] = NULL;
+
+    runahead_instance_labels[0] = (char*)L("val_runahead_single");
+    runahead_instance_labels[1] = (char*)L("val_runahead_second");
+    runahead_instance_labels[2] = NULL;
 }
 static void ShadersMenu_InitStrings(void) {
     Option* options = config.shaders.options;
@@ -5353,6 +6484,7 @@ void Menu_beforeSleep() {
 	SRAM_write();
 	RTC_write();
 	State_autosave();
+	Saver_flush();
 	putFile(AUTO_RESUME_PATH, game.path + strlen(SDCARD_PATH));
 	PWR_setCPUSpeed(CPU_SPEED_MENU);
 }
@@ -6650,6 +7782,7 @@ static void Menu_initState(void) {
 }
 static void Menu_updateState(void) {
 	// LOG_info("Menu_updateState\n");
+	Saver_flush(); // so save_exists reflects states still being written
 
 	int last_slot = state_slot;
 	state_slot = menu.slot;
@@ -6831,9 +7964,7 @@ static void Menu_loop(void) {
 		screen = GFX_resize(DEVICE_WIDTH,DEVICE_HEIGHT,DEVICE_PITCH);
 	}
 
-	char act[PATH_MAX];
-	sprintf(act, "gametimectl.elf stop '%s' &", replaceString2(game.path, "'", "'\\''"));
-	system(act);
+	play_activity_queue_stop(game.path);
 
 	SRAM_write();
 	RTC_write();
@@ -6959,6 +8090,7 @@ static void Menu_loop(void) {
 				case ITEM_OPTS: {
 					if (simple_mode) {
 						core.reset();
+						Rewind_reset();
 						status = STATUS_RESET;
 						show_menu = 0;
 					}
@@ -7164,9 +8296,7 @@ static void Menu_loop(void) {
 		
 		if (!HAS_POWER_BUTTON) PWR_disableSleep();
 
-		char act[PATH_MAX];
-		sprintf(act, "gametimectl.elf start '%s' &", replaceString2(game.path, "'", "'\\''"));
-		system(act);
+		play_activity_queue_start(game.path);
 	}
 	else if (exists(NOUI_PATH)) PWR_powerOff(0); // TODO: won't work with threaded core, only check this once per launch
 	
@@ -7236,6 +8366,8 @@ static void trackFPS(void) {
 		cpu_ticks = 0;
 		fps_ticks = 0;
 		
+		RunAhead_checkBudget();
+		
 		// LOG_info("fps: %f cpu: %f\n", fps_double, cpu_double);
 	}
 }
@@ -7319,6 +8451,8 @@ int main(int argc , char* argv[]) {
 	Game_open(rom_path); // nes tries to load gamegenie setting before this returns ffs
 	if (!game.is_open) goto finish;
 	
+	Saver_init();
+	
 	simple_mode = exists(SIMPLE_MODE_PATH);
 	
 	// restore options
@@ -7383,8 +8517,16 @@ int main(int argc , char* argv[]) {
 	LOG_info("total startup time %ims\n\n",SDL_GetTicks());
 	while (!quit) {
 		GFX_startFrame();
-	
-		core.run();
+		TRACE_frame();
+	
+		Rewind_step();
+		uint64_t trace_start = TRACE_begin();
+		uint64_t run_start = getMicroseconds();
+		flip_us = 0;
+		RunAhead_run();
+		TRACE_end(TRACE_CORE_RUN, currentcpuspeed, trace_start);
+		CPU_updateGovernor(getMicroseconds() - run_start);
+		Rewind_push();
 		limitFF();
 		trackFPS();
 		
@@ -7394,6 +8536,7 @@ int main(int argc , char* argv[]) {
 			if (Core_updateAVInfo()) {
 				LOG_info("AV info changed, reset sound system");
 				SND_resetAudio(core.sample_rate, core.fps);
+				if (cpugov.freq_count) CPUGov_setFPS(&cpugov, core.fps);
 			}
 			resetFPSCounter();
 			chooseSyncRef();
@@ -7405,6 +8548,7 @@ int main(int argc , char* argv[]) {
 			Menu_loop();
 			PWR_updateFrequency(PWR_UPDATE_FREQ_INGAME,0);
 			has_pending_opt_change = config.core.changed;
+			RunAhead_reset(config.core.changed);
 			resetFPSCounter();
 			chooseSyncRef();
 			// this is not needed
@@ -7428,6 +8572,10 @@ int main(int argc , char* argv[]) {
 	SDL_FreeSurface(converted); 
 	
 	if(rgbaData) free(rgbaData);
+	if (trace_enabled) Trace_save();
+	CPU_saveProfile();
+	Rewind_quit();
+	RunAhead_quit();
 
 	PLAT_clearTurbo();
 
@@ -7439,6 +8587,7 @@ finish:
 	Game_close();
 	Core_unload();
 	Core_quit();
+	Saver_quit(); // after Core_quit() queues the final SRAM and RTC writes
 	Core_close();
 	Config_quit();
 	Special_quit();
@@ -7450,5 +8599,6 @@ finish:
 	PAD_quit();
 	GFX_quit();
 	SDL_WaitThread(screenshotsavethread, NULL);
+	play_activity_flush();
 	return EXIT_SUCCESS;
 }
@@ -7,10 +7,16 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <libgen.h>  // For dirname()
+#include <time.h>
+#include <sys/stat.h>
+#include <malloc.h>
 #include "defines.h"
 #include "api.h"
 #include "utils.h"
 #include "config.h"
+#include "hashmap.h"
+#include <sqlite3.h>
+#include <gametimedb.h>
 #include <sys/resource.h>
 #include <pthread.h>
 #include <assert.h>
@@ -94,30 +100,88 @@ static void StringArray_free(Array* self) {
 
 ///////////////////////////////////////
 
-typedef struct Hash {
-	Array* keys;
-	Array* values;
-} Hash; // not really a hash
+// bump allocator for everything a Directory's listing needs, released in
+// one go with the Directory instead of entry by entry. Entry structs and
+// their strings come from separate blocks so a listing's Entries end up
+// packed next to each other
 
-static Hash* Hash_new(void) {
-	Hash* self = malloc(sizeof(Hash));
-	self->keys = Array_new();
-	self->values = Array_new();
-	return self;
+#define ARENA_BLOCK_SIZE (32 * 1024)
+
+typedef struct ArenaBlock {
+	struct ArenaBlock* next;
+	size_t used;
+	size_t size;
+	char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+	ArenaBlock* structs;
+	ArenaBlock* strings;
+} Arena;
+
+static Arena* Arena_new(void) {
+	return calloc(1, sizeof(Arena));
 }
-static void Hash_free(Hash* self) {
-	StringArray_free(self->keys);
-	StringArray_free(self->values);
-	free(self);
+static void* ArenaBlock_alloc(ArenaBlock** head, size_t size) {
+	ArenaBlock* block = *head;
+	if (!block || block->used+size>block->size) {
+		size_t block_size = size>ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		block = malloc(sizeof(ArenaBlock) + block_size);
+		block->next = *head;
+		block->used = 0;
+		block->size = block_size;
+		*head = block;
+	}
+	void* ptr = block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+static void* Arena_alloc(Arena* self, size_t size) {
+	return ArenaBlock_alloc(&self->structs, (size + 7) & ~(size_t)7);
 }
-static void Hash_set(Hash* self, char* key, char* value) {
-	Array_push(self->keys, strdup(key));
-	Array_push(self->values, strdup(value));
+static char* Arena_strdup(Arena* self, const char* str) {
+	size_t len = strlen(str) + 1;
+	char* copy = ArenaBlock_alloc(&self->strings, len);
+	memcpy(copy, str, len);
+	return copy;
 }
-static char* Hash_get(Hash* self, char* key) {
-	int i = StringArray_indexOf(self->keys, key);
-	if (i==-1) return NULL;
-	return self->values->items[i];
+static void ArenaBlock_free(ArenaBlock* block) {
+	while (block) {
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+}
+static void Arena_free(Arena* self) {
+	ArenaBlock_free(self->structs);
+	ArenaBlock_free(self->strings);
+	free(self);
+}
+
+///////////////////////////////////////
+
+// reads a tab separated map.txt, the first line for a file wins
+static HashMap* Map_load(char* map_path) {
+	FILE* file = fopen(map_path, "r");
+	if (!file) return NULL;
+
+	HashMap* map = HashMap_new();
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		normalizeNewline(line);
+		trimTrailingNewlines(line);
+		if (strlen(line) == 0) continue; // skip empty lines
+
+		char* tmp = strchr(line, '\t');
+		if (tmp) {
+			tmp[0] = '\0';
+			char* key = line;
+			char* value = tmp + 1;
+			if (!HashMap_get(map, key)) HashMap_set(map, key, value);
+		}
+	}
+	fclose(file);
+	return map;
 }
 
 ///////////////////////////////////////
@@ -129,32 +193,58 @@ enum EntryType {
 	ENTRY_DIP,
 };
 typedef struct Entry {
-	char* path;
+	// what sorting and drawing a row touch first
 	char* name;
-	char* unique;
 	int type;
 	int alpha; // index in parent Directory's alphas Array, which points to the index of an Entry in its entries Array :sweat_smile:
+	int has_thumb; // -1 if unknown, only listings from the library index know
+	char* path;
+	char* unique;
+	Arena* arena; // owns the Entry and its strings, NULL if they were malloc'd
 } Entry;
 
-static Entry* Entry_new(char* path, int type) {
-	char display_name[256];
-	getDisplayName(path, display_name);
-	Entry* self = malloc(sizeof(Entry));
-	self->path = strdup(path);
-	self->name = strdup(display_name);
+static __thread Arena* entry_arena = NULL; // set while a Directory builds its listing on this thread
+
+static Entry* Entry_alloc(void) {
+	Entry* self = entry_arena ? Arena_alloc(entry_arena, sizeof(Entry)) : malloc(sizeof(Entry));
+	self->arena = entry_arena;
+	self->name = NULL;
+	self->path = NULL;
 	self->unique = NULL;
-	self->type = type;
+	self->type = 0;
 	self->alpha = 0;
+	self->has_thumb = -1;
 	return self;
 }
+static char* Entry_strdup(Entry* self, const char* str) {
+	if (!str) return NULL;
+	return self->arena ? Arena_strdup(self->arena, str) : strdup(str);
+}
 
 static Entry* Entry_newNamed(char* path, int type, char* displayName) {
-	Entry *self = Entry_new(path, type);
-	self->name = strdup(displayName);
+	Entry* self = Entry_alloc();
+	self->path = Entry_strdup(self, path);
+	self->name = Entry_strdup(self, displayName);
+	self->type = type;
 	return self;
 }
+static Entry* Entry_new(char* path, int type) {
+	char display_name[256];
+	getDisplayName(path, display_name);
+	return Entry_newNamed(path, type, display_name);
+}
+
+static void Entry_setName(Entry* self, char* name) {
+	if (!self->arena) free(self->name);
+	self->name = Entry_strdup(self, name);
+}
+static void Entry_setUnique(Entry* self, char* unique) {
+	if (!self->arena && self->unique) free(self->unique);
+	self->unique = Entry_strdup(self, unique);
+}
 
 static void Entry_free(Entry* self) {
+	if (self->arena) return; // released with its Directory
 	free(self->path);
 	free(self->name);
 	if (self->unique) free(self->unique);
@@ -168,13 +258,41 @@ static int EntryArray_indexOf(Array* self, char* path) {
 	}
 	return -1;
 }
+
+// sorting runs over a packed array of the first 8 lowercased bytes of each
+// name so most comparisons never chase the Entry and name pointers
+typedef struct EntrySortKey {
+	uint64_t prefix;
+	Entry* entry;
+} EntrySortKey;
+
+static uint64_t EntrySortKey_prefix(const char* name) {
+	uint64_t prefix = 0;
+	for (int i=0; i<8; i++) {
+		prefix <<= 8;
+		if (*name) prefix |= (uint8_t)tolower((uint8_t)*name++);
+	}
+	return prefix;
+}
 static int EntryArray_sortEntry(const void* a, const void* b) {
-	Entry* item1 = *(Entry**)a;
-	Entry* item2 = *(Entry**)b;
-	return strcasecmp(item1->name, item2->name);
+	const EntrySortKey* key1 = a;
+	const EntrySortKey* key2 = b;
+	if (key1->prefix!=key2->prefix) return key1->prefix<key2->prefix ? -1 : 1;
+	return strcasecmp(key1->entry->name, key2->entry->name);
 }
 static void EntryArray_sort(Array* self) {
-	qsort(self->items, self->count, sizeof(void*), EntryArray_sortEntry);
+	if (self->count<2) return;
+	EntrySortKey* keys = malloc(self->count * sizeof(EntrySortKey));
+	for (int i=0; i<self->count; i++) {
+		Entry* entry = self->items[i];
+		keys[i].prefix = EntrySortKey_prefix(entry->name);
+		keys[i].entry = entry;
+	}
+	qsort(keys, self->count, sizeof(EntrySortKey), EntryArray_sortEntry);
+	for (int i=0; i<self->count; i++) {
+		self->items[i] = keys[i].entry;
+	}
+	free(keys);
 }
 
 static void EntryArray_free(Array* self) {
@@ -206,11 +324,34 @@ static void IntArray_free(IntArray* self) {
 
 ///////////////////////////////////////
 
+// a listing being built on the listing worker, see Listing below
+typedef struct ListingJob {
+	struct ListingJob* next; // in the worker's queue
+	char path[256];
+	int selected;
+	int start;
+	int end;
+	volatile int cancel; // set when the Directory waiting for it is closed
+	int done;
+	struct Directory* result;
+	Array* preview; // first screenful found, until Listing_poll takes it
+	Arena* preview_arena;
+} ListingJob;
+
+static ListingJob* listing_active = NULL; // the one the worker is building right now, under listingMutex
+static __thread ListingJob* listing_job = NULL; // the same but only set on the worker, builds on other threads never see it
+static int Listing_cancelled(void) {
+	return listing_job && listing_job->cancel;
+}
+static void Listing_progress(Array* entries);
+
 typedef struct Directory {
 	char* path;
 	char* name;
 	Array* entries;
 	IntArray* alphas;
+	Arena* arena; // holds entries, NULL if they live in the arena of the Directory being built around this one
+	ListingJob* job; // NULL once entries is the complete listing
 	// rendering
 	int selected;
 	int start;
@@ -239,43 +380,28 @@ static void getUniqueName(Entry* entry, char* out_name) {
 	strcpy(tmp, ")");
 }
 
+static void Library_depend(char* path); // see library index below
+
 static void Directory_index(Directory* self) {
     int is_collection = prefixMatch(COLLECTIONS_PATH, self->path);
     int skip_index = exactMatch(FAUX_RECENT_PATH, self->path) || is_collection; // not alphabetized
     
-    Hash* map = NULL;
+    HashMap* map = NULL;
     char map_path[256];
     sprintf(map_path, "%s/map.txt", is_collection ? COLLECTIONS_PATH : self->path);
 
+    Library_depend(map_path);
     if (exists(map_path)) {
-        FILE* file = fopen(map_path, "r");
-        if (file) {
-            map = Hash_new();
-            char line[256];
-            while (fgets(line, 256, file) != NULL) {
-                normalizeNewline(line);
-                trimTrailingNewlines(line);
-                if (strlen(line) == 0) continue; // skip empty lines
-
-                char* tmp = strchr(line, '\t');
-                if (tmp) {
-                    tmp[0] = '\0';
-                    char* key = line;
-                    char* value = tmp + 1;
-                    Hash_set(map, key, strdup(value)); // Ensure strdup to store value properly
-                }
-            }
-            fclose(file);
-            
+        map = Map_load(map_path);
+        if (map) {
             int resort = 0;
             int filter = 0;
             for (int i = 0; i < self->entries->count; i++) {
                 Entry* entry = self->entries->items[i];
                 char* filename = strrchr(entry->path, '/') + 1;
-                char* alias = Hash_get(map, filename);
+                char* alias = HashMap_get(map, filename);
                 if (alias) {
-                    free(entry->name);  // Free before overwriting
-                    entry->name = strdup(alias);
+                    Entry_setName(entry, alias);
                     resort = 1;
                     if (!filter && hide(entry->name)) filter = 1;
                 }
@@ -303,21 +429,9 @@ static void Directory_index(Directory* self) {
     int index = 0;
     for (int i = 0; i < self->entries->count; i++) {
         Entry* entry = self->entries->items[i];
-        if (map) {
-            char* filename = strrchr(entry->path, '/') + 1;
-            char* alias = Hash_get(map, filename);
-            if (alias) {
-                free(entry->name);  // Free before overwriting
-                entry->name = strdup(alias);
-            }
-        }
+        // aliases were already applied above
         
         if (prior != NULL && exactMatch(prior->name, entry->name)) {
-            free(prior->unique);
-            free(entry->unique);
-            prior->unique = NULL;
-            entry->unique = NULL;
-
             char* prior_filename = strrchr(prior->path, '/') + 1;
             char* entry_filename = strrchr(entry->path, '/') + 1;
             if (exactMatch(prior_filename, entry_filename)) {
@@ -326,11 +440,11 @@ static void Directory_index(Directory* self) {
                 getUniqueName(prior, prior_unique);
                 getUniqueName(entry, entry_unique);
 
-                prior->unique = strdup(prior_unique);
-                entry->unique = strdup(entry_unique);
+                Entry_setUnique(prior, prior_unique);
+                Entry_setUnique(entry, entry_unique);
             } else {
-                prior->unique = strdup(prior_filename);
-                entry->unique = strdup(entry_filename);
+                Entry_setUnique(prior, prior_filename);
+                Entry_setUnique(entry, entry_filename);
             }
         }
 
@@ -347,7 +461,391 @@ static void Directory_index(Directory* self) {
         prior = entry;
     }
 
-    if (map) Hash_free(map);  // Free the map at the end
+    if (map) HashMap_free(map);  // Free the map at the end
+}
+
+///////////////////////////////////////
+// library index, keeps finished directory listings (sorted, aliased by
+// map.txt, alpha indexed and with thumbnail presence) in a single file so
+// opening a big folder is a lookup instead of readdir + map.txt parsing.
+// each listing remembers the mtime and size of everything it was built
+// from (folders, map.txt, .media) so validating it only takes a few stat()
+// calls and any change rebuilds just that listing
+
+#define LIBRARY_PATH SHARED_USERDATA_PATH "/.minui/library.idx"
+#define LIBRARY_MAGIC 0x494c584e // NXLI
+#define LIBRARY_VERSION 1
+#define LIBRARY_MAX_RECORDS 256 // most recently used listings kept
+
+typedef struct LibraryRecord {
+	char* key; // directory path
+	uint8_t* data;
+	uint32_t size;
+} LibraryRecord;
+
+typedef struct LibraryBuffer {
+	uint8_t* data;
+	uint32_t size;
+	uint32_t capacity;
+	uint32_t offset; // when reading
+	int error;
+} LibraryBuffer;
+
+static struct {
+	int loaded;
+	int dirty;
+	Array* records; // LibraryRecord, most recently used first
+} library;
+static __thread Array* library_deps = NULL; // paths the listing being built on this thread depends on, NULL when not recording
+
+static void LibraryBuffer_write(LibraryBuffer* self, const void* data, uint32_t size) {
+	if (self->size+size>self->capacity) {
+		while (self->size+size>self->capacity) self->capacity = self->capacity ? self->capacity * 2 : 4096;
+		self->data = realloc(self->data, self->capacity);
+	}
+	memcpy(self->data+self->size, data, size);
+	self->size += size;
+}
+static void LibraryBuffer_writeInt(LibraryBuffer* self, int32_t i) {
+	LibraryBuffer_write(self, &i, sizeof(i));
+}
+static void LibraryBuffer_writeLong(LibraryBuffer* self, int64_t i) {
+	LibraryBuffer_write(self, &i, sizeof(i));
+}
+static void LibraryBuffer_writeString(LibraryBuffer* self, char* str) {
+	int32_t len = str ? strlen(str) : -1;
+	LibraryBuffer_writeInt(self, len);
+	if (len>0) LibraryBuffer_write(self, str, len);
+}
+static void LibraryBuffer_read(LibraryBuffer* self, void* data, uint32_t size) {
+	if (self->error || self->offset+size>self->size) {
+		self->error = 1;
+		memset(data, 0, size);
+		return;
+	}
+	memcpy(data, self->data+self->offset, size);
+	self->offset += size;
+}
+static int32_t LibraryBuffer_readInt(LibraryBuffer* self) {
+	int32_t i;
+	LibraryBuffer_read(self, &i, sizeof(i));
+	return i;
+}
+static int64_t LibraryBuffer_readLong(LibraryBuffer* self) {
+	int64_t i;
+	LibraryBuffer_read(self, &i, sizeof(i));
+	return i;
+}
+static char* LibraryBuffer_readString(LibraryBuffer* self, Arena* arena) { // caller frees unless from arena
+	int32_t len = LibraryBuffer_readInt(self);
+	if (len<0 || self->error) return NULL;
+	if (self->offset+len>self->size) {
+		self->error = 1;
+		return NULL;
+	}
+	char* str = arena ? ArenaBlock_alloc(&arena->strings, len+1) : malloc(len+1);
+	memcpy(str, self->data+self->offset, len);
+	str[len] = '\0';
+	self->offset += len;
+	return str;
+}
+
+static void LibraryRecord_free(LibraryRecord* self) {
+	free(self->key);
+	free(self->data);
+	free(self);
+}
+
+static void Library_load(void) {
+	if (library.loaded) return;
+	library.loaded = 1;
+	library.records = Array_new();
+
+	// the whole index is a single read
+	FILE* file = fopen(LIBRARY_PATH, "rb");
+	if (!file) return;
+	LibraryBuffer buffer = {0};
+	fseek(file, 0, SEEK_END);
+	buffer.size = buffer.capacity = ftell(file);
+	rewind(file);
+	buffer.data = malloc(buffer.size ? buffer.size : 1);
+	if (fread(buffer.data, 1, buffer.size, file)!=buffer.size) buffer.error = 1;
+	fclose(file);
+
+	if (LibraryBuffer_readInt(&buffer)!=LIBRARY_MAGIC || LibraryBuffer_readInt(&buffer)!=LIBRARY_VERSION) {
+		LOG_info("Library_load: ignoring stale or unreadable %s\n", LIBRARY_PATH);
+		free(buffer.data);
+		return;
+	}
+	int count = LibraryBuffer_readInt(&buffer);
+	for (int i=0; i<count && !buffer.error; i++) {
+		char* key = LibraryBuffer_readString(&buffer, NULL);
+		uint32_t size = LibraryBuffer_readInt(&buffer);
+		if (!key || buffer.error || buffer.offset+size>buffer.size) {
+			free(key);
+			break;
+		}
+		LibraryRecord* record = malloc(sizeof(LibraryRecord));
+		record->key = key;
+		record->size = size;
+		record->data = malloc(size ? size : 1);
+		memcpy(record->data, buffer.data+buffer.offset, size);
+		buffer.offset += size;
+		Array_push(library.records, record);
+	}
+	free(buffer.data);
+	LOG_info("Library_load: %i listings\n", library.records->count);
+}
+static void Library_save(void) {
+	if (!library.dirty) return;
+
+	LibraryBuffer buffer = {0};
+	LibraryBuffer_writeInt(&buffer, LIBRARY_MAGIC);
+	LibraryBuffer_writeInt(&buffer, LIBRARY_VERSION);
+	LibraryBuffer_writeInt(&buffer, library.records->count);
+	for (int i=0; i<library.records->count; i++) {
+		LibraryRecord* record = library.records->items[i];
+		LibraryBuffer_writeString(&buffer, record->key);
+		LibraryBuffer_writeInt(&buffer, record->size);
+		LibraryBuffer_write(&buffer, record->data, record->size);
+	}
+
+	// write then rename so a power cut never leaves a torn index
+	char tmp_path[256];
+	sprintf(tmp_path, "%s.tmp", LIBRARY_PATH);
+	FILE* file = fopen(tmp_path, "wb");
+	if (file) {
+		int ok = fwrite(buffer.data, 1, buffer.size, file)==buffer.size;
+		if (fclose(file)!=0) ok = 0;
+		if (ok) rename(tmp_path, LIBRARY_PATH);
+		else unlink(tmp_path);
+	}
+	free(buffer.data);
+	library.dirty = 0;
+}
+static void Library_quit(void) {
+	Library_save();
+	if (!library.records) return;
+	for (int i=0; i<library.records->count; i++) {
+		LibraryRecord_free(library.records->items[i]);
+	}
+	Array_free(library.records);
+	library.records = NULL;
+	library.loaded = 0;
+}
+
+// called by anything that reads the filesystem while a listing is built
+static void Library_depend(char* path) {
+	if (!library_deps) return;
+	if (StringArray_indexOf(library_deps, path)!=-1) return;
+	Array_push(library_deps, strdup(path));
+}
+
+static int Library_isCacheable(char* path) {
+	// root and recents change with recently played, collections and m3us are
+	// short lists of paths that still need to be checked for existence
+	if (exactMatch(path, SDCARD_PATH)) return 0;
+	if (exactMatch(path, FAUX_RECENT_PATH)) return 0;
+	if (prefixMatch(COLLECTIONS_PATH, path)) return 0;
+	if (suffixMatch(".m3u", path)) return 0;
+	return prefixMatch(ROMS_PATH, path);
+}
+
+static LibraryRecord* Library_find(char* path) {
+	for (int i=0; i<library.records->count; i++) {
+		LibraryRecord* record = library.records->items[i];
+		if (exactMatch(record->key, path)) return record;
+	}
+	return NULL;
+}
+
+static void Library_statDep(char* path, int64_t* mtime, int64_t* size) {
+	struct stat st;
+	if (stat(path, &st)==0) {
+		*mtime = st.st_mtime;
+		*size = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+	}
+	else *mtime = *size = -1;
+}
+
+// fills entries and alphas from the index if nothing it depends on changed
+static int Library_restore(Directory* self) {
+	if (!Library_isCacheable(self->path)) return 0;
+	Library_load();
+
+	LibraryRecord* record = Library_find(self->path);
+	if (!record) return 0;
+
+	LibraryBuffer buffer = {.data=record->data, .size=record->size};
+	int valid = 1;
+	int dep_count = LibraryBuffer_readInt(&buffer);
+	for (int i=0; i<dep_count && valid && !buffer.error; i++) {
+		char* path = LibraryBuffer_readString(&buffer, NULL);
+		int64_t mtime = LibraryBuffer_readLong(&buffer);
+		int64_t size = LibraryBuffer_readLong(&buffer);
+		int64_t cur_mtime, cur_size;
+		if (path) {
+			Library_statDep(path, &cur_mtime, &cur_size);
+			if (cur_mtime!=mtime || cur_size!=size) valid = 0;
+			free(path);
+		}
+		else valid = 0;
+	}
+	if (!valid || buffer.error) {
+		Array_remove(library.records, record);
+		LibraryRecord_free(record);
+		library.dirty = 1;
+		return 0;
+	}
+
+	Array* entries = Array_new();
+	int entry_count = LibraryBuffer_readInt(&buffer);
+	for (int i=0; i<entry_count && !buffer.error; i++) {
+		Entry* entry = Entry_alloc();
+		entry->type = LibraryBuffer_readInt(&buffer);
+		entry->alpha = LibraryBuffer_readInt(&buffer);
+		entry->has_thumb = LibraryBuffer_readInt(&buffer);
+		entry->path = LibraryBuffer_readString(&buffer, entry->arena);
+		entry->name = LibraryBuffer_readString(&buffer, entry->arena);
+		entry->unique = LibraryBuffer_readString(&buffer, entry->arena);
+		if (!entry->path || !entry->name) {
+			buffer.error = 1;
+			Entry_free(entry);
+			break;
+		}
+		Array_push(entries, entry);
+	}
+	int alpha_count = LibraryBuffer_readInt(&buffer);
+	if (alpha_count<0 || alpha_count>INT_ARRAY_MAX) buffer.error = 1;
+	for (int i=0; i<alpha_count && !buffer.error; i++) {
+		IntArray_push(self->alphas, LibraryBuffer_readInt(&buffer));
+	}
+	if (buffer.error) {
+		EntryArray_free(entries);
+		self->alphas->count = 0;
+		Array_remove(library.records, record);
+		LibraryRecord_free(record);
+		library.dirty = 1;
+		return 0;
+	}
+
+	self->entries = entries;
+	// most recently used first so the least used fall off when saving
+	Array_remove(library.records, record);
+	Array_unshift(library.records, record);
+	return 1;
+}
+
+static Array* Library_beginRecording(void) {
+	Array* outer = library_deps;
+	library_deps = Array_new();
+	return outer;
+}
+
+static int Library_sortString(const void* a, const void* b) {
+	return strcmp(*(char**)a, *(char**)b);
+}
+// marks entries whose <parent>/.media/<name>.png exists, one readdir per parent
+static void Library_findThumbs(Array* entries) {
+	char media_path[256] = {0};
+	Array* thumbs = NULL;
+	for (int i=0; i<entries->count; i++) {
+		Entry* entry = entries->items[i];
+
+		char parent[256];
+		strcpy(parent, entry->path);
+		char* tmp = strrchr(parent, '/');
+		if (!tmp) continue;
+		tmp[0] = '\0';
+		char thumb_name[256];
+		snprintf(thumb_name, sizeof(thumb_name), "%s", tmp+1);
+		tmp = strrchr(thumb_name, '.');
+		if (tmp) tmp[0] = '\0';
+		strcat(thumb_name, ".png");
+
+		char path[256];
+		snprintf(path, sizeof(path), "%s/.media", parent);
+		if (!thumbs || !exactMatch(path, media_path)) {
+			if (thumbs) StringArray_free(thumbs);
+			thumbs = Array_new();
+			strcpy(media_path, path);
+			Library_depend(media_path);
+
+			DIR* dh = opendir(media_path);
+			if (dh) {
+				struct dirent* dp;
+				while ((dp = readdir(dh))!=NULL) {
+					if (suffixMatch(".png", dp->d_name)) Array_push(thumbs, strdup(dp->d_name));
+				}
+				closedir(dh);
+			}
+			qsort(thumbs->items, thumbs->count, sizeof(void*), Library_sortString);
+		}
+		char* key = thumb_name;
+		entry->has_thumb = bsearch(&key, thumbs->items, thumbs->count, sizeof(void*), Library_sortString)!=NULL;
+	}
+	if (thumbs) StringArray_free(thumbs);
+}
+
+static void Library_endRecording(Directory* self, Array* outer) {
+	Array* deps = library_deps;
+	library_deps = outer;
+
+	if (Listing_cancelled()) { // only got part of the way
+		StringArray_free(deps);
+		return;
+	}
+
+	if (Library_isCacheable(self->path)) {
+		library_deps = deps; // .media folders are dependencies too
+		Library_findThumbs(self->entries);
+		library_deps = outer;
+
+		LibraryBuffer buffer = {0};
+		time_t now = time(NULL);
+		int fresh = 0;
+		LibraryBuffer_writeInt(&buffer, deps->count);
+		for (int i=0; i<deps->count; i++) {
+			int64_t mtime, size;
+			Library_statDep(deps->items[i], &mtime, &size);
+			// FAT mtimes are 2 seconds apart, a change in the same window would go unnoticed
+			if (mtime>=now-2) fresh = 1;
+			LibraryBuffer_writeString(&buffer, deps->items[i]);
+			LibraryBuffer_writeLong(&buffer, mtime);
+			LibraryBuffer_writeLong(&buffer, size);
+		}
+		LibraryBuffer_writeInt(&buffer, self->entries->count);
+		for (int i=0; i<self->entries->count; i++) {
+			Entry* entry = self->entries->items[i];
+			LibraryBuffer_writeInt(&buffer, entry->type);
+			LibraryBuffer_writeInt(&buffer, entry->alpha);
+			LibraryBuffer_writeInt(&buffer, entry->has_thumb);
+			LibraryBuffer_writeString(&buffer, entry->path);
+			LibraryBuffer_writeString(&buffer, entry->name);
+			LibraryBuffer_writeString(&buffer, entry->unique);
+		}
+		LibraryBuffer_writeInt(&buffer, self->alphas->count);
+		for (int i=0; i<self->alphas->count; i++) {
+			LibraryBuffer_writeInt(&buffer, self->alphas->items[i]);
+		}
+
+		if (!fresh) {
+			LibraryRecord* record = malloc(sizeof(LibraryRecord));
+			record->key = strdup(self->path);
+			record->data = buffer.data;
+			record->size = buffer.size;
+			Array_unshift(library.records, record);
+			while (library.records->count>LIBRARY_MAX_RECORDS) {
+				LibraryRecord_free(Array_pop(library.records));
+			}
+			library.dirty = 1;
+		}
+		else free(buffer.data);
+	}
+
+	// whatever contains this listing depends on the same things
+	for (int i=0; i<deps->count; i++) Library_depend(deps->items[i]);
+	StringArray_free(deps);
 }
 
 static Array* getRoot(void);
@@ -364,6 +862,21 @@ static Directory* Directory_new(char* path, int selected) {
 	Directory* self = malloc(sizeof(Directory));
 	self->path = strdup(path);
 	self->name = strdup(display_name);
+	self->alphas = IntArray_new();
+	self->selected = selected;
+	self->job = NULL;
+
+	// nested listings (getRoot builds Roms) hand their entries to the outer one
+	Arena* outer_arena = entry_arena;
+	self->arena = outer_arena ? NULL : Arena_new();
+	entry_arena = outer_arena ? outer_arena : self->arena;
+
+	if (Library_restore(self)) {
+		entry_arena = outer_arena;
+		return self;
+	}
+
+	Array* outer_deps = Library_beginRecording();
 	if (exactMatch(path, SDCARD_PATH)) {
 		self->entries = getRoot();
 	}
@@ -382,16 +895,19 @@ static Directory* Directory_new(char* path, int selected) {
 	else {
 		self->entries = getEntries(path);
 	}
-	self->alphas = IntArray_new();
-	self->selected = selected;
 	Directory_index(self);
+	Library_endRecording(self, outer_deps);
+	entry_arena = outer_arena;
 	return self;
 }
+static void Listing_cancel(ListingJob* job);
 static void Directory_free(Directory* self) {
+	if (self->job) Listing_cancel(self->job);
 	free(self->path);
 	free(self->name);
 	EntryArray_free(self->entries);
 	IntArray_free(self->alphas);
+	if (self->arena) Arena_free(self->arena);
 	free(self);
 }
 
@@ -458,7 +974,334 @@ static Array* recents; // RecentArray
 static Array *quick; // EntryArray
 static Array *quickActions; // EntryArray
 
+///////////////////////////////////////
+
+// listings other than root and recents are built on a worker thread so a
+// huge folder doesn't freeze input. Directory_open waits LISTING_WAIT_MS
+// for it, if it isn't done by then the Directory starts out empty, shows
+// the first screenful found once there is one and gets the complete sorted
+// and indexed listing when the worker is done. closing it cancels the work
+
+#define LISTING_WAIT_MS 50
+
+static ListingJob* listingQueueHead = NULL;
+static ListingJob* listingQueueTail = NULL;
+static SDL_mutex* listingMutex = NULL;
+static SDL_cond* listingQueueCond = NULL;
+static SDL_cond* listingDoneCond = NULL;
+static SDL_mutex* buildMutex = NULL; // held while building any listing, the library index isn't thread safe
+
+static void Listing_free(ListingJob* job) {
+	if (job->result) Directory_free(job->result);
+	if (job->preview) Array_free(job->preview);
+	if (job->preview_arena) Arena_free(job->preview_arena);
+	free(job);
+}
+
+// called on the worker as entries are found
+static void Listing_progress(Array* entries) {
+	ListingJob* job = listing_job;
+	if (!job || job->preview_arena || entries->count<MAIN_ROW_COUNT) return;
+
+	// copies, the originals still get renamed and indexed
+	Arena* arena = Arena_new();
+	Array* preview = Array_new();
+	Arena* outer_arena = entry_arena;
+	entry_arena = arena;
+	for (int i=0; i<entries->count; i++) {
+		Entry* entry = entries->items[i];
+		Array_push(preview, Entry_newNamed(entry->path, entry->type, entry->name));
+	}
+	entry_arena = outer_arena;
+	EntryArray_sort(preview);
+
+	SDL_LockMutex(listingMutex);
+	job->preview_arena = arena;
+	job->preview = preview;
+	SDL_UnlockMutex(listingMutex);
+}
+
+static void Listing_cancel(ListingJob* job) {
+	SDL_LockMutex(listingMutex);
+	job->cancel = 1;
+	int done = job->done; // otherwise the worker frees it
+	SDL_UnlockMutex(listingMutex);
+	if (done) Listing_free(job);
+}
+
+int ListingWorker(void* unused) {
+	while (true) {
+		SDL_LockMutex(listingMutex);
+		while (!listingQueueHead) {
+			SDL_CondWait(listingQueueCond, listingMutex);
+		}
+		ListingJob* job = listingQueueHead;
+		listingQueueHead = job->next;
+		if (!listingQueueHead) listingQueueTail = NULL;
+		listing_active = job;
+		listing_job = job;
+		SDL_UnlockMutex(listingMutex);
+
+		Directory* result = NULL;
+		if (!job->cancel) {
+			SDL_LockMutex(buildMutex);
+			result = Directory_new(job->path, job->selected);
+			SDL_UnlockMutex(buildMutex);
+		}
+
+		SDL_LockMutex(listingMutex);
+		listing_active = NULL;
+		listing_job = NULL;
+		int cancel = job->cancel;
+		if (!cancel) {
+			job->result = result;
+			job->done = 1;
+			SDL_CondBroadcast(listingDoneCond);
+		}
+		SDL_UnlockMutex(listingMutex);
+
+		if (cancel) {
+			if (result) Directory_free(result);
+			Listing_free(job);
+		}
+	}
+	return 0;
+}
+
+static void Directory_setWindow(Directory* self, int start, int end) {
+	self->start = start;
+	self->end = end ? end : ((self->entries->count<MAIN_ROW_COUNT) ? self->entries->count : MAIN_ROW_COUNT);
+}
+
+static Directory* Directory_open(char* path, int selected, int start, int end) {
+	Directory* self;
+	if (exactMatch(path, SDCARD_PATH) || exactMatch(path, FAUX_RECENT_PATH)) {
+		// both (re)build recents which the game switcher reads on this thread
+		SDL_LockMutex(buildMutex);
+		self = Directory_new(path, selected);
+		SDL_UnlockMutex(buildMutex);
+		Directory_setWindow(self, start, end);
+		return self;
+	}
+
+	ListingJob* job = calloc(1, sizeof(ListingJob));
+	snprintf(job->path, sizeof(job->path), "%s", path);
+	job->selected = selected;
+	job->start = start;
+	job->end = end;
+
+	SDL_LockMutex(listingMutex);
+	if (listingQueueTail) listingQueueTail->next = job;
+	else listingQueueHead = job;
+	listingQueueTail = job;
+	SDL_CondSignal(listingQueueCond);
+
+	Uint32 deadline = SDL_GetTicks() + LISTING_WAIT_MS;
+	while (!job->done) {
+		Uint32 now = SDL_GetTicks();
+		if (now>=deadline) break;
+		SDL_CondWaitTimeout(listingDoneCond, listingMutex, deadline - now);
+	}
+	int done = job->done;
+	SDL_UnlockMutex(listingMutex);
+
+	if (done) {
+		self = job->result;
+		job->result = NULL;
+		Listing_free(job);
+		Directory_setWindow(self, start, end);
+		return self;
+	}
+
+	char display_name[256];
+	getDisplayName(path, display_name);
+	self = malloc(sizeof(Directory));
+	self->path = strdup(path);
+	self->name = strdup(display_name);
+	self->entries = Array_new();
+	self->alphas = IntArray_new();
+	self->arena = NULL;
+	self->job = job;
+	self->selected = 0;
+	Directory_setWindow(self, 0, 0);
+	return self;
+}
+
+// swaps in the complete listing, keeping the selection if the preview was scrolled
+static void Listing_apply(Directory* self) {
+	ListingJob* job = self->job;
+	Directory* result = job->result;
+	job->result = NULL;
+
+	int selected = job->selected;
+	int start = job->start;
+	int end = job->end;
+	if (self->selected>0) {
+		Entry* entry = self->entries->items[self->selected];
+		int i = EntryArray_indexOf(result->entries, entry->path);
+		if (i>=0) {
+			selected = i;
+			start = i - (self->selected - self->start);
+			if (start<0) start = 0;
+			end = start + MAIN_ROW_COUNT;
+			if (end>result->entries->count) end = result->entries->count;
+			start = end - MAIN_ROW_COUNT;
+			if (start<0) start = 0;
+		}
+	}
+
+	EntryArray_free(self->entries);
+	IntArray_free(self->alphas);
+	self->entries = result->entries;
+	self->alphas = result->alphas;
+	self->arena = result->arena;
+	self->selected = selected;
+	Directory_setWindow(self, start, end);
+	self->job = NULL;
+
+	free(result->path);
+	free(result->name);
+	free(result);
+	Listing_free(job);
+}
+
+// blocks until the listing is complete, for when a selection has to be found in it
+static void Listing_wait(Directory* self) {
+	if (!self->job) return;
+	SDL_LockMutex(listingMutex);
+	while (!self->job->done) {
+		SDL_CondWait(listingDoneCond, listingMutex);
+	}
+	SDL_UnlockMutex(listingMutex);
+	Listing_apply(self);
+}
+
+// call once a frame, returns 1 if any Directory on the stack changed
+static int Listing_poll(void) {
+	int changed = 0;
+	for (int i=0; i<stack->count; i++) {
+		Directory* dir = stack->items[i];
+		if (!dir->job) continue;
+
+		SDL_LockMutex(listingMutex);
+		int done = dir->job->done;
+		Array* preview = NULL;
+		if (!done && dir->job->preview) {
+			preview = dir->job->preview;
+			dir->job->preview = NULL;
+		}
+		SDL_UnlockMutex(listingMutex);
+
+		if (done) {
+			Listing_apply(dir);
+			changed = 1;
+		}
+		else if (preview) {
+			EntryArray_free(dir->entries);
+			dir->entries = preview;
+			dir->selected = 0;
+			Directory_setWindow(dir, 0, 0);
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+// stops the worker for good so the library index can be saved
+static void Listing_quit(void) {
+	SDL_LockMutex(listingMutex);
+	for (ListingJob* job=listingQueueHead; job; job=job->next) {
+		job->cancel = 1;
+	}
+	if (listing_active) listing_active->cancel = 1;
+	SDL_UnlockMutex(listingMutex);
+	SDL_LockMutex(buildMutex); // never released
+}
+
+///////////////////////////////////////
+
+// startup profiling. each phase is logged as it finishes and once the first
+// frame is on screen the breakdown is appended to logs/startup.txt, one line
+// per start, so time to first frame can be compared across updates and
+// settings. coming back from a game in resident mode is measured the same way
+
+#define STARTUP_LOG_PATH USERDATA_PATH "/logs/startup.txt"
+#define STARTUP_PHASES 16
+
+static struct {
+	const char* label;
+	uint64_t begin; // ns, CLOCK_MONOTONIC
+	uint64_t last;
+	const char* names[STARTUP_PHASES];
+	uint32_t durations[STARTUP_PHASES]; // us
+	int count;
+	int done;
+} startup;
+
+static uint64_t Startup_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void Startup_begin(const char* label) {
+	memset(&startup, 0, sizeof(startup));
+	startup.label = label;
+	startup.begin = startup.last = Startup_now();
+}
+static void Startup_phase(const char* name) {
+	if (startup.done) return;
+	uint64_t now = Startup_now();
+	uint32_t us = (now - startup.last) / 1000;
+	startup.last = now;
+	LOG_info("%s: %-12s %7.1fms\n", startup.label, name, us / 1000.0);
+	if (startup.count<STARTUP_PHASES) {
+		startup.names[startup.count] = name;
+		startup.durations[startup.count] = us;
+		startup.count += 1;
+	}
+}
+static void Startup_firstFrame(void) {
+	if (startup.done) return;
+	Startup_phase("frame"); // the rest of the first loop iteration
+	startup.done = 1;
+
+	double total = (startup.last - startup.begin) / 1000000.0;
+	LOG_info("%s: %.1fms to first frame\n", startup.label, total);
+
+	char timestamp[32];
+	time_t now = time(NULL);
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+	mkdir(USERDATA_PATH "/logs", 0755);
+	FILE* file = fopen(STARTUP_LOG_PATH, "a");
+	if (!file) return;
+	fprintf(file, "%s %s %.1fms", timestamp, startup.label, total);
+	for (int i=0; i<startup.count; i++) {
+		fprintf(file, " %s=%.1f", startup.names[i], startup.durations[i] / 1000.0);
+	}
+	fprintf(file, "\n");
+	fclose(file);
+}
+
+// nothing on screen needs wifi, it comes up while the first frames are drawn
+static SDL_Thread* wifi_thread = NULL;
+
+static int WifiInitWorker(void* unused) {
+	WIFI_init();
+	return 0;
+}
+static void Startup_wait(SDL_Thread** thread) {
+	if (!*thread) return;
+	SDL_WaitThread(*thread, NULL);
+	*thread = NULL;
+}
+
+///////////////////////////////////////
+
 static int quit = 0;
+static int resident = 0;
+static int suspend = 0;
 static int can_resume = 0;
 static int should_resume = 0; // set to 1 on BTN_RESUME but only if can_resume==1
 static int has_preview = 0;
@@ -532,13 +1375,24 @@ static Entry* entryFromPakName(char* pak_name)
 	return NULL;
 }
 
+static __thread HashMap* emu_cache = NULL; // emu name to "1" or "0", only while readRecents runs
 static int hasEmu(char* emu_name) {
+	Library_depend(PAKS_PATH "/Emus");
+	Library_depend(SDCARD_PATH "/Emus/" PLATFORM);
+
+	char* cached = emu_cache ? HashMap_get(emu_cache, emu_name) : NULL;
+	if (cached) return cached[0]=='1';
+
 	char pak_path[256];
 	sprintf(pak_path, "%s/Emus/%s.pak/launch.sh", PAKS_PATH, emu_name);
-	if (exists(pak_path)) return 1;
+	int has = exists(pak_path);
+	if (!has) {
+		sprintf(pak_path, "%s/Emus/%s/%s.pak/launch.sh", SDCARD_PATH, PLATFORM, emu_name);
+		has = exists(pak_path);
+	}
 
-	sprintf(pak_path, "%s/Emus/%s/%s.pak/launch.sh", SDCARD_PATH, PLATFORM, emu_name);
-	return exists(pak_path);
+	if (emu_cache) HashMap_set(emu_cache, emu_name, has ? "1" : "0");
+	return has;
 }
 static int hasCue(char* dir_path, char* cue_path) { // NOTE: dir_path not rom_path
 	char* tmp = strrchr(dir_path, '/') + 1; // folder name
@@ -575,11 +1429,13 @@ static int hasM3u(char* rom_path, char* m3u_path) { // NOTE: rom_path not dir_pa
 	return exists(m3u_path);
 }
 
-static int hasRecents(void) {
-	LOG_info("hasRecents %s\n", RECENT_PATH);
+// fills list from RECENT_PATH, doesn't touch recents so it can run off the main thread
+static int readRecents(Array* list) {
+	LOG_info("readRecents %s\n", RECENT_PATH);
 	int has = 0;
-	RecentArray_free(recents);
-	recents = Array_new();
+
+	// most recents share a handful of emus, don't stat their paks for every one
+	emu_cache = HashMap_new();
 
 	Array* parent_paths = Array_new();
 	if (exists(CHANGE_DISC_PATH)) {
@@ -589,7 +1445,7 @@ static int hasRecents(void) {
 			char* disc_path = sd_path + strlen(SDCARD_PATH); // makes path platform agnostic
 			Recent* recent = Recent_new(disc_path, NULL);
 			if (recent->available) has += 1;
-			Array_push(recents, recent);
+			Array_push(list, recent);
 		
 			char parent_path[256];
 			strcpy(parent_path, disc_path);
@@ -621,7 +1477,7 @@ static int hasRecents(void) {
 			char sd_path[256];
 			sprintf(sd_path, "%s%s", SDCARD_PATH, path);
 			if (exists(sd_path)) {
-				if (recents->count<MAX_RECENTS) {
+				if (list->count<MAX_RECENTS) {
 					// this logic replaces an existing disc from a multi-disc game with the last used
 					char m3u_path[256];
 					if (hasM3u(sd_path, m3u_path)) { // TODO: this might tank launch speed
@@ -647,18 +1503,26 @@ static int hasRecents(void) {
 					
 					Recent* recent = Recent_new(path, alias);
 					if (recent->available) has += 1;
-					Array_push(recents, recent);
+					Array_push(list, recent);
 				}
 			}
 		}
 		fclose(file);
 	}
 	
-	saveRecents();
-	
 	StringArray_free(parent_paths);
+	HashMap_free(emu_cache);
+	emu_cache = NULL;
 	return has>0;
 }
+static int hasRecents(void) {
+	Array* list = Array_new();
+	int has = readRecents(list);
+	RecentArray_free(recents);
+	recents = list;
+	saveRecents();
+	return has;
+}
 static int hasCollections(void) {
 	int has = 0;
 	if (!exists(COLLECTIONS_PATH)) return has;
@@ -684,7 +1548,9 @@ static int hasRoms(char* dir_name) {
 	if (!hasEmu(emu_name)) return has;
 	
 	// check for at least one non-hidden file (we're going to assume it's a rom)
-	sprintf(rom_path, "%s/%s/", ROMS_PATH, dir_name);
+	sprintf(rom_path, "%s/%s", ROMS_PATH, dir_name);
+	Library_depend(rom_path);
+	strcat(rom_path, "/");
 	DIR *dh = opendir(rom_path);
 	if (dh!=NULL) {
 		struct dirent *dp;
@@ -708,6 +1574,7 @@ static int hasTools(void) {
 static Array* getRoms()
 {
 	Array* entries = Array_new();
+    Library_depend(ROMS_PATH);
     DIR* dh = opendir(ROMS_PATH);
     if (dh) {
         struct dirent* dp;
@@ -739,46 +1606,7 @@ static Array* getRoms()
         Array_free(emus); // Only frees container, entries now owns the items
     }
 
-	// Handle mapping logic
-    char map_path[256];
-    snprintf(map_path, sizeof(map_path), "%s/map.txt", ROMS_PATH);
-    if (entries->count > 0 && exists(map_path)) {
-        FILE* file = fopen(map_path, "r");
-        if (file) {
-            Hash* map = Hash_new();
-            char line[256];
-
-            while (fgets(line, sizeof(line), file)) {
-                normalizeNewline(line);
-                trimTrailingNewlines(line);
-                if (strlen(line) == 0) continue; // Skip empty lines
-
-                char* tmp = strchr(line, '\t');
-                if (tmp) {
-                    *tmp = '\0';
-                    char* key = line;
-                    char* value = tmp + 1;
-                    Hash_set(map, key, strdup(value)); // Ensure strdup
-                }
-            }
-            fclose(file);
-
-            int resort = 0;
-            for (int i = 0; i < entries->count; i++) {
-                Entry* entry = entries->items[i];
-                char* filename = strrchr(entry->path, '/') + 1;
-                char* alias = Hash_get(map, filename);
-                if (alias) {
-                    free(entry->name);  // Free before overwriting
-                    entry->name = strdup(alias);
-                    resort = 1;
-                }
-            }
-            if (resort) EntryArray_sort(entries);
-            Hash_free(map);
-        }
-    }
-
+	// map.txt aliases are applied by Directory_index, like every other listing
 	return entries;
 }
 
@@ -849,12 +1677,43 @@ static Array* getQuickToggles(void) {
 	return entries;
 }
 
+// the first scan runs alongside GFX_init, see main
+static SDL_Thread* recents_thread = NULL;
+static Array* recents_found = NULL; // RecentArray, published by Recents_scan
+static int recents_available = 0;
+static int RecentsWorker(void* unused) {
+	recents_found = Array_new();
+	recents_available = readRecents(recents_found);
+	return 0;
+}
+static int Recents_scan(void) {
+	if (!recents_thread) return CFG_getShowRecents() && hasRecents();
+
+	SDL_WaitThread(recents_thread, NULL);
+	recents_thread = NULL;
+	if (!CFG_getShowRecents()) { // settings weren't loaded yet when it started
+		RecentArray_free(recents_found);
+		recents_found = NULL;
+		return 0;
+	}
+
+	RecentArray_free(recents);
+	recents = recents_found;
+	recents_found = NULL;
+	saveRecents();
+	return recents_available;
+}
+
 static Array* getRoot(void) {
     Array* root = Array_new();
 
-    if (CFG_getShowRecents() && hasRecents()) Array_push(root, Entry_new(FAUX_RECENT_PATH, ENTRY_DIR));
+    if (Recents_scan()) Array_push(root, Entry_new(FAUX_RECENT_PATH, ENTRY_DIR));
 
-	Array *entries = getRoms();
+	// the Roms listing is what's slow to build, get it from the library index
+	Directory* roms = Directory_new(ROMS_PATH, 0);
+	Array *entries = roms->entries;
+	roms->entries = Array_new();
+	Directory_free(roms);
 
 	// Handle collections
     if (hasCollections()) {
@@ -888,10 +1747,7 @@ static Entry* entryFromRecent(Recent* recent)
 	sprintf(sd_path, "%s%s", SDCARD_PATH, recent->path);
 	int type = suffixMatch(".pak", sd_path) ? ENTRY_PAK : ENTRY_ROM; // ???
 	Entry* entry = Entry_new(sd_path, type);
-	if (recent->alias) {
-		free(entry->name);
-		entry->name = strdup(recent->alias);
-	}
+	if (recent->alias) Entry_setName(entry, recent->alias);
 	return entry;
 }
 
@@ -959,11 +1815,9 @@ static Array* getDiscs(char* path){
 						
 			if (exists(disc_path)) {
 				disc += 1;
-				Entry* entry = Entry_new(disc_path, ENTRY_ROM);
-				free(entry->name);
 				char name[16];
 				sprintf(name, "Disc %i", disc);
-				entry->name = strdup(name);
+				Entry* entry = Entry_newNamed(disc_path, ENTRY_ROM, name);
 				Array_push(entries, entry);
 			}
 		}
@@ -998,6 +1852,7 @@ static int getFirstDisc(char* m3u_path, char* disc_path) { // based on getDiscs(
 }
 
 static void addEntries(Array* entries, char* path) {
+	Library_depend(path);
 	DIR *dh = opendir(path);
 	if (dh!=NULL) {
 		struct dirent *dp;
@@ -1028,6 +1883,8 @@ static void addEntries(Array* entries, char* path) {
 				}
 			}
 			Array_push(entries, Entry_new(full_path, type));
+			Listing_progress(entries);
+			if (Listing_cancelled()) break;
 		}
 		closedir(dh);
 	}
@@ -1054,6 +1911,7 @@ static Array* getEntries(char* path){
 		// but conditional so we can continue to support a bare tag name as a folder name
 		if (tmp) tmp[1] = '\0'; 
 		
+		Library_depend(ROMS_PATH);
 		DIR *dh = opendir(ROMS_PATH);
 		if (dh!=NULL) {
 			struct dirent *dp;
@@ -1061,7 +1919,7 @@ static Array* getEntries(char* path){
 			sprintf(full_path, "%s/", ROMS_PATH);
 			tmp = full_path + strlen(full_path);
 			// while loop so we can collate paths, see above
-			while((dp = readdir(dh)) != NULL) {
+			while((dp = readdir(dh)) != NULL && !Listing_cancelled()) {
 				if (hide(dp->d_name)) continue;
 				if (dp->d_type!=DT_DIR) continue;
 				strcpy(tmp, dp->d_name);
@@ -1085,6 +1943,17 @@ static void queueNext(char* cmd) {
 	putFile("/tmp/next", cmd);
 	quit = 1;
 }
+// with --resident the game runs from inside nextui, see Resident_run. paks
+// still go through launch.sh, they can change anything nextui has loaded
+static void queueGame(char* cmd) {
+	if (!resident) {
+		queueNext(cmd);
+		return;
+	}
+	LOG_info("cmd: %s\n", cmd);
+	putFile("/tmp/next", cmd); // gametimectl resume reads the rom from here
+	suspend = 1;
+}
 
 // based on https://stackoverflow.com/a/31775567/145965
 static int replaceString(char *line, const char *search, const char *replace) {
@@ -1197,15 +2066,14 @@ static int autoResume(void) {
 	
 	// putFile(LAST_PATH, FAUX_RECENT_PATH); // saveLast() will crash here because top is NULL
 
-	char act[256];
-	sprintf(act, "gametimectl.elf start '%s'", escapeSingleQuotes(sd_path));
-	system(act);
+	play_activity_queue_start(sd_path);
 	
 	char cmd[256];
-	// dont escape sd_path again because it was already escaped for gametimectl and function modifies input str aswell
-	sprintf(cmd, "'%s' '%s'", escapeSingleQuotes(emu_path), sd_path);
+	// NOTE: escapeSingleQuotes() modifies the passed string
+	sprintf(cmd, "'%s' '%s'", escapeSingleQuotes(emu_path), escapeSingleQuotes(sd_path));
 	putInt(RESUME_SLOT_PATH, AUTO_RESUME_SLOT);
 	queueNext(cmd);
+	play_activity_flush(); // main returns right after this
 	return 1;
 }
 
@@ -1276,13 +2144,10 @@ static void openRom(char* path, char* last) {
 	// so we need to save the path before we call that
 	addRecent(recent_path, recent_alias); // yiiikes
 	saveLast(last==NULL ? sd_path : last);
-	char act[256];
-	sprintf(act, "gametimectl.elf start '%s'", escapeSingleQuotes(sd_path));
-	system(act);
+	play_activity_queue_start(sd_path); // written in order after the stop_all from startup
 	char cmd[256];
-	// dont escape sd_path again because it was already escaped for gametimectl and function modifies input str aswell
-	sprintf(cmd, "'%s' '%s'", escapeSingleQuotes(emu_path), sd_path);
-	queueNext(cmd);
+	sprintf(cmd, "'%s' '%s'", escapeSingleQuotes(emu_path), escapeSingleQuotes(sd_path));
+	queueGame(cmd);
 }
 
 static bool isDirectSubdirectory(const Directory* parent, const char* child_path) {
@@ -1335,9 +2200,7 @@ Array* pathToStack(const char* path) {
 	if (!prefixMatch(SDCARD_PATH, path)) return array;
 
 	// Always include root directory
-	Directory* root_dir = Directory_new(SDCARD_PATH, 0);
-	root_dir->start = 0;
-	root_dir->end = (root_dir->entries->count < MAIN_ROW_COUNT) ? root_dir->entries->count : MAIN_ROW_COUNT;
+	Directory* root_dir = Directory_open(SDCARD_PATH, 0, 0, 0);
 	Array_push(array, root_dir);
 
 	if (exactMatch(path, SDCARD_PATH)) return array;
@@ -1379,15 +2242,11 @@ Array* pathToStack(const char* path) {
 				Directory_free(last); // assuming you have a Directory_free
 
 				// Replace with updated one using combined path
-				Directory* merged = Directory_new(temp_path, 0);
-				merged->start = 0;
-				merged->end = (merged->entries->count < MAIN_ROW_COUNT) ? merged->entries->count : MAIN_ROW_COUNT;
+				Directory* merged = Directory_open(temp_path, 0, 0, 0);
 				Array_push(array, merged);
 			}
 		} else {
-			Directory* dir = Directory_new(temp_path, 0);
-			dir->start = 0;
-			dir->end = (dir->entries->count < MAIN_ROW_COUNT) ? dir->entries->count : MAIN_ROW_COUNT;
+			Directory* dir = Directory_open(temp_path, 0, 0, 0);
 			Array_push(array, dir);
 		}
 
@@ -1436,10 +2295,7 @@ static void openDirectory(char* path, int auto_launch) {
 			}
 		}
 
-		top = Directory_new(path, selected);
-		top->start = start;
-		top->end = end ? end : ((top->entries->count<MAIN_ROW_COUNT) ? top->entries->count : MAIN_ROW_COUNT);
-	
+		top = Directory_open(path, selected, start, end);
 		Array_push(stack, top);
 	}
 	else {
@@ -1467,6 +2323,7 @@ static void toggleQuick(Entry* self)
 		return;
 
 	if(!strcmp(self->name, "Wifi")) {
+		Startup_wait(&wifi_thread);
 		WIFI_enable(!WIFI_enabled());
 	}
 	else if(!strcmp(self->name, "Sleep")) {
@@ -1573,6 +2430,7 @@ static void loadLast(void) { // call after loading root directory
 				
 					if (entry->type==ENTRY_DIR) {
 						openDirectory(entry->path, 0);
+						Listing_wait(top); // the next level is looked up in it
 						break;
 					}
 				}
@@ -1602,7 +2460,7 @@ static void QuickMenu_quit(void) {
 
 static void Menu_init(void) {
 	stack = Array_new(); // array of open Directories
-	recents = Array_new();
+	if (!recents) recents = Array_new(); // unless main already started scanning them
 
 	openDirectory(SDCARD_PATH, 0);
 	loadLast(); // restore state when available
@@ -1785,6 +2643,466 @@ void enqueueThumbTask(LoadBackgroundTask* task) {
     SDL_UnlockMutex(thumbqueueMutex);
 }
 
+///////////////////////////////////////
+
+// decoded game art, most recently used first. surfaces are already shrunk
+// to the size they're drawn at and have their corners rounded so
+// scrolling back over an entry never decodes its png again. the cache and
+// thumbbmp each hold a reference (SDL_Surface refcount), only touch those
+// with thumbCacheMutex held
+
+#define THUMB_CACHE_BYTES (24 * 1024 * 1024)
+#define THUMB_PREFETCH 2 // entries above and below the selected one
+
+typedef struct ThumbCacheItem {
+	char path[MAX_PATH];
+	time_t mtime;
+	int max_w;
+	int max_h;
+	int radius;
+	SDL_Surface* surface;
+	size_t bytes;
+} ThumbCacheItem;
+
+static Array* thumb_cache = NULL; // ThumbCacheItem
+static size_t thumb_cache_bytes = 0;
+static SDL_mutex* thumbCacheMutex = NULL;
+
+static char thumb_prefetch[THUMB_PREFETCH*2][MAX_PATH];
+static int thumb_prefetch_count = 0;
+static int thumb_prefetch_next = 0;
+static SDL_mutex* prefetchMutex = NULL;
+static SDL_cond* prefetchCond = NULL;
+
+static void ThumbCache_release(SDL_Surface* surface) {
+	SDL_LockMutex(thumbCacheMutex);
+	SDL_FreeSurface(surface);
+	SDL_UnlockMutex(thumbCacheMutex);
+}
+
+static ThumbCacheItem* ThumbCache_find(ThumbCacheItem* key) { // with thumbCacheMutex held
+	for (int i=0; i<thumb_cache->count; i++) {
+		ThumbCacheItem* item = thumb_cache->items[i];
+		if (item->mtime==key->mtime && item->max_w==key->max_w && item->max_h==key->max_h && item->radius==key->radius && exactMatch(item->path, key->path)) return item;
+	}
+	return NULL;
+}
+static SDL_Surface* ThumbCache_get(ThumbCacheItem* key) {
+	SDL_Surface* surface = NULL;
+	SDL_LockMutex(thumbCacheMutex);
+	ThumbCacheItem* item = ThumbCache_find(key);
+	if (item) {
+		Array_remove(thumb_cache, item);
+		Array_unshift(thumb_cache, item);
+		surface = item->surface;
+		surface->refcount += 1;
+	}
+	SDL_UnlockMutex(thumbCacheMutex);
+	return surface;
+}
+
+// takes a reference to surface unless the prefetcher beat us to it
+static void ThumbCache_put(ThumbCacheItem* key, SDL_Surface* surface) {
+	SDL_LockMutex(thumbCacheMutex);
+	if (ThumbCache_find(key)) {
+		SDL_UnlockMutex(thumbCacheMutex);
+		return;
+	}
+	ThumbCacheItem* item = malloc(sizeof(ThumbCacheItem));
+	*item = *key;
+	item->surface = surface;
+	item->bytes = surface->pitch * surface->h;
+	surface->refcount += 1;
+	Array_unshift(thumb_cache, item);
+	thumb_cache_bytes += item->bytes;
+	while (thumb_cache_bytes>THUMB_CACHE_BYTES && thumb_cache->count>1) {
+		ThumbCacheItem* old = Array_pop(thumb_cache);
+		thumb_cache_bytes -= old->bytes;
+		SDL_FreeSurface(old->surface); // stays alive if it's still on screen
+		free(old);
+	}
+	SDL_UnlockMutex(thumbCacheMutex);
+}
+
+// drops everything but the files on disk, the art on screen reloads with the next draw
+static void ThumbCache_flush(void) {
+	SDL_LockMutex(prefetchMutex);
+	thumb_prefetch_count = 0;
+	thumb_prefetch_next = 0;
+	SDL_UnlockMutex(prefetchMutex);
+
+	SDL_LockMutex(thumbMutex);
+	if (thumbbmp) ThumbCache_release(thumbbmp);
+	thumbbmp = NULL;
+	SDL_UnlockMutex(thumbMutex);
+
+	SDL_LockMutex(thumbCacheMutex);
+	while (thumb_cache->count) {
+		ThumbCacheItem* item = Array_pop(thumb_cache);
+		SDL_FreeSurface(item->surface);
+		free(item);
+	}
+	thumb_cache_bytes = 0;
+	SDL_UnlockMutex(thumbCacheMutex);
+}
+
+// area average, SDL_BlitScaled is nearest neighbour which shimmers when shrinking
+static SDL_Surface* Thumb_resize(SDL_Surface* src, int w, int h) {
+	SDL_Surface* dst = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_RGBA8888);
+	if (!dst) return src;
+
+	for (int y=0; y<h; y++) {
+		int y0 = y * src->h / h;
+		int y1 = (y + 1) * src->h / h;
+		if (y1<=y0) y1 = y0 + 1;
+		Uint32* out = (Uint32*)((uint8_t*)dst->pixels + y * dst->pitch);
+		for (int x=0; x<w; x++) {
+			int x0 = x * src->w / w;
+			int x1 = (x + 1) * src->w / w;
+			if (x1<=x0) x1 = x0 + 1;
+			// two channels at a time, 32 bit lanes hold any box this can be asked for
+			uint64_t lo = 0;
+			uint64_t hi = 0;
+			for (int sy=y0; sy<y1; sy++) {
+				Uint32* row = (Uint32*)((uint8_t*)src->pixels + sy * src->pitch);
+				for (int sx=x0; sx<x1; sx++) {
+					lo += ((uint64_t)(row[sx] & 0x00FF0000) << 16) | (row[sx] & 0x000000FF);
+					hi += ((uint64_t)(row[sx] & 0xFF000000) << 8) | ((row[sx] >> 8) & 0x000000FF);
+				}
+			}
+			uint64_t count = (y1 - y0) * (x1 - x0);
+			Uint32 r = ((hi >> 32) + count / 2) / count;
+			Uint32 g = ((lo >> 32) + count / 2) / count;
+			Uint32 b = ((hi & 0xFFFFFFFF) + count / 2) / count;
+			Uint32 a = ((lo & 0xFFFFFFFF) + count / 2) / count;
+			out[x] = (r << 24) | (g << 16) | (b << 8) | a;
+		}
+	}
+	SDL_FreeSurface(src);
+	return dst;
+}
+
+///////////////////////////////////////
+
+// decoded art is also kept on the sd card, already sized for the screen
+// and art width it was made for, so after the first time showing it is
+// a plain read instead of inflating the whole png. a header followed by
+// RGBA8888 rows, regenerated when the png or the box it's fit into
+// changes. nextui.elf --build-thumbs fills it for the whole library and
+// drops files whose png or rom is gone, launch.sh runs that while on the
+// charger
+
+#define THUMB_FILE_DIR SHARED_USERDATA_PATH "/.thumbs"
+#define THUMB_BOX_PATH THUMB_FILE_DIR "/box.txt" // the box nextui last drew art in
+#define THUMB_FILE_MAGIC "NXT1"
+
+typedef struct ThumbFileHeader {
+	char magic[4];
+	int32_t max_w;
+	int32_t max_h;
+	int32_t radius;
+	int64_t src_mtime;
+	int64_t src_size;
+	int32_t w;
+	int32_t h;
+} ThumbFileHeader;
+
+static int thumb_box_w = 0;
+static int thumb_box_h = 0;
+static int thumb_radius = 0;
+
+// the box art is fit into, same as drawing it
+static void Thumb_updateBox(void) {
+	thumb_box_w = (int)(screen->w * CFG_getGameArtWidth());
+	thumb_box_h = (int)(screen->h * 0.6);
+	thumb_radius = SCALE1(CFG_getThumbnailRadius());
+
+	char box[64];
+	sprintf(box, "%i %i %i", thumb_box_w, thumb_box_h, thumb_radius);
+	char saved[64] = {0};
+	if (exists(THUMB_BOX_PATH)) getFile(THUMB_BOX_PATH, saved, sizeof(saved));
+	if (!exactMatch(box, saved)) {
+		mkdir(THUMB_FILE_DIR, 0755);
+		putFile(THUMB_BOX_PATH, box);
+	}
+}
+
+static void ThumbFile_getPath(const char* path, char* file_path) {
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	for (const char* tmp=path; *tmp; tmp++) {
+		hash = (hash ^ (uint8_t)*tmp) * 1099511628211ull;
+	}
+	sprintf(file_path, "%s/%016llx.raw", THUMB_FILE_DIR, (unsigned long long)hash);
+}
+
+static int ThumbFile_readHeader(int fd, ThumbCacheItem* key, struct stat* st, ThumbFileHeader* header) {
+	if (read(fd, header, sizeof(ThumbFileHeader))!=sizeof(ThumbFileHeader)) return 0;
+	return memcmp(header->magic, THUMB_FILE_MAGIC, 4)==0
+		&& header->max_w==key->max_w && header->max_h==key->max_h && header->radius==key->radius
+		&& header->src_mtime==st->st_mtime && header->src_size==st->st_size
+		&& header->w>0 && header->h>0 && header->w<=key->max_w && header->h<=key->max_h;
+}
+
+static int ThumbFile_isCurrent(ThumbCacheItem* key, struct stat* st) {
+	char file_path[MAX_PATH];
+	ThumbFile_getPath(key->path, file_path);
+	int fd = open(file_path, O_RDONLY);
+	if (fd<0) return 0;
+	ThumbFileHeader header;
+	int current = ThumbFile_readHeader(fd, key, st, &header);
+	close(fd);
+	return current;
+}
+
+static SDL_Surface* ThumbFile_read(ThumbCacheItem* key, struct stat* st) {
+	char file_path[MAX_PATH];
+	ThumbFile_getPath(key->path, file_path);
+	int fd = open(file_path, O_RDONLY);
+	if (fd<0) return NULL;
+
+	SDL_Surface* surface = NULL;
+	ThumbFileHeader header;
+	if (ThumbFile_readHeader(fd, key, st, &header)) {
+		surface = SDL_CreateRGBSurfaceWithFormat(0, header.w, header.h, 32, SDL_PIXELFORMAT_RGBA8888);
+		size_t size = header.w * 4;
+		for (int y=0; surface && y<header.h; y++) {
+			if (read(fd, (uint8_t*)surface->pixels + y * surface->pitch, size)!=size) {
+				SDL_FreeSurface(surface);
+				surface = NULL;
+			}
+		}
+	}
+	close(fd);
+	return surface;
+}
+
+static void ThumbFile_write(ThumbCacheItem* key, struct stat* st, SDL_Surface* surface) {
+	char file_path[MAX_PATH];
+	ThumbFile_getPath(key->path, file_path);
+	char tmp_path[MAX_PATH];
+	sprintf(tmp_path, "%s.%i.%lx.tmp", file_path, getpid(), SDL_ThreadID()); // the prefetcher or a --build-thumbs run might be writing the same one
+
+	mkdir(THUMB_FILE_DIR, 0755);
+	int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd<0) return;
+
+	ThumbFileHeader header = {0};
+	memcpy(header.magic, THUMB_FILE_MAGIC, 4);
+	header.max_w = key->max_w;
+	header.max_h = key->max_h;
+	header.radius = key->radius;
+	header.src_mtime = st->st_mtime;
+	header.src_size = st->st_size;
+	header.w = surface->w;
+	header.h = surface->h;
+
+	int ok = write(fd, &header, sizeof(header))==sizeof(header);
+	size_t size = surface->w * 4;
+	for (int y=0; ok && y<surface->h; y++) {
+		ok = write(fd, (uint8_t*)surface->pixels + y * surface->pitch, size)==size;
+	}
+	if (close(fd)!=0) ok = 0;
+	if (ok) rename(tmp_path, file_path);
+	else unlink(tmp_path);
+}
+
+// full size png to art that's ready to draw
+static SDL_Surface* Thumb_decode(ThumbCacheItem* key) {
+	SDL_Surface* image = IMG_Load(key->path);
+	if (!image) return NULL;
+	SDL_Surface* surface = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA8888, 0);
+	SDL_FreeSurface(image);
+	if (!surface) return NULL;
+
+	double aspect_ratio = (double)surface->h / surface->w;
+	int new_w = key->max_w;
+	int new_h = (int)(new_w * aspect_ratio);
+	if (new_h > key->max_h) {
+		new_h = key->max_h;
+		new_w = (int)(new_h / aspect_ratio);
+	}
+	// smaller art is left for the renderer to scale up
+	if (new_w>0 && new_h>0 && (surface->w>new_w || surface->h>new_h)) {
+		surface = Thumb_resize(surface, new_w, new_h);
+	}
+
+	GFX_ApplyRoundedCorners_RGBA8888(
+		surface,
+		&(SDL_Rect){0, 0, surface->w, surface->h},
+		(float)key->radius * ((float)surface->w / (float)new_w)
+	);
+	return surface;
+}
+
+static int Thumb_makeKey(const char* path, ThumbCacheItem* key, struct stat* st) {
+	if (stat(path, st)!=0) return 0;
+	memset(key, 0, sizeof(ThumbCacheItem));
+	snprintf(key->path, sizeof(key->path), "%s", path);
+	key->mtime = st->st_mtime;
+	key->max_w = thumb_box_w;
+	key->max_h = thumb_box_h;
+	key->radius = thumb_radius;
+	return 1;
+}
+
+// returns a reference the caller releases with ThumbCache_release, NULL if there's no art
+static SDL_Surface* Thumb_load(const char* path) {
+	ThumbCacheItem key;
+	struct stat st;
+	if (!Thumb_makeKey(path, &key, &st)) return NULL;
+
+	SDL_Surface* surface = ThumbCache_get(&key);
+	if (surface) return surface;
+
+	surface = ThumbFile_read(&key, &st);
+	if (!surface) {
+		surface = Thumb_decode(&key);
+		if (!surface) return NULL;
+		ThumbFile_write(&key, &st, surface);
+	}
+	ThumbCache_put(&key, surface);
+	return surface;
+}
+
+static void getThumbPath(char* entry_path, char* thumb_path) {
+	char dir_path[MAX_PATH];
+	snprintf(dir_path, sizeof(dir_path), "%s", entry_path);
+	char* name = strrchr(dir_path, '/');
+	if (!name) {
+		thumb_path[0] = '\0';
+		return;
+	}
+	*name++ = '\0';
+	char* dot = strrchr(name, '.');
+	if (dot) *dot = '\0';
+	snprintf(thumb_path, MAX_PATH, "%s/.media/%s.png", dir_path, name);
+}
+
+// replaces whatever is still waiting, nearest entries first
+void prefetchThumbs(Directory* dir) {
+	SDL_LockMutex(prefetchMutex);
+	thumb_prefetch_count = 0;
+	thumb_prefetch_next = 0;
+	for (int distance=1; distance<=THUMB_PREFETCH; distance++) {
+		for (int sign=1; sign>=-1; sign-=2) {
+			int i = dir->selected + distance * sign;
+			if (i<0 || i>=dir->entries->count) continue;
+			Entry* entry = dir->entries->items[i];
+			if (entry->has_thumb==0) continue;
+			getThumbPath(entry->path, thumb_prefetch[thumb_prefetch_count]);
+			if (thumb_prefetch[thumb_prefetch_count][0]) thumb_prefetch_count++;
+		}
+	}
+	if (thumb_prefetch_count) SDL_CondSignal(prefetchCond);
+	SDL_UnlockMutex(prefetchMutex);
+}
+
+// names the art in path/.media is looked up by, the entry's file name
+// without its extension like the game list does, sorted
+static Array* Thumb_listNames(char* path) {
+	Array* names = Array_new();
+	DIR* dh = opendir(path);
+	if (dh) {
+		struct dirent* dp;
+		while ((dp = readdir(dh))!=NULL) {
+			if (hide(dp->d_name)) continue;
+			char* name = strdup(dp->d_name);
+			char* dot = strrchr(name, '.');
+			if (dot) *dot = '\0';
+			Array_push(names, name);
+		}
+		closedir(dh);
+	}
+	qsort(names->items, names->count, sizeof(void*), Library_sortString);
+	return names;
+}
+
+// for every .media folder under path, returns how many were (re)built. the
+// name of each art file still in use is added to live, see ThumbFile_prune
+static int Thumb_buildAll(char* path, Array* names, Array* live) {
+	int count = 0;
+	DIR* dh = opendir(path);
+	if (!dh) return count;
+
+	int is_media = suffixMatch("/.media", path);
+	Array* here = NULL; // names in path, for its own .media
+	struct dirent* dp;
+	char full_path[MAX_PATH];
+	while ((dp = readdir(dh))!=NULL) {
+		snprintf(full_path, sizeof(full_path), "%s/%s", path, dp->d_name);
+		if (is_media) {
+			if (dp->d_name[0]=='.' || !suffixMatch(".png", dp->d_name)) continue;
+
+			char name[256];
+			snprintf(name, sizeof(name), "%s", dp->d_name);
+			name[strlen(name)-4] = '\0'; // .png
+			char* key_name = name;
+			if (!bsearch(&key_name, names->items, names->count, sizeof(void*), Library_sortString)) continue; // its rom is gone
+
+			ThumbCacheItem key;
+			struct stat st;
+			if (!Thumb_makeKey(full_path, &key, &st)) continue;
+			char file_path[MAX_PATH];
+			ThumbFile_getPath(key.path, file_path);
+			Array_push(live, strdup(strrchr(file_path, '/')+1));
+
+			if (ThumbFile_isCurrent(&key, &st)) continue;
+			SDL_Surface* surface = Thumb_decode(&key);
+			if (!surface) continue;
+			ThumbFile_write(&key, &st, surface);
+			SDL_FreeSurface(surface);
+			count += 1;
+		}
+		else if (dp->d_type==DT_DIR && exactMatch(dp->d_name, ".media")) {
+			if (!here) here = Thumb_listNames(path);
+			count += Thumb_buildAll(full_path, here, live);
+		}
+		else if (dp->d_type==DT_DIR && !hide(dp->d_name)) {
+			count += Thumb_buildAll(full_path, NULL, live);
+		}
+	}
+	closedir(dh);
+	if (here) StringArray_free(here);
+	return count;
+}
+
+// deletes art files Thumb_buildAll didn't list in live, returns how many
+static int ThumbFile_prune(Array* live) {
+	int count = 0;
+	DIR* dh = opendir(THUMB_FILE_DIR);
+	if (!dh) return count;
+
+	qsort(live->items, live->count, sizeof(void*), Library_sortString);
+	struct dirent* dp;
+	char file_path[MAX_PATH];
+	while ((dp = readdir(dh))!=NULL) {
+		if (!suffixMatch(".raw", dp->d_name)) continue;
+		char* key_name = dp->d_name;
+		if (bsearch(&key_name, live->items, live->count, sizeof(void*), Library_sortString)) continue;
+		snprintf(file_path, sizeof(file_path), "%s/%s", THUMB_FILE_DIR, dp->d_name);
+		if (unlink(file_path)==0) count += 1;
+	}
+	closedir(dh);
+	return count;
+}
+
+int ThumbPrefetchWorker(void* unused) {
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+	char path[MAX_PATH];
+	while (true) {
+		SDL_LockMutex(prefetchMutex);
+		while (thumb_prefetch_next>=thumb_prefetch_count) {
+			SDL_CondWait(prefetchCond, prefetchMutex);
+		}
+		strcpy(path, thumb_prefetch[thumb_prefetch_next++]);
+		SDL_UnlockMutex(prefetchMutex);
+
+		SDL_Surface* surface = Thumb_load(path);
+		if (surface) ThumbCache_release(surface);
+	}
+	return 0;
+}
+
 // Worker threadd
 int BGLoadWorker(void* unused) {
     while (true) {
@@ -1837,15 +3155,7 @@ int ThumbLoadWorker(void* unused) {
         LoadBackgroundTask* task = node->task;
         free(node);
 
-        SDL_Surface* result = NULL;
-        if (access(task->imagePath, F_OK) == 0) {
-            SDL_Surface* image = IMG_Load(task->imagePath);
-            if (image) {
-                SDL_Surface* imageRGBA = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA8888, 0);
-                SDL_FreeSurface(image);
-                result = imageRGBA;
-            }
-        }
+        SDL_Surface* result = Thumb_load(task->imagePath);
 
         if (task->callback) {
 			task->callback(result);
@@ -1892,36 +3202,12 @@ void startLoadThumb(const char* thumbpath, BackgroundLoadedCallback callback, vo
     task->userData = userData;
     enqueueThumbTask(task);
 }
-void onThumbLoaded(SDL_Surface* surface) {
+void onThumbLoaded(SDL_Surface* surface) { // already rounded, see Thumb_load
 	SDL_LockMutex(thumbMutex);
 	thumbchanged = 1;
-	if (thumbbmp) SDL_FreeSurface(thumbbmp);
-    if (!surface) {
-		thumbbmp = NULL;
-		SDL_UnlockMutex(thumbMutex);
-		return;
-	}
-  
-		
-    thumbbmp = surface;
-	int img_w = thumbbmp->w;
-	int img_h = thumbbmp->h;
-	double aspect_ratio = (double)img_h / img_w;
-	int max_w = (int)(screen->w * CFG_getGameArtWidth()); 
-	int max_h = (int)(screen->h * 0.6);  
-	int new_w = max_w;
-	int new_h = (int)(new_w * aspect_ratio); 
-	
-	if (new_h > max_h) {
-		new_h = max_h;
-		new_w = (int)(new_h / aspect_ratio);
-	}
-	GFX_ApplyRoundedCorners_RGBA8888(
-		thumbbmp,
-		&(SDL_Rect){0, 0, thumbbmp->w, thumbbmp->h},
-		SCALE1((float)CFG_getThumbnailRadius() * ((float)img_w / (float)new_w))
-	);
-	needDraw = 1;
+	if (thumbbmp) ThumbCache_release(thumbbmp);
+	thumbbmp = surface;
+	if (surface) needDraw = 1;
 	SDL_UnlockMutex(thumbMutex);
 }
 
@@ -2078,39 +3364,141 @@ void initImageLoaderPool() {
 	animqueueCond = SDL_CreateCond();
 	frameMutex = SDL_CreateMutex();
 	flipCond = SDL_CreateCond();
+	thumbCacheMutex = SDL_CreateMutex();
+	prefetchMutex = SDL_CreateMutex();
+	prefetchCond = SDL_CreateCond();
+	thumb_cache = Array_new();
+	listingMutex = SDL_CreateMutex();
+	listingQueueCond = SDL_CreateCond();
+	listingDoneCond = SDL_CreateCond();
+	buildMutex = SDL_CreateMutex();
 
     SDL_CreateThread(BGLoadWorker, "BGLoadWorker", NULL);
     SDL_CreateThread(ThumbLoadWorker, "ThumbLoadWorker", NULL);
 	SDL_CreateThread(animWorker, "animWorker", NULL);
+	SDL_CreateThread(ListingWorker, "ListingWorker", NULL);
+	SDL_CreateThread(ThumbPrefetchWorker, "ThumbPrefetchWorker", NULL);
 }
 ///////////////////////////////////////
 
+// runs the game queueGame left in /tmp/next the way launch.sh would, but
+// without exiting. the window, gl context and input are handed over to the
+// emulator and taken back after. the directory stack and cached art are
+// freed for the emulator and rebuilt after, everything else (settings,
+// recents and the worker threads) stays as it was
+typedef struct ResidentDir {
+	char path[MAX_PATH];
+	int selected;
+	int start;
+	int end;
+} ResidentDir;
+static void Resident_run(void) {
+	char cmd[MAX_PATH * 2];
+	getFile("/tmp/next", cmd, sizeof(cmd));
+
+	int auto_cpu = useAutoCpu;
+	useAutoCpu = 0; // the emulator sets its own speed
+	Startup_wait(&wifi_thread); // uses CFG, which GFX_quit frees
+	PAD_quit();
+	GFX_quit();
+
+	// only the path and scroll position of each level survive the game
+	int depth = stack->count;
+	ResidentDir* dirs = malloc(depth * sizeof(ResidentDir));
+	for (int i=0; i<depth; i++) {
+		Directory* dir = stack->items[i];
+		snprintf(dirs[i].path, sizeof(dirs[i].path), "%s", dir->path);
+		dirs[i].selected = dir->selected;
+		dirs[i].start = dir->start;
+		dirs[i].end = dir->end;
+	}
+	DirectoryArray_free(stack);
+	stack = NULL;
+	top = NULL;
+	ThumbCache_flush();
+	malloc_trim(0);
+	PWR_setCPUSpeed(CPU_SPEED_PERFORMANCE);
+
+	play_activity_flush(); // the emulator stops what nextui started
+	LOG_info("resident: %s\n", cmd);
+	system(cmd);
+	unlink("/tmp/next");
+	Startup_begin("resume");
+
+	PLAT_resetCPUSpeed(); // the emulator moved the governor behind our back
+	PWR_setCPUSpeed(CPU_SPEED_PERFORMANCE);
+	screen = GFX_init(MODE_MAIN);
+	Thumb_updateBox();
+	PAD_init();
+	useAutoCpu = auto_cpu;
+
+	// playing reorders recently played, a cold start would show the game on top
+	stack = Array_new();
+	for (int i=0; i<depth; i++) {
+		if (exactMatch(dirs[i].path, FAUX_RECENT_PATH)) top = Directory_open(FAUX_RECENT_PATH, 0, 0, 0);
+		else top = Directory_open(dirs[i].path, dirs[i].selected, dirs[i].start, dirs[i].end);
+		if (top->selected>=top->entries->count && !top->job) { // the game may have removed files
+			top->selected = 0;
+			Directory_setWindow(top, 0, 0);
+		}
+		Array_push(stack, top);
+	}
+	free(dirs);
+	if (top->selected>=0 && top->selected<top->entries->count) {
+		readyResume(top->entries->items[top->selected]); // there may be a new auto save
+	}
+
+	// launch.sh's loop checks these after every command
+	if (exists("/tmp/poweroff") || exists("/tmp/reboot") || !exists("/tmp/nextui_exec")) quit = 1;
+}
+
+///////////////////////////////////////
+
 int main (int argc, char *argv[]) {
-	// LOG_info("time from launch to:\n");
-	// unsigned long main_begin = SDL_GetTicks();
-	// unsigned long first_draw = 0;
-	
+	Startup_begin("start");
+
+	if (argc>1 && exactMatch(argv[1], "--build-thumbs")) { // see launch.sh
+		char box[64];
+		if (!exists(THUMB_BOX_PATH)) return 0; // nextui hasn't drawn any art yet
+		getFile(THUMB_BOX_PATH, box, sizeof(box));
+		if (sscanf(box, "%i %i %i", &thumb_box_w, &thumb_box_h, &thumb_radius)!=3) return 0;
+		Array* live = Array_new();
+		LOG_info("built %i thumbnails\n", Thumb_buildAll(ROMS_PATH, NULL, live));
+		if (exists(ROMS_PATH)) LOG_info("removed %i thumbnails\n", ThumbFile_prune(live)); // never on a card that didn't mount
+		StringArray_free(live);
+		return 0;
+	}
+
 	if (autoResume()) return 0; // nothing to do
+	resident = argc>1 && exactMatch(argv[1], "--resident");
 	
 	simple_mode = exists(SIMPLE_MODE_PATH);
 
 	LOG_info("NextUI\n");
+	// reading recents is mostly waiting on the sd card, getRoot picks it up
+	recents = Array_new();
+	recents_thread = SDL_CreateThread(RecentsWorker, "RecentsWorker", NULL);
+
 	InitSettings();
+	Startup_phase("settings");
 	
 	screen = GFX_init(MODE_MAIN);
-	// LOG_info("- graphics init: %lu\n", SDL_GetTicks() - main_begin);
+	Thumb_updateBox();
+	Startup_phase("graphics");
 	
 	PAD_init();
-	// LOG_info("- input init: %lu\n", SDL_GetTicks() - main_begin);
 	VIB_init();
-	WIFI_init();
+	Startup_phase("input");
+	wifi_thread = SDL_CreateThread(WifiInitWorker, "WifiInitWorker", NULL); // needs CFG from GFX_init
 	PWR_init();
 	if (!HAS_POWER_BUTTON && !simple_mode) PWR_disableSleep();
-	// LOG_info("- power init: %lu\n", SDL_GetTicks() - main_begin);
+	Startup_phase("power");
 	
 	// start my threaded image loader :D
 	initImageLoaderPool();
+	Startup_phase("workers");
 	Menu_init();
+	Startup_phase("menu");
 	int qm_row = 0;
 	int qm_col = 0;
 	int qm_slot = 0;
@@ -2132,7 +3520,7 @@ int main (int argc, char *argv[]) {
 		lastScreen = SCREEN_GAME;
 
 	// make sure we have no running games logged as active anymore (we might be launching back into the UI here)
-	system("gametimectl.elf stop_all");
+	play_activity_queue_stop_all();
 	
 	GFX_setVsync(VSYNC_STRICT);
 
@@ -2169,6 +3557,7 @@ int main (int argc, char *argv[]) {
 		unsigned long now = SDL_GetTicks();
 		
 		PAD_poll();
+		if (Listing_poll()) dirty = 1;
 			
 		int selected = top->selected;
 		int total = top->entries->count;
@@ -2392,7 +3781,7 @@ int main (int argc, char *argv[]) {
 				}
 			}
 		
-			if (PAD_justRepeated(BTN_L1) && !PAD_isPressed(BTN_R1) && !PWR_ignoreSettingInput(BTN_L1, show_setting)) { // previous alpha
+			if (total>0 && PAD_justRepeated(BTN_L1) && !PAD_isPressed(BTN_R1) && !PWR_ignoreSettingInput(BTN_L1, show_setting)) { // previous alpha
 				Entry* entry = top->entries->items[selected];
 				int i = entry->alpha-1;
 				if (i>=0) {
@@ -2405,7 +3794,7 @@ int main (int argc, char *argv[]) {
 					}
 				}
 			}
-			else if (PAD_justRepeated(BTN_R1) && !PAD_isPressed(BTN_L1) && !PWR_ignoreSettingInput(BTN_R1, show_setting)) { // next alpha
+			else if (total>0 && PAD_justRepeated(BTN_R1) && !PAD_isPressed(BTN_L1) && !PWR_ignoreSettingInput(BTN_R1, show_setting)) { // next alpha
 				Entry* entry = top->entries->items[selected];
 				int i = entry->alpha+1;
 				if (i<top->alphas->count) {
@@ -2662,66 +4051,69 @@ int main (int argc, char *argv[]) {
 			}
 			else { // if currentscreen == SCREEN_GAMELIST
 				// background and game art file path stuff
-				Entry* entry = top->entries->items[top->selected];
-				assert(entry);
-				char tmp_path[MAX_PATH];
-				strncpy(tmp_path, entry->path, sizeof(tmp_path) - 1);
-				tmp_path[sizeof(tmp_path) - 1] = '\0';
+				if (total > 0) { // nothing is selected in an empty or still loading folder
+					Entry* entry = top->entries->items[top->selected];
+					assert(entry);
+					char tmp_path[MAX_PATH];
+					strncpy(tmp_path, entry->path, sizeof(tmp_path) - 1);
+					tmp_path[sizeof(tmp_path) - 1] = '\0';
 			
-				char* res_name = strrchr(tmp_path, '/');
-				if (res_name) res_name++;
+					char* res_name = strrchr(tmp_path, '/');
+					if (res_name) res_name++;
 
-				char path_copy[1024];
-				strncpy(path_copy, entry->path, sizeof(path_copy) - 1);
-				path_copy[sizeof(path_copy) - 1] = '\0';
+					char path_copy[1024];
+					strncpy(path_copy, entry->path, sizeof(path_copy) - 1);
+					path_copy[sizeof(path_copy) - 1] = '\0';
 		
-				char* rompath = dirname(path_copy);
+					char* rompath = dirname(path_copy);
 			
-				char res_copy[1024];
-				strncpy(res_copy, res_name, sizeof(res_copy) - 1);
-				res_copy[sizeof(res_copy) - 1] = '\0';
+					char res_copy[1024];
+					strncpy(res_copy, res_name, sizeof(res_copy) - 1);
+					res_copy[sizeof(res_copy) - 1] = '\0';
 		
-				char* dot = strrchr(res_copy, '.');
-				if (dot) *dot = '\0'; 
+					char* dot = strrchr(res_copy, '.');
+					if (dot) *dot = '\0'; 
 
-				static int lastType = -1;
+					static int lastType = -1;
 		
-				if(((entry->type == ENTRY_DIR || entry->type == ENTRY_ROM) && CFG_getRomsUseFolderBackground())) {
-					char *newBg = entry->type == ENTRY_DIR ? entry->path:rompath;
-					if((strcmp(newBg, folderBgPath) != 0 || lastType != entry->type) && sizeof(folderBgPath) != 1) {
-						lastType = entry->type;
-						char tmppath[512];
-						strncpy(folderBgPath, newBg, sizeof(folderBgPath) - 1);
-						if (entry->type == ENTRY_DIR)
-							snprintf(tmppath, sizeof(tmppath), "%s/.media/bg.png", folderBgPath);
-						else if (entry->type == ENTRY_ROM)
-							snprintf(tmppath, sizeof(tmppath), "%s/.media/bglist.png", folderBgPath);
-						if(!exists(tmppath)) {
-							snprintf(tmppath, sizeof(tmppath), SDCARD_PATH "/bg.png", folderBgPath);
+					if(((entry->type == ENTRY_DIR || entry->type == ENTRY_ROM) && CFG_getRomsUseFolderBackground())) {
+						char *newBg = entry->type == ENTRY_DIR ? entry->path:rompath;
+						if((strcmp(newBg, folderBgPath) != 0 || lastType != entry->type) && sizeof(folderBgPath) != 1) {
+							lastType = entry->type;
+							char tmppath[512];
+							strncpy(folderBgPath, newBg, sizeof(folderBgPath) - 1);
+							if (entry->type == ENTRY_DIR)
+								snprintf(tmppath, sizeof(tmppath), "%s/.media/bg.png", folderBgPath);
+							else if (entry->type == ENTRY_ROM)
+								snprintf(tmppath, sizeof(tmppath), "%s/.media/bglist.png", folderBgPath);
+							if(!exists(tmppath)) {
+								snprintf(tmppath, sizeof(tmppath), SDCARD_PATH "/bg.png", folderBgPath);
+							}
+							startLoadFolderBackground(tmppath, onBackgroundLoaded, NULL);
 						}
-						startLoadFolderBackground(tmppath, onBackgroundLoaded, NULL);
+					} 
+					else if(strcmp(SDCARD_PATH "/bg.png", folderBgPath) != 0) {
+						strncpy(folderBgPath, SDCARD_PATH "/bg.png", sizeof(folderBgPath) - 1);
+						startLoadFolderBackground(SDCARD_PATH "/bg.png", onBackgroundLoaded, NULL);
 					}
-				} 
-				else if(strcmp(SDCARD_PATH "/bg.png", folderBgPath) != 0) {
-					strncpy(folderBgPath, SDCARD_PATH "/bg.png", sizeof(folderBgPath) - 1);
-					startLoadFolderBackground(SDCARD_PATH "/bg.png", onBackgroundLoaded, NULL);
-				}
-				// load game thumbnails
-				if (total > 0) {
-					if(CFG_getShowGameArt()) {
-						char thumbpath[1024];
-						snprintf(thumbpath, sizeof(thumbpath), "%s/.media/%s.png", rompath, res_copy);
-						had_thumb = 0;
-						startLoadThumb(thumbpath, onThumbLoaded, NULL);
-						int max_w = (int)(screen->w - (screen->w * CFG_getGameArtWidth())); 
-						int max_h = (int)(screen->h * 0.6);  
-						int new_w = max_w;
-						int new_h = max_h; 
-						had_thumb = 1;
-						if(exists(thumbpath))
-							ox = (int)(max_w) - SCALE1(BUTTON_MARGIN*5);
-						else
-							ox = screen->w;
+					// load game thumbnails
+					if (total > 0) {
+						if(CFG_getShowGameArt()) {
+							char thumbpath[1024];
+							snprintf(thumbpath, sizeof(thumbpath), "%s/.media/%s.png", rompath, res_copy);
+							had_thumb = 0;
+							startLoadThumb(thumbpath, onThumbLoaded, NULL);
+							prefetchThumbs(top);
+							int max_w = (int)(screen->w - (screen->w * CFG_getGameArtWidth())); 
+							int max_h = (int)(screen->h * 0.6);  
+							int new_w = max_w;
+							int new_h = max_h; 
+							had_thumb = 1;
+							if(entry->has_thumb>=0 ? entry->has_thumb : exists(thumbpath))
+								ox = (int)(max_w) - SCALE1(BUTTON_MARGIN*5);
+							else
+								ox = screen->w;
+						}
 					}
 				}
 
@@ -2831,7 +4223,7 @@ int main (int argc, char *argv[]) {
 				}
 				else {
 					// TODO: for some reason screen's dimensions end up being 0x0 in GFX_blitMessage...
-					GFX_blitMessage(font.large, "Empty folder", screen, &(SDL_Rect){0,0,screen->w,screen->h}); //, NULL);
+					GFX_blitMessage(font.large, top->job ? "Loading..." : "Empty folder", screen, &(SDL_Rect){0,0,screen->w,screen->h}); //, NULL);
 				}
 				
 				lastScreen = SCREEN_GAMELIST;
@@ -2909,8 +4301,10 @@ int main (int argc, char *argv[]) {
 				// GFX_drawOnLayer(globalText, SCALE1(PADDING+BUTTON_PADDING), pilltargetTextY, globalText->w, globalText->h, 1.0f, 0, LAYER_SCROLLTEXT);
 				SDL_UnlockMutex(animMutex);
 			}
-			if(!startgame) // dont flip if game gonna start
+			if(!startgame) { // dont flip if game gonna start
 				GFX_flip(screen);
+				Startup_firstFrame(); // only once something was presented
+			}
 
 			dirty = 0;
 		} else if(animationDraw || folderbgchanged || thumbchanged || is_scrolling) {
@@ -3056,12 +4450,41 @@ int main (int argc, char *argv[]) {
 			sleep(4);
 			quit = 1;
 		}
+
+		if (suspend && !quit) {
+			suspend = 0;
+			Resident_run();
+			Startup_phase("restore");
+
+			// same as coming back from launch.sh
+			startgame = 0;
+			lastScreen = SCREEN_OFF;
+			currentScreen = CFG_getDefaultView();
+			if (exists(GAME_SWITCHER_PERSIST_PATH)) {
+				unlink(GAME_SWITCHER_PERSIST_PATH);
+				currentScreen = SCREEN_GAMESWITCHER;
+				lastScreen = SCREEN_GAME;
+			}
+			play_activity_queue_stop_all();
+
+			GFX_setVsync(VSYNC_STRICT);
+			PAD_reset();
+			GFX_clearLayers(LAYER_ALL);
+			GFX_clear(screen);
+			folderbgchanged = 1;
+			thumbchanged = 1;
+			dirty = 1;
+		}
 	}
 	if(blackBG)	SDL_FreeSurface(blackBG);
 	if (folderbgbmp) SDL_FreeSurface(folderbgbmp);
-	if (thumbbmp) SDL_FreeSurface(thumbbmp);
+	if (thumbbmp) ThumbCache_release(thumbbmp);
 
+	Startup_wait(&wifi_thread);
+	play_activity_flush(); // the game launched next reads and writes it too
 	Menu_quit();
+	Listing_quit();
+	Library_quit();
 	PWR_quit();
 	PAD_quit();
 	GFX_quit();
@@ -0,0 +1,29 @@
+// compiles every shader in Shaders/glsl into the binary cache minarch loads
+// programs from, so switching presets in the in-game menu never waits on the
+// compiler. binaries left over from edited shaders or an older driver are
+// removed. run it after adding shaders or updating, outside of a game
+//
+//	shaderwarm
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "api.h"
+#include "utils.h"
+
+int main(int argc, char* argv[]) {
+	if (argc > 1) {
+		printf("usage: shaderwarm\n");
+		return EXIT_FAILURE;
+	}
+
+	uint64_t start = getMicroseconds();
+	PLAT_initVideo();
+	PLAT_initShaders();
+	int count = PLAT_warmShaderCache();
+	PLAT_quitVideo();
+
+	printf("%i shaders cached in %.1fs\n", count, (getMicroseconds() - start) / 1000000.0);
+	return count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1655,7 +1655,7 @@ void PLAT_flip(SDL_Surface* IGNORED, int ignored) {
         SDL_RenderPresent(vid.renderer);
         return;
     }
-    SDL_UpdateTexture(vid.stream_layer1, NULL, vid.blit->src, vid.blit->src_p);
+    if (vid.blit->src) SDL_UpdateTexture(vid.stream_layer1, NULL, vid.blit->src, vid.blit->src_p);
 
     SDL_Texture* target = vid.stream_layer1;
     int x = vid.blit->src_x;
@@ -1899,7 +1899,7 @@ void PLAT_GL_Swap() {
     SDL_Rect dst_rect = {0, 0, device_width, device_height};
     setRectToAspectRatio(&dst_rect);
 
-    if (!vid.blit->src) {
+    if (!vid.blit->src && !vid.blit->src_dupe) {
         return;
     }
 
@@ -1954,7 +1954,7 @@ void PLAT_GL_Swap() {
     }
 	
     static GLuint src_texture = 0;
-    static int src_w_last = 0, src_h_last = 0;
+    static int src_w_last = 0, src_h_last = 0, src_fmt_last = -1;
     static int last_w = 0, last_h = 0;
 
     if (!src_texture || reloadShaderTextures) {
@@ -1972,14 +1972,34 @@ void PLAT_GL_Swap() {
     }
 
     glBindTexture(GL_TEXTURE_2D, src_texture);
-    if (vid.blit->src_w != src_w_last || vid.blit->src_h != src_h_last || reloadShaderTextures) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, vid.blit->src_w, vid.blit->src_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid.blit->src);
+
+    // RGB565 frames are uploaded as-is, the GPU does the expansion for free
+    GLenum src_format = GL_RGBA;
+    GLenum src_type = GL_UNSIGNED_BYTE;
+    int src_bpp = 4;
+    if (vid.blit->src_fmt == RENDERER_SRC_RGB565) {
+        src_format = GL_RGB;
+        src_type = GL_UNSIGNED_SHORT_5_6_5;
+        src_bpp = 2;
+    }
+    // honour the source pitch so cores with padded lines don't need a repack
+    if (vid.blit->src_p) glPixelStorei(GL_UNPACK_ROW_LENGTH, vid.blit->src_p / src_bpp);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, src_bpp);
+
+    if (!vid.blit->src) {
+        // a dupe frame, the texture still holds the last one
+    } else if (vid.blit->src_w != src_w_last || vid.blit->src_h != src_h_last || vid.blit->src_fmt != src_fmt_last || reloadShaderTextures) {
+        glTexImage2D(GL_TEXTURE_2D, 0, src_format, vid.blit->src_w, vid.blit->src_h, 0, src_format, src_type, vid.blit->src);
         src_w_last = vid.blit->src_w;
         src_h_last = vid.blit->src_h;
+        src_fmt_last = vid.blit->src_fmt;
     } else {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid.blit->src_w, vid.blit->src_h, GL_RGBA, GL_UNSIGNED_BYTE, vid.blit->src);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid.blit->src_w, vid.blit->src_h, src_format, src_type, vid.blit->src);
     }
 
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
     if (nrofshaders < 1) {
         runShaderPass(src_texture, g_shader_default, NULL, dst_rect.x, dst_rect.y,
             dst_rect.w, dst_rect.h,
@@ -20,6 +20,7 @@
 
 #include "scaler.h"
 #include <time.h>
+#include <math.h>
 #include <pthread.h>
 
 #include <dirent.h>
@@ -41,16 +42,7 @@ typedef struct Shader {
 	int srctype;
 	int scaletype;
 	char *filename;
-	GLuint texture;
 	int updated;
-	GLint u_FrameDirection;
-	GLint u_FrameCount;
-	GLint u_OutputSize;
-	GLint u_TextureSize;
-	GLint u_InputSize;
-	GLint OrigInputSize;
-	GLint texLocation;
-	GLint texelSizeLocation;
 	ShaderParam *pragmas;  // Dynamic array of parsed pragma parameters
 	int num_pragmas;       // Count of valid pragma parameters
 
@@ -61,12 +53,264 @@ GLuint g_shader_overlay = 0;
 GLuint g_noshader = 0;
 
 Shader* shaders[MAXSHADERS] = {
-    &(Shader){ .shader_p = 0, .scale = 1, .filter = GL_LINEAR, .scaletype = 1, .srctype = 0, .filename ="stock.glsl", .texture = 0, .updated = 1 },
-    &(Shader){ .shader_p = 0, .scale = 1, .filter = GL_LINEAR, .scaletype = 1, .srctype = 0, .filename ="stock.glsl", .texture = 0, .updated = 1 },
-    &(Shader){ .shader_p = 0, .scale = 1, .filter = GL_LINEAR, .scaletype = 1, .srctype = 0, .filename ="stock.glsl", .texture = 0, .updated = 1 },
+    &(Shader){ .shader_p = 0, .scale = 1, .filter = GL_LINEAR, .scaletype = 1, .srctype = 0, .filename ="stock.glsl", .updated = 1 },
+    &(Shader){ .shader_p = 0, .scale = 1, .filter = GL_LINEAR, .scaletype = 1, .srctype = 0, .filename ="stock.glsl", .updated = 1 },
+    &(Shader){ .shader_p = 0, .scale = 1, .filter = GL_LINEAR, .scaletype = 1, .srctype = 0, .filename ="stock.glsl", .updated = 1 },
 };
 
 static int nrofshaders = 0; // choose between 1 and 3 pipelines, > pipelines = more cpu usage, but more shader options and shader upscaling stuff
+
+///////////////////////////////
+
+// tracks the GL state the shader pipeline cares about so binds, switches and
+// uniform uploads only reach the driver when something actually changed. every
+// program gets its own VAO with the attributes bound once, its uniform
+// locations looked up once and the last values it was given. anything in this
+// file touching the same state has to go through here or the cache goes stale
+
+#define MAX_SHADER_PRAGMAS 32
+#define MAX_PROGRAMS 8
+#define GL_UNKNOWN ((GLuint)-1)
+
+// counts towards the debug overlay's gl calls per frame
+#define GL_CALL(call) (gl.calls++, call)
+
+typedef struct ProgramState {
+	GLuint program; // 0 if the slot is free
+	GLuint vao;
+	GLint u_FrameDirection;
+	GLint u_FrameCount;
+	GLint u_OutputSize;
+	GLint u_TextureSize;
+	GLint u_InputSize;
+	GLint OrigInputSize;
+	GLint texLocation;
+	GLint texelSizeLocation;
+
+	// last uploaded values, -1 or NAN until the first upload
+	int frame_direction;
+	int frame_count;
+	int texture_unit;
+	GLfloat output_size[2];
+	GLfloat texture_size[2];
+	GLfloat input_size[2];
+	GLfloat orig_input_size[2];
+	GLfloat texel_size[2];
+	GLfloat pragmas[MAX_SHADER_PRAGMAS];
+} ProgramState;
+
+static struct GL_State {
+	ProgramState programs[MAX_PROGRAMS];
+	int evict; // next slot to reuse when they're all taken
+	ProgramState* current;
+	GLuint program;
+	GLuint vao;
+	GLuint vbo;
+	GLuint fbo;
+	GLuint texture;
+	int blend;
+	GLint viewport[4];
+	int calls;
+} gl = {
+	.program = GL_UNKNOWN,
+	.vao = GL_UNKNOWN,
+	.fbo = GL_UNKNOWN,
+	.texture = GL_UNKNOWN,
+	.blend = -1,
+	.viewport = {-1,-1,-1,-1},
+};
+
+static void GL_bindVertexArray(GLuint vao) {
+	if (vao == gl.vao) return;
+	GL_CALL(glBindVertexArray(vao));
+	gl.vao = vao;
+}
+
+// the fullscreen quad every pass draws, shared by all the VAOs
+static GLuint GL_getQuad(void) {
+	if (!gl.vbo) {
+		float vertices[] = {
+			// x,    y,    z,    w,     u,    v,    s,    t
+			-1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 0.0f, 0.0f,  // top-left
+			-1.0f, -1.0f, 0.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f,  // bottom-left
+			1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 0.0f, 0.0f,  // top-right
+			1.0f, -1.0f, 0.0f, 1.0f,  1.0f, 0.0f, 0.0f, 0.0f,  // bottom-right
+
+			// upside down, for a preset pass drawing straight to the screen
+			// where defaultv2.glsl would otherwise have done the flip
+			-1.0f, -1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 0.0f, 0.0f,
+			-1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f,
+			1.0f, -1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 0.0f, 0.0f,
+			1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 0.0f, 0.0f, 0.0f
+		};
+		glGenBuffers(1, &gl.vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, gl.vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	}
+	return gl.vbo;
+}
+
+static void GL_forgetProgramState(ProgramState* ps) {
+	if (!ps->program) return;
+	if (gl.vao == ps->vao) GL_bindVertexArray(0);
+	glDeleteVertexArrays(1, &ps->vao);
+	if (gl.current == ps) gl.current = NULL;
+	memset(ps, 0, sizeof(ProgramState));
+}
+
+// call before deleting a program, GL hands the name out again
+static void GL_forgetProgram(GLuint program) {
+	for (int i=0; i<MAX_PROGRAMS; i++) {
+		if (gl.programs[i].program == program) GL_forgetProgramState(&gl.programs[i]);
+	}
+	if (gl.program == program) gl.program = GL_UNKNOWN;
+}
+
+static ProgramState* GL_useProgram(GLuint program) {
+	if (program == gl.program && gl.current) return gl.current;
+
+	ProgramState* ps = NULL;
+	for (int i=0; i<MAX_PROGRAMS && !ps; i++) {
+		if (gl.programs[i].program == program) ps = &gl.programs[i];
+	}
+	if (program != gl.program) {
+		GL_CALL(glUseProgram(program));
+		gl.program = program;
+	}
+
+	if (!ps) {
+		for (int i=0; i<MAX_PROGRAMS && !ps; i++) {
+			if (!gl.programs[i].program) ps = &gl.programs[i];
+		}
+		if (!ps) {
+			ps = &gl.programs[gl.evict];
+			gl.evict = (gl.evict + 1) % MAX_PROGRAMS;
+			GL_forgetProgramState(ps);
+		}
+
+		ps->program = program;
+		glGenVertexArrays(1, &ps->vao);
+		GL_bindVertexArray(ps->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, GL_getQuad());
+		GLint posAttrib = glGetAttribLocation(program, "VertexCoord");
+		if (posAttrib >= 0) {
+			glVertexAttribPointer(posAttrib, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(posAttrib);
+		}
+		GLint texAttrib = glGetAttribLocation(program, "TexCoord");
+		if (texAttrib >= 0) {
+			glVertexAttribPointer(texAttrib,  4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(4 * sizeof(float)));
+			glEnableVertexAttribArray(texAttrib);
+		}
+
+		ps->u_FrameDirection = glGetUniformLocation(program, "FrameDirection");
+		ps->u_FrameCount = glGetUniformLocation(program, "FrameCount");
+		ps->u_OutputSize = glGetUniformLocation(program, "OutputSize");
+		ps->u_TextureSize = glGetUniformLocation(program, "TextureSize");
+		ps->u_InputSize = glGetUniformLocation(program, "InputSize");
+		ps->OrigInputSize = glGetUniformLocation(program, "OrigInputSize");
+		ps->texLocation = glGetUniformLocation(program, "Texture");
+		ps->texelSizeLocation = glGetUniformLocation(program, "texelSize");
+
+		ps->frame_direction = -1;
+		ps->frame_count = -1;
+		ps->texture_unit = -1;
+		for (int i=0; i<2; i++) {
+			ps->output_size[i] = NAN;
+			ps->texture_size[i] = NAN;
+			ps->input_size[i] = NAN;
+			ps->orig_input_size[i] = NAN;
+			ps->texel_size[i] = NAN;
+		}
+		for (int i=0; i<MAX_SHADER_PRAGMAS; i++) {
+			ps->pragmas[i] = NAN;
+		}
+
+		// never changes so it only goes up once
+		GLint u_MVP = glGetUniformLocation(program, "MVPMatrix");
+		if (u_MVP >= 0) {
+			float identity[16] = {
+				1,0,0,0,
+				0,1,0,0,
+				0,0,1,0,
+				0,0,0,1
+			};
+			glUniformMatrix4fv(u_MVP, 1, GL_FALSE, identity);
+		}
+	}
+
+	GL_bindVertexArray(ps->vao);
+	gl.current = ps;
+	return ps;
+}
+
+static void GL_uniform1i(GLint location, int* last, int value) {
+	if (location < 0 || *last == value) return;
+	GL_CALL(glUniform1i(location, value));
+	*last = value;
+}
+static void GL_uniform2f(GLint location, GLfloat* last, GLfloat x, GLfloat y) {
+	if (location < 0 || (last[0] == x && last[1] == y)) return;
+	GL_CALL(glUniform2f(location, x, y));
+	last[0] = x;
+	last[1] = y;
+}
+
+static void GL_bindFramebuffer(GLuint fbo) {
+	if (fbo == gl.fbo) return;
+	GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+	gl.fbo = fbo;
+}
+
+// unit 0 is the only one in use
+static void GL_bindTexture(GLuint texture) {
+	if (texture == gl.texture) return;
+	GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+	gl.texture = texture;
+}
+
+static void GL_setBlend(int blend) {
+	if (blend == gl.blend) return;
+	if (blend) {
+		GL_CALL(glEnable(GL_BLEND));
+		GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+	}
+	else {
+		GL_CALL(glDisable(GL_BLEND));
+	}
+	gl.blend = blend;
+}
+
+static void GL_viewport(GLint x, GLint y, GLint w, GLint h) {
+	if (gl.viewport[0] == x && gl.viewport[1] == y && gl.viewport[2] == w && gl.viewport[3] == h) return;
+	GL_CALL(glViewport(x, y, w, h));
+	gl.viewport[0] = x;
+	gl.viewport[1] = y;
+	gl.viewport[2] = w;
+	gl.viewport[3] = h;
+}
+
+// called once per swap, reports and resets the count
+static void GL_endFrame(void) {
+	currentglcalls = gl.calls;
+	gl.calls = 0;
+}
+
+// everything goes with the context, a new one starts from GL's defaults but
+// assume nothing
+static void GL_quitState(void) {
+	for (int i=0; i<MAX_PROGRAMS; i++) {
+		GL_forgetProgramState(&gl.programs[i]);
+	}
+	if (gl.vbo) glDeleteBuffers(1, &gl.vbo);
+	memset(&gl, 0, sizeof(gl));
+	gl.program = GL_UNKNOWN;
+	gl.vao = GL_UNKNOWN;
+	gl.fbo = GL_UNKNOWN;
+	gl.texture = GL_UNKNOWN;
+	gl.blend = -1;
+	for (int i=0; i<4; i++) gl.viewport[i] = -1;
+}
 ///////////////////////////////
 
 int is_brick = 0;
@@ -155,76 +399,6 @@ int extractPragmaParameters(const char *shaderSource, ShaderParam *params, int m
     return paramCount; // number of parameters found
 }
 
-GLuint link_program(GLuint vertex_shader, GLuint fragment_shader, const char* cache_key) {
-    char cache_path[512];
-    snprintf(cache_path, sizeof(cache_path), "/mnt/SDCARD/.shadercache/%s.bin", cache_key);
-
-    GLuint program = glCreateProgram();
-    GLint success;
-
-    // Try to load cached binary first
-    FILE *f = fopen(cache_path, "rb");
-    if (f) {
-        GLint binaryFormat;
-        fread(&binaryFormat, sizeof(GLint), 1, f);
-        fseek(f, 0, SEEK_END);
-        size_t length = ftell(f) - sizeof(GLint);
-        fseek(f, sizeof(GLint), SEEK_SET);
-        void *binary = malloc(length);
-        fread(binary, 1, length, f);
-        fclose(f);
-
-        glProgramBinary(program, binaryFormat, binary, length);
-        free(binary);
-
-        glGetProgramiv(program, GL_LINK_STATUS, &success);
-        if (success) {
-            LOG_info("Loaded shader program from cache: %s\n", cache_key);
-            return program;
-        } else {
-            LOG_info("Cache load failed, falling back to compile.\n");
-            glDeleteProgram(program);
-            program = glCreateProgram();
-        }
-    }
-
-    // Compile and link if cache failed
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
-    glLinkProgram(program);
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-
-    if (!success) {
-        GLint logLength;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
-        char* log = (char*)malloc(logLength);
-        glGetProgramInfoLog(program, logLength, &logLength, log);
-        printf("Program link error: %s\n", log);
-        free(log);
-        return program;
-    }
-
-    GLint binaryLength;
-    GLenum binaryFormat;
-    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
-    void* binary = malloc(binaryLength);
-    glGetProgramBinary(program, binaryLength, NULL, &binaryFormat, binary);
-
-    mkdir("/mnt/SDCARD/.shadercache", 0755); 
-    f = fopen(cache_path, "wb");
-    if (f) {
-        fwrite(&binaryFormat, sizeof(GLenum), 1, f);
-        fwrite(binary, 1, binaryLength, f);
-        fclose(f);
-        LOG_info("Saved shader program to cache: %s\n", cache_key);
-    }
-    free(binary);
-
-    LOG_info("Program linked and cached\n");
-    return program;
-}
-
 char* load_shader_source(const char* filename) {
 	char filepath[256];
 	snprintf(filepath, sizeof(filepath), "%s", filename);
@@ -251,11 +425,13 @@ char* load_shader_source(const char* filename) {
     return source;
 }
 
-GLuint load_shader_from_file(GLenum type, const char* filename, const char* path) {
+// the source as it's handed to the compiler, with the version fixed up and the
+// stage and precision defines added. NULL if the file can't be read
+char* build_shader_source(GLenum type, const char* filename, const char* path) {
     char filepath[256];
     snprintf(filepath, sizeof(filepath), "%s/%s", path, filename);
     char* source = load_shader_source(filepath);
-    if (!source) return 0;
+    if (!source) return NULL;
 
     LOG_info("load shader from file %s\n", filepath);
 
@@ -264,17 +440,19 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
     if (!cleaned) {
         fprintf(stderr, "Out of memory\n");
         free(source);
-        return 0;
+        return NULL;
     }
     cleaned[0] = '\0';
 
-    char* line = strtok(source, "\n");
+    // also runs on the compile thread
+    char* saveptr = NULL;
+    char* line = strtok_r(source, "\n", &saveptr);
     while (line) {
         if (strncmp(line, "#pragma parameter", 17) != 0) {
             strcat(cleaned, line);
             strcat(cleaned, "\n");
         }
-        line = strtok(NULL, "\n");
+        line = strtok_r(NULL, "\n", &saveptr);
     }
 
     const char* define = NULL;
@@ -296,7 +474,7 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
         fprintf(stderr, "Unsupported shader type\n");
         free(source);
         free(cleaned);
-        return 0;
+        return NULL;
     }
 
     const char* version_start = strstr(cleaned, "#version");
@@ -347,7 +525,7 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
             fprintf(stderr, "Out of memory\n");
             free(source);
             free(cleaned);
-            return 0;
+            return NULL;
         }
 
         strcpy(combined, replacement_version);
@@ -362,7 +540,7 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
             fprintf(stderr, "Out of memory\n");
             free(source);
             free(cleaned);
-            return 0;
+            return NULL;
         }
 
         memcpy(combined, cleaned, header_len);
@@ -378,7 +556,7 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
             fprintf(stderr, "Out of memory\n");
             free(source);
             free(cleaned);
-            return 0;
+            return NULL;
         }
 
         strcpy(combined, fallback_version);
@@ -387,14 +565,15 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
         strcat(combined, cleaned);
     }
 
-    GLuint shader = glCreateShader(type);
-    const char* combined_ptr = combined;
-    glShaderSource(shader, 1, &combined_ptr, NULL);
-    glCompileShader(shader);
-
     free(source);
     free(cleaned);
-    free(combined);
+    return combined;
+}
+
+GLuint compile_shader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
 
     GLint compiled;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
@@ -409,26 +588,363 @@ GLuint load_shader_from_file(GLenum type, const char* filename, const char* path
     return shader;
 }
 
+///////////////////////////////
+
+// linked programs are cached as driver binaries named after a hash of both
+// final sources and the driver strings, so an edited shader or a new driver
+// misses instead of loading a stale binary. a hit skips compiling entirely
+
+#define SHADERCACHE_FOLDER SDCARD_PATH "/.shadercache"
+
+static char shader_driver[256]; // vendor, renderer and version, set in PLAT_initShaders
+
+// FNV-1a
+static uint64_t hashShaderString(uint64_t hash, const char* str) {
+	while (*str) hash = (hash ^ (uint8_t)*str++) * 1099511628211ull;
+	return hash;
+}
+
+static int loadProgramBinary(GLuint program, const char* cache_path) {
+	FILE *f = fopen(cache_path, "rb");
+	if (!f) return 0;
+
+	GLenum binaryFormat;
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f) - (long)sizeof(GLenum);
+	fseek(f, 0, SEEK_SET);
+	if (length<=0 || fread(&binaryFormat, sizeof(GLenum), 1, f)!=1) {
+		fclose(f);
+		return 0;
+	}
+	void *binary = malloc(length);
+	size_t read = fread(binary, 1, length, f);
+	fclose(f);
+
+	GLint success = 0;
+	if (read==(size_t)length) {
+		glProgramBinary(program, binaryFormat, binary, length);
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+	}
+	free(binary);
+	return success;
+}
+
+static void saveProgramBinary(GLuint program, const char* cache_path) {
+	GLint binaryLength = 0;
+	GLenum binaryFormat;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength<=0) return;
+	void* binary = malloc(binaryLength);
+	glGetProgramBinary(program, binaryLength, NULL, &binaryFormat, binary);
+
+	// written aside and renamed so a power cut never leaves half a binary
+	char tmp_path[MAX_PATH];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+	mkdir(SHADERCACHE_FOLDER, 0755);
+	FILE* f = fopen(tmp_path, "wb");
+	if (f) {
+		int ok = fwrite(&binaryFormat, sizeof(GLenum), 1, f)==1 && fwrite(binary, 1, binaryLength, f)==(size_t)binaryLength;
+		if (fclose(f)==0 && ok && rename(tmp_path, cache_path)==0) LOG_info("Saved shader program to cache: %s\n", cache_path);
+		else unlink(tmp_path);
+	}
+	free(binary);
+}
+
+// compiles and links filename from path, or loads it from the cache. cache_path
+// gets the binary it used if not NULL. 0 if it doesn't build
+GLuint load_program(const char* filename, const char* path, char* cache_path) {
+	char* vertex_source = build_shader_source(GL_VERTEX_SHADER, filename, path);
+	char* fragment_source = build_shader_source(GL_FRAGMENT_SHADER, filename, path);
+	if (!vertex_source || !fragment_source) {
+		free(vertex_source);
+		free(fragment_source);
+		return 0;
+	}
+
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashShaderString(hash, shader_driver);
+	hash = hashShaderString(hash, vertex_source);
+	hash = hashShaderString(hash, fragment_source);
+	char path_buffer[MAX_PATH];
+	if (!cache_path) cache_path = path_buffer;
+	snprintf(cache_path, MAX_PATH, SHADERCACHE_FOLDER "/%s-%016llx.bin", filename, (unsigned long long)hash);
+
+	GLuint program = glCreateProgram();
+	if (loadProgramBinary(program, cache_path)) {
+		LOG_info("Loaded shader program from cache: %s\n", cache_path);
+		free(vertex_source);
+		free(fragment_source);
+		return program;
+	}
+
+	GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source);
+	GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+	free(vertex_source);
+	free(fragment_source);
+	if (!vertex_shader || !fragment_shader) {
+		if (vertex_shader) glDeleteShader(vertex_shader);
+		if (fragment_shader) glDeleteShader(fragment_shader);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	glDetachShader(program, vertex_shader);
+	glDetachShader(program, fragment_shader);
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		char log[512];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		LOG_info("Program link error %s: %s\n", filename, log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	saveProgramBinary(program, cache_path);
+	LOG_info("Program linked and cached\n");
+	return program;
+}
+
+///////////////////////////////
+
+// presets compile on a thread with its own context sharing objects with
+// vid.gl_context, the shader's old program keeps drawing until the new one is
+// linked and picked up by PLAT_GL_Swap. if the driver won't make a context
+// current without a surface they compile in place like they used to
+
+typedef struct ShaderJob {
+	char filename[256]; // empty if there's no job
+	int generation;
+	GLuint program;
+} ShaderJob;
+
+static struct ShaderCompiler {
+	SDL_Thread* thread;
+	SDL_GLContext context;
+	SDL_mutex* lock;
+	SDL_cond* wake;
+	SDL_sem* started;
+	int running;
+	int quit;
+	ShaderJob pending[MAXSHADERS]; // a newer request for a shader replaces the queued one
+	ShaderJob done[MAXSHADERS];
+	int generation[MAXSHADERS]; // latest request per shader, only touched on the render thread
+} compiler;
+
+static void installShaderProgram(Shader* shader, GLuint program) {
+	if (shader->shader_p != 0) {
+		LOG_info("Deleting previous shader %i\n",shader->shader_p);
+		GL_forgetProgram(shader->shader_p);
+		glDeleteProgram(shader->shader_p);
+	}
+	shader->shader_p = program;
+
+	for (int i = 0; i < shader->num_pragmas; ++i) {
+		shader->pragmas[i].uniformLocation = program ? glGetUniformLocation(program, shader->pragmas[i].name) : -1;
+	}
+
+	if (program == 0) LOG_info("Shader linking failed for %s\n", shader->filename);
+	else LOG_info("Shader Program Linking Success %s shader ID is %i\n", shader->filename, program);
+	shader->updated = 1;
+}
+
+static int shaderCompileThread(void* data) {
+	compiler.running = SDL_GL_MakeCurrent(NULL, compiler.context)==0;
+	if (!compiler.running) LOG_info("shader compile thread has no context (%s), compiling in place\n", SDL_GetError());
+	SDL_SemPost(compiler.started);
+	if (!compiler.running) return 0;
+
+	SDL_LockMutex(compiler.lock);
+	while (!compiler.quit) {
+		int i = 0;
+		while (i<MAXSHADERS && !compiler.pending[i].filename[0]) i++;
+		if (i==MAXSHADERS) {
+			SDL_CondWait(compiler.wake, compiler.lock);
+			continue;
+		}
+		ShaderJob job = compiler.pending[i];
+		compiler.pending[i].filename[0] = '\0';
+		SDL_UnlockMutex(compiler.lock);
+
+		uint64_t start = getMicroseconds();
+		job.program = load_program(job.filename, SHADERS_FOLDER "/glsl", NULL);
+		glFinish(); // complete before the render context touches it
+		LOG_info("compiled %s in %.1fms\n", job.filename, (getMicroseconds() - start) / 1000.0);
+
+		SDL_LockMutex(compiler.lock);
+		if (compiler.done[i].filename[0] && compiler.done[i].program) glDeleteProgram(compiler.done[i].program);
+		compiler.done[i] = job;
+	}
+	SDL_UnlockMutex(compiler.lock);
+
+	SDL_GL_MakeCurrent(NULL, NULL);
+	return 0;
+}
+
+static void startShaderCompiler(void) {
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	compiler.context = SDL_GL_CreateContext(vid.window);
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+	SDL_GL_MakeCurrent(vid.window, vid.gl_context); // creating it made it current
+	if (!compiler.context) {
+		LOG_info("no shared context for compiling shaders: %s\n", SDL_GetError());
+		return;
+	}
+
+	compiler.lock = SDL_CreateMutex();
+	compiler.wake = SDL_CreateCond();
+	compiler.started = SDL_CreateSemaphore(0);
+	compiler.thread = SDL_CreateThread(shaderCompileThread, "ShaderCompileThread", NULL);
+	if (compiler.thread) SDL_SemWait(compiler.started);
+	if (!compiler.running) {
+		if (compiler.thread) SDL_WaitThread(compiler.thread, NULL);
+		compiler.thread = NULL;
+		SDL_GL_DeleteContext(compiler.context);
+		compiler.context = NULL;
+	}
+}
+
+static void queueShaderProgram(int i, const char* filename) {
+	compiler.generation[i]++;
+	if (!compiler.running) {
+		installShaderProgram(shaders[i], load_program(filename, SHADERS_FOLDER "/glsl", NULL));
+		return;
+	}
+
+	SDL_LockMutex(compiler.lock);
+	ShaderJob* job = &compiler.pending[i];
+	snprintf(job->filename, sizeof(job->filename), "%s", filename);
+	job->generation = compiler.generation[i];
+	job->program = 0;
+	SDL_CondSignal(compiler.wake);
+	SDL_UnlockMutex(compiler.lock);
+}
+
+// on the render thread, swaps in whatever finished since the last frame
+static void collectShaderPrograms(void) {
+	if (!compiler.running) return;
+
+	ShaderJob done[MAXSHADERS];
+	SDL_LockMutex(compiler.lock);
+	memcpy(done, compiler.done, sizeof(done));
+	for (int i=0; i<MAXSHADERS; i++) {
+		compiler.done[i].filename[0] = '\0';
+	}
+	SDL_UnlockMutex(compiler.lock);
+
+	for (int i=0; i<MAXSHADERS; i++) {
+		if (!done[i].filename[0]) continue;
+		if (done[i].generation==compiler.generation[i]) installShaderProgram(shaders[i], done[i].program);
+		else if (done[i].program) glDeleteProgram(done[i].program); // asked for something else since
+	}
+}
+
+static void quitShaderCompiler(void) {
+	if (!compiler.running) return;
+
+	SDL_LockMutex(compiler.lock);
+	compiler.quit = 1;
+	SDL_CondSignal(compiler.wake);
+	SDL_UnlockMutex(compiler.lock);
+	SDL_WaitThread(compiler.thread, NULL);
+
+	for (int i=0; i<MAXSHADERS; i++) {
+		if (compiler.done[i].filename[0] && compiler.done[i].program) glDeleteProgram(compiler.done[i].program);
+	}
+	SDL_GL_DeleteContext(compiler.context);
+	SDL_DestroyCond(compiler.wake);
+	SDL_DestroyMutex(compiler.lock);
+	SDL_DestroySemaphore(compiler.started);
+	memset(&compiler, 0, sizeof(compiler));
+}
+
 void PLAT_initShaders() {
 	SDL_GL_MakeCurrent(vid.window, vid.gl_context);
-	glViewport(0, 0, device_width, device_height);
-	
-	GLuint vertex;
-	GLuint fragment;
-
-	vertex = load_shader_from_file(GL_VERTEX_SHADER, "default.glsl",SYSSHADERS_FOLDER);
-	fragment = load_shader_from_file(GL_FRAGMENT_SHADER, "default.glsl",SYSSHADERS_FOLDER);
-	g_shader_default = link_program(vertex, fragment,"defaultv2.glsl");
+	GL_viewport(0, 0, device_width, device_height);
 
-	vertex = load_shader_from_file(GL_VERTEX_SHADER, "overlay.glsl",SYSSHADERS_FOLDER);
-	fragment = load_shader_from_file(GL_FRAGMENT_SHADER, "overlay.glsl",SYSSHADERS_FOLDER);
-	g_shader_overlay = link_program(vertex, fragment,"overlay.glsl");
+	snprintf(shader_driver, sizeof(shader_driver), "%s/%s/%s",
+		(const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+	LOG_info("shader driver %s\n", shader_driver);
 
-	vertex = load_shader_from_file(GL_VERTEX_SHADER, "noshader.glsl",SYSSHADERS_FOLDER);
-	fragment = load_shader_from_file(GL_FRAGMENT_SHADER, "noshader.glsl",SYSSHADERS_FOLDER);
-	g_noshader = link_program(vertex, fragment,"noshader.glsl");
+	g_shader_default = load_program("default.glsl", SYSSHADERS_FOLDER, NULL);
+	g_shader_overlay = load_program("overlay.glsl", SYSSHADERS_FOLDER, NULL);
+	g_noshader = load_program("noshader.glsl", SYSSHADERS_FOLDER, NULL);
 	
 	LOG_info("default shaders loaded, %i\n\n",g_shader_default);
+
+	startShaderCompiler();
+}
+
+// for the shaderwarm tool. compiles every preset shader into the cache and
+// removes binaries nothing maps to anymore, returns how many shaders built
+int PLAT_warmShaderCache(void) {
+	DIR* dir = opendir(SHADERS_FOLDER "/glsl");
+	if (!dir) {
+		LOG_error("can't open %s\n", SHADERS_FOLDER "/glsl");
+		return 0;
+	}
+
+	int count = 0;
+	int failed = 0;
+	int capacity = 64;
+	char (*keep)[MAX_PATH] = malloc(capacity * MAX_PATH);
+	const char* system_shaders[] = {"default.glsl", "overlay.glsl", "noshader.glsl"};
+	for (int i=0; i<3; i++) {
+		GLuint program = load_program(system_shaders[i], SYSSHADERS_FOLDER, keep[count]);
+		if (program) {
+			glDeleteProgram(program);
+			count++;
+		}
+	}
+
+	struct dirent* entry;
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0]=='.' || !suffixMatch(".glsl", entry->d_name)) continue;
+		if (count==capacity) {
+			capacity *= 2;
+			keep = realloc(keep, capacity * MAX_PATH);
+		}
+		uint64_t start = getMicroseconds();
+		GLuint program = load_program(entry->d_name, SHADERS_FOLDER "/glsl", keep[count]);
+		if (!program) {
+			LOG_error("%s doesn't build\n", entry->d_name);
+			failed++;
+			continue;
+		}
+		glDeleteProgram(program);
+		LOG_info("%s ready in %.1fms\n", entry->d_name, (getMicroseconds() - start) / 1000.0);
+		count++;
+	}
+	closedir(dir);
+
+	dir = opendir(SHADERCACHE_FOLDER);
+	if (dir) {
+		while ((entry = readdir(dir))) {
+			if (entry->d_name[0]=='.') continue;
+			char path[MAX_PATH];
+			snprintf(path, sizeof(path), SHADERCACHE_FOLDER "/%s", entry->d_name);
+			int used = 0;
+			for (int i=0; i<count && !used; i++) {
+				used = exactMatch(path, keep[i]);
+			}
+			if (!used) {
+				LOG_info("removing stale %s\n", path);
+				unlink(path);
+			}
+		}
+		closedir(dir);
+	}
+	free(keep);
+
+	LOG_info("%i shaders cached, %i failed\n", count, failed);
+	return count;
 }
 
 
@@ -492,7 +1008,7 @@ SDL_Surface* PLAT_initVideo(void) {
 
 	vid.gl_context = SDL_GL_CreateContext(vid.window);
 	SDL_GL_MakeCurrent(vid.window, vid.gl_context);
-	glViewport(0, 0, w, h);
+	GL_viewport(0, 0, w, h);
 
 	vid.stream_layer1 = SDL_CreateTexture(vid.renderer,SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, w,h);
 	vid.target_layer1 = SDL_CreateTexture(vid.renderer,SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET , w,h);
@@ -576,7 +1092,6 @@ char* PLAT_findFileInDir(const char *directory, const char *filename) {
     return NULL;
 }
 
-#define MAX_SHADER_PRAGMAS 32
 void loadShaderPragmas(Shader *shader, const char *shaderSource) {
 	shader->pragmas = calloc(MAX_SHADER_PRAGMAS, sizeof(ShaderParam));
 	if (!shader->pragmas) {
@@ -603,29 +1118,15 @@ void PLAT_updateShader(int i, const char *filename, int *scale, int *filter, int
 
 		char filepath[512];
 		snprintf(filepath, sizeof(filepath), SHADERS_FOLDER "/glsl/%s",filename);
-		const char *shaderSource  = load_shader_source(filepath);
-		loadShaderPragmas(shader,shaderSource);
-
-		GLuint vertex_shader1 = load_shader_from_file(GL_VERTEX_SHADER, filename,SHADERS_FOLDER "/glsl");
-		GLuint fragment_shader1 = load_shader_from_file(GL_FRAGMENT_SHADER, filename,SHADERS_FOLDER "/glsl");
-			
-        // Link the shader program
-		if (shader->shader_p != 0) {
-			LOG_info("Deleting previous shader %i\n",shader->shader_p);
-			glDeleteProgram(shader->shader_p);
+		char *shaderSource  = load_shader_source(filepath);
+		if (shaderSource) {
+			loadShaderPragmas(shader,shaderSource);
+			free(shaderSource);
 		}
-        shader->shader_p = link_program(vertex_shader1, fragment_shader1,filename);
-        
-		shader->u_FrameDirection = glGetUniformLocation( shader->shader_p, "FrameDirection");
-		shader->u_FrameCount = glGetUniformLocation( shader->shader_p, "FrameCount");
-		shader->u_OutputSize = glGetUniformLocation( shader->shader_p, "OutputSize");
-		shader->u_TextureSize = glGetUniformLocation( shader->shader_p, "TextureSize");
-		shader->u_InputSize = glGetUniformLocation( shader->shader_p, "InputSize");
-		shader->OrigInputSize = glGetUniformLocation( shader->shader_p, "OrigInputSize");
-		shader->texLocation = glGetUniformLocation(shader->shader_p, "Texture");
-		shader->texelSizeLocation = glGetUniformLocation(shader->shader_p, "texelSize");
+
+		// the menu reads these straight away, locations come with the program
 		for (int i = 0; i < shader->num_pragmas; ++i) {
-			shader->pragmas[i].uniformLocation = glGetUniformLocation(shader->shader_p, shader->pragmas[i].name);
+			shader->pragmas[i].uniformLocation = -1;
 			shader->pragmas[i].value = shader->pragmas[i].def;
 
 			printf("Param: %s = %f (min: %f, max: %f, step: %f)\n",
@@ -635,21 +1136,9 @@ void PLAT_updateShader(int i, const char *filename, int *scale, int *filter, int
 				shader->pragmas[i].max,
 				shader->pragmas[i].step);
 		}
-
-        if (shader->shader_p == 0) {
-            LOG_info("Shader linking failed for %s\n", filename);
-        }
-
-        GLint success = 0;
-        glGetProgramiv(shader->shader_p, GL_LINK_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetProgramInfoLog(shader->shader_p, 512, NULL, infoLog);
-            LOG_info("Shader Program Linking Failed: %s\n", infoLog);
-        } else {
-			LOG_info("Shader Program Linking Success %s shader ID is %i\n", filename,shader->shader_p);
-		}
 		shader->filename = strdup(filename);
+
+		queueShaderProgram(i, filename);
     }
     if (scale != NULL) {
         shader->scale = *scale +1;
@@ -743,11 +1232,17 @@ static void clearVideo(void) {
 	}
 }
 
+static void quitUpload(void);
+static void quitShaderGraph(void);
 void PLAT_quitVideo(void) {
 	clearVideo();
 
 
 	glFinish();
+	quitShaderCompiler();
+	quitUpload();
+	quitShaderGraph();
+	GL_quitState();
 	SDL_GL_DeleteContext(vid.gl_context);
 	SDL_FreeSurface(vid.screen);
 
@@ -1810,7 +2305,7 @@ void PLAT_flip(SDL_Surface* IGNORED, int ignored) {
         SDL_RenderPresent(vid.renderer);
         return;
     }
-    SDL_UpdateTexture(vid.stream_layer1, NULL, vid.blit->src, vid.blit->src_p);
+    if (vid.blit->src) SDL_UpdateTexture(vid.stream_layer1, NULL, vid.blit->src, vid.blit->src_p);
 
     SDL_Texture* target = vid.stream_layer1;
     int x = vid.blit->src_x;
@@ -1841,136 +2336,194 @@ void PLAT_flip(SDL_Surface* IGNORED, int ignored) {
 }
 
 static int frame_count = 0;
-void runShaderPass(GLuint src_texture, GLuint shader_program, GLuint* target_texture,
-                   int x, int y, int dst_width, int dst_height, Shader* shader, int alpha, int filter) {
-
-	static GLuint static_VAO = 0, static_VBO = 0;
-	static GLuint last_program = 0;
-	static GLfloat last_texelSize[2] = {-1.0f, -1.0f};
-	static GLfloat texelSize[2] = {-1.0f, -1.0f};
-	static GLuint fbo = 0;
-
-	texelSize[0] = 1.0f / shader->texw;
-	texelSize[1] = 1.0f / shader->texh;
 
+// shader pass output, pooled by size with a framebuffer each so switching
+// passes is a bind instead of re-attaching a texture to one shared fbo
+typedef struct RenderTarget {
+	GLuint texture;
+	GLuint fbo;
+	int w;
+	int h;
+	int filter; // what it's currently sampled with, -1 if not set yet
+} RenderTarget;
+
+void runShaderPass(GLuint src_texture, GLuint shader_program, RenderTarget* target,
+                   int x, int y, int dst_width, int dst_height, Shader* shader, int alpha, int flip) {
+
+	ProgramState* ps = GL_useProgram(shader_program);
+
+	// things like overlays and stuff we don't need to write to another texture so they can be directly written to screen framebuffer
+	GL_bindFramebuffer(target ? target->fbo : 0);
+	GL_setBlend(alpha==1);
+	GL_bindTexture(src_texture);
+	GL_viewport(x, y, dst_width, dst_height);
+
+	GL_uniform1i(ps->u_FrameDirection, &ps->frame_direction, 1);
+	GL_uniform1i(ps->u_FrameCount, &ps->frame_count, frame_count);
+	GL_uniform1i(ps->texLocation, &ps->texture_unit, 0);
+	GL_uniform2f(ps->u_OutputSize, ps->output_size, dst_width, dst_height);
+	GL_uniform2f(ps->u_TextureSize, ps->texture_size, shader->texw, shader->texh);
+	GL_uniform2f(ps->OrigInputSize, ps->orig_input_size, shader->srcw, shader->srch);
+	GL_uniform2f(ps->u_InputSize, ps->input_size, shader->srcw, shader->srch);
+	GL_uniform2f(ps->texelSizeLocation, ps->texel_size, 1.0f / shader->texw, 1.0f / shader->texh);
+	for (int i = 0; i < shader->num_pragmas && i < MAX_SHADER_PRAGMAS; ++i) {
+		if (shader->pragmas[i].uniformLocation < 0 || ps->pragmas[i] == shader->pragmas[i].value) continue;
+		GL_CALL(glUniform1f(shader->pragmas[i].uniformLocation, shader->pragmas[i].value));
+		ps->pragmas[i] = shader->pragmas[i].value;
+	}
 
-	if (shader_program != last_program)
-    	glUseProgram(shader_program);
+	GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, flip ? 4 : 0, 4));
+}
 
-	if (static_VAO == 0) {
-		glGenVertexArrays(1, &static_VAO);
-		glGenBuffers(1, &static_VBO);
-		glBindVertexArray(static_VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, static_VBO);
+///////////////////////////////
 
-		float vertices[] = {
-			// x,    y,    z,    w,     u,    v,    s,    t
-			-1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 0.0f, 0.0f,  // top-left
-			-1.0f, -1.0f, 0.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f,  // bottom-left
-			1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 0.0f, 0.0f,  // top-right
-			1.0f, -1.0f, 0.0f, 1.0f,  1.0f, 0.0f, 0.0f, 0.0f   // bottom-right
-		};
+// the preset compiled down to what actually has to be drawn. a pass without a
+// shader that samples nearest at its input size is a straight copy and gets
+// dropped, and when the last pass already comes out at the on screen size it
+// draws to the screen itself instead of going through the final scale. passes
+// only ever read the pass before them so same sized targets ping-pong
+typedef struct ShaderPass {
+	Shader* shader;
+	int input;  // targets index, -1 for the core's frame
+	int output; // targets index, -1 for the screen
+	int filter; // input is sampled with this
+	int x;
+	int y;
+	int w;
+	int h;
+	int flip;
+	int index;  // pass in the preset, nrofshaders for the final scale
+} ShaderPass;
+
+static struct ShaderGraph {
+	ShaderPass passes[MAXSHADERS + 1];
+	int count;
+	RenderTarget targets[MAXSHADERS];
+	Shader final; // uniforms for the final scale
+	int src_w;
+	int src_h;
+	SDL_Rect dst;
+} graph;
+
+static int claimRenderTarget(int w, int h, int input, int* claimed) {
+	for (int i=0; i<MAXSHADERS; i++) {
+		RenderTarget* target = &graph.targets[i];
+		if (i != input && target->texture && target->w == w && target->h == h) {
+			claimed[i] = 1;
+			return i;
+		}
+	}
 
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	// resize one nothing in this graph uses yet, or make a new one
+	int i = 0;
+	while (i == input || claimed[i]) i++;
+	RenderTarget* target = &graph.targets[i];
+	if (!target->texture) {
+		glGenTextures(1, &target->texture);
+		GL_bindTexture(target->texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glGenFramebuffers(1, &target->fbo);
+		GL_bindFramebuffer(target->fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
 	}
-	
+	GL_bindTexture(target->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	target->w = w;
+	target->h = h;
+	target->filter = -1;
+	claimed[i] = 1;
+	return i;
+}
 
-	if (shader_program != last_program) {
-		GLint posAttrib = glGetAttribLocation(shader_program, "VertexCoord");
-		if (posAttrib >= 0) {
-			glVertexAttribPointer(posAttrib, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-			glEnableVertexAttribArray(posAttrib);
-		}
-		GLint texAttrib = glGetAttribLocation(shader_program, "TexCoord");
-		if (texAttrib >= 0) {
-			glVertexAttribPointer(texAttrib,  4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(4 * sizeof(float)));
-			glEnableVertexAttribArray(texAttrib);
-		}
+static void releaseRenderTarget(RenderTarget* target) {
+	if (!target->texture) return;
+	if (gl.fbo == target->fbo) GL_bindFramebuffer(0);
+	if (gl.texture == target->texture) GL_bindTexture(0);
+	glDeleteFramebuffers(1, &target->fbo);
+	glDeleteTextures(1, &target->texture);
+	memset(target, 0, sizeof(RenderTarget));
+}
 
-		if (shader->u_FrameDirection >= 0) glUniform1i(shader->u_FrameDirection, 1);
-		if (shader->u_FrameCount >= 0) glUniform1i(shader->u_FrameCount, frame_count);
-		if (shader->u_OutputSize >= 0) glUniform2f(shader->u_OutputSize, dst_width, dst_height);
-		if (shader->u_TextureSize >= 0) glUniform2f(shader->u_TextureSize, shader->texw, shader->texh); 
-		if (shader->OrigInputSize >= 0) glUniform2f(shader->OrigInputSize, shader->srcw, shader->srch); 
-		if (shader->u_InputSize >= 0) glUniform2f(shader->u_InputSize, shader->srcw, shader->srch); 
-		for (int i = 0; i < shader->num_pragmas; ++i) {
-			glUniform1f(shader->pragmas[i].uniformLocation, shader->pragmas[i].value);
+static void buildShaderGraph(int src_w, int src_h, SDL_Rect* dst_rect) {
+	int last_w = src_w;
+	int last_h = src_h;
+
+	graph.count = 0;
+	for (int i = 0; i < nrofshaders; i++) {
+		Shader* shader = shaders[i];
+		int dst_w = last_w * shader->scale;
+		int dst_h = last_h * shader->scale;
+		if (shader->scale == 9) {
+			dst_w = dst_rect->w;
+			dst_h = dst_rect->h;
 		}
 
-		GLint u_MVP = glGetUniformLocation(shader_program, "MVPMatrix");
-		if (u_MVP >= 0) {
-			float identity[16] = {
-				1,0,0,0,
-				0,1,0,0,
-				0,0,1,0,
-				0,0,0,1
-			};
-			glUniformMatrix4fv(u_MVP, 1, GL_FALSE, identity);
-		}
-		glBindVertexArray(static_VAO);
+		shader->srcw = shader->srctype == 0 ? src_w : shader->srctype == 2 ? dst_rect->w : last_w;
+		shader->srch = shader->srctype == 0 ? src_h : shader->srctype == 2 ? dst_rect->h : last_h;
+		shader->texw = shader->scaletype == 0 ? src_w : shader->scaletype == 2 ? dst_rect->w : last_w;
+		shader->texh = shader->scaletype == 0 ? src_h : shader->scaletype == 2 ? dst_rect->h : last_h;
+		shader->updated = 0;
+
+		if (!shader->shader_p && shader->filter == GL_NEAREST && dst_w == last_w && dst_h == last_h) continue;
+
+		graph.passes[graph.count++] = (ShaderPass){
+			.shader = shader,
+			.filter = shader->filter,
+			.w = dst_w,
+			.h = dst_h,
+			.index = i,
+		};
+		last_w = dst_w;
+		last_h = dst_h;
 	}
-	static GLuint lastfbo = -1;
-	if (target_texture) {
-		if (*target_texture==0 || shader->updated || reloadShaderTextures) { 
-			
-			// if(target_texture) {
-			// 	glDeleteTextures(1,target_texture);
-			// }
-			if(*target_texture==0)
-				glGenTextures(1, target_texture);
-			glActiveTexture(GL_TEXTURE0);	
-			glBindTexture(GL_TEXTURE_2D, *target_texture);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dst_width, dst_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-			shader->updated = 0;
-		}
-		if (fbo == 0) {
-			glGenFramebuffers(1, &fbo);
-		}
-		
-		if (lastfbo == 0) {
-			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-			
-		}
-		lastfbo = fbo;
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *target_texture, 0);
-		
-    } else {
-		// things like overlays and stuff we don't need to write to another texture so they can be directly written to screen framebuffer
-		if (lastfbo != 0) {
-        	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		}
-		lastfbo = 0;
-    }
 
-	if(alpha==1) {
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	} else {
-		glDisable(GL_BLEND);
+	ShaderPass* last = graph.count ? &graph.passes[graph.count - 1] : NULL;
+	if (last && last->w == dst_rect->w && last->h == dst_rect->h) {
+		last->x = dst_rect->x;
+		last->y = dst_rect->y;
+		last->flip = 1;
+	}
+	else {
+		graph.final = (Shader){
+			.srcw = last_w, .srch = last_h, .texw = last_w, .texh = last_h,
+		};
+		graph.passes[graph.count++] = (ShaderPass){
+			.shader = &graph.final,
+			.filter = finalScaleFilter,
+			.x = dst_rect->x,
+			.y = dst_rect->y,
+			.w = dst_rect->w,
+			.h = dst_rect->h,
+			.index = nrofshaders,
+		};
 	}
 
-	static GLuint last_bound_texture = 0;
-	if (src_texture != last_bound_texture) {
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, src_texture);
-		last_bound_texture = src_texture;
+	int claimed[MAXSHADERS] = {0};
+	int input = -1;
+	for (int i = 0; i < graph.count; i++) {
+		ShaderPass* pass = &graph.passes[i];
+		pass->input = input;
+		pass->output = pass->flip || pass->shader == &graph.final ? -1 : claimRenderTarget(pass->w, pass->h, input, claimed);
+		input = pass->output;
+	}
+	for (int i = 0; i < MAXSHADERS; i++) {
+		if (!claimed[i]) releaseRenderTarget(&graph.targets[i]);
 	}
-	glViewport(x, y, dst_width, dst_height);
 
-	
-	if (shader->texLocation >= 0) glUniform1i(shader->texLocation, 0);  
-	
-	if (shader->texelSizeLocation >= 0) {
-		glUniform2fv(shader->texelSizeLocation, 1, texelSize);
-		last_texelSize[0] = texelSize[0];
-		last_texelSize[1] = texelSize[1];
+	graph.src_w = src_w;
+	graph.src_h = src_h;
+	graph.dst = *dst_rect;
+	LOG_info("shader graph: %i of %i passes, %s final scale\n", graph.count - (last && last->flip ? 0 : 1), nrofshaders, last && last->flip ? "no" : "with");
+}
+
+// the targets go with the context
+static void quitShaderGraph(void) {
+	for (int i = 0; i < MAXSHADERS; i++) {
+		releaseRenderTarget(&graph.targets[i]);
 	}
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	last_program = shader_program;
+	graph.count = 0;
+	reloadShaderTextures = 1;
 }
 
 typedef struct {
@@ -2033,6 +2586,70 @@ int prepareFrameThread(void *data) {
 
 static SDL_Thread *prepare_thread = NULL;
 
+// the core's frame goes to the gpu through a ring of pixel unpack buffers, the
+// copy into one of them is plain cpu work and the texture update reads from it
+// asynchronously so we never wait for the previous frame's draw to let go of
+// src_texture. a fence per buffer tells us when it can be written again
+#define UPLOAD_BUFFERS 3
+
+static struct {
+	GLuint pbo[UPLOAD_BUFFERS];
+	GLsync fence[UPLOAD_BUFFERS];
+	GLsizeiptr size[UPLOAD_BUFFERS];
+	int next;
+} upload = {0};
+
+static void uploadSourceTexture(GLenum format, GLenum type, int bpp, int allocate) {
+	int pitch = vid.blit->src_p ? vid.blit->src_p : vid.blit->src_w * bpp;
+	GLsizeiptr size = (GLsizeiptr)pitch * (vid.blit->src_h - 1) + vid.blit->src_w * bpp;
+	const void* pixels = vid.blit->src;
+
+	if (!upload.pbo[0]) glGenBuffers(UPLOAD_BUFFERS, upload.pbo);
+	int i = upload.next;
+	upload.next = (upload.next + 1) % UPLOAD_BUFFERS;
+
+	GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo[i]));
+
+	int busy = 0;
+	if (upload.fence[i]) {
+		GLenum status = GL_CALL(glClientWaitSync(upload.fence[i], 0, 0));
+		busy = status!=GL_ALREADY_SIGNALED && status!=GL_CONDITION_SATISFIED;
+		GL_CALL(glDeleteSync(upload.fence[i]));
+		upload.fence[i] = 0;
+	}
+	// too small or still being read, have the driver swap in fresh storage
+	// rather than block on the old one
+	if (busy || upload.size[i]<size) {
+		if (upload.size[i]<size) upload.size[i] = size;
+		GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, upload.size[i], NULL, GL_STREAM_DRAW));
+	}
+
+	void* dst = GL_CALL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	if (dst) {
+		memcpy(dst, pixels, size);
+		if (GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))) pixels = NULL; // offset into the bound buffer
+		else dst = NULL; // contents were lost, upload from client memory
+	}
+	if (!dst) GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+	if (allocate) GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, format, vid.blit->src_w, vid.blit->src_h, 0, format, type, pixels));
+	else GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid.blit->src_w, vid.blit->src_h, format, type, pixels));
+
+	if (dst) {
+		upload.fence[i] = GL_CALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+		GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+	}
+}
+
+// the buffers go with the context
+static void quitUpload(void) {
+	for (int i=0; i<UPLOAD_BUFFERS; i++) {
+		if (upload.fence[i]) glDeleteSync(upload.fence[i]);
+	}
+	if (upload.pbo[0]) glDeleteBuffers(UPLOAD_BUFFERS, upload.pbo);
+	memset(&upload, 0, sizeof(upload));
+}
+
 void PLAT_GL_Swap() {
 
 	if (prepare_thread == NULL) {
@@ -2046,17 +2663,20 @@ void PLAT_GL_Swap() {
 
     static int lastframecount = 0;
     if (reloadShaderTextures) lastframecount = frame_count;
-    if (frame_count < lastframecount + 3)
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (frame_count < lastframecount + 3) {
+        GL_bindFramebuffer(0);
+        GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    }
 
     SDL_Rect dst_rect = {0, 0, device_width, device_height};
     setRectToAspectRatio(&dst_rect);
 
-    if (!vid.blit->src) {
+    if (!vid.blit->src && !vid.blit->src_dupe) {
         return;
     }
 
 	SDL_GL_MakeCurrent(vid.window, vid.gl_context);
+	collectShaderPrograms();
 
     static GLuint effect_tex = 0;
     static int effect_w = 0, effect_h = 0;
@@ -2068,7 +2688,7 @@ void PLAT_GL_Swap() {
 	 if (frame_prep.effect_ready) {
 		if(frame_prep.loaded_effect) {
 			if(!effect_tex) glGenTextures(1, &effect_tex);
-			glBindTexture(GL_TEXTURE_2D, effect_tex);
+			GL_bindTexture(effect_tex);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -2078,6 +2698,7 @@ void PLAT_GL_Swap() {
 			effect_h = frame_prep.loaded_effect->h;
 		} else {
 			if (effect_tex) {
+				if (gl.texture == effect_tex) GL_bindTexture(0);
 				glDeleteTextures(1, &effect_tex);
 			}
 			effect_tex = 0;
@@ -2088,7 +2709,7 @@ void PLAT_GL_Swap() {
     if (frame_prep.overlay_ready) {
 		if(frame_prep.loaded_overlay) {
 			if(!overlay_tex) glGenTextures(1, &overlay_tex);
-			glBindTexture(GL_TEXTURE_2D, overlay_tex);
+			GL_bindTexture(overlay_tex);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -2099,6 +2720,7 @@ void PLAT_GL_Swap() {
 		
 		} else {
 			if (overlay_tex) {
+				if (gl.texture == overlay_tex) GL_bindTexture(0);
 				glDeleteTextures(1, &overlay_tex);
 			}
 			overlay_tex = 0;
@@ -2107,8 +2729,8 @@ void PLAT_GL_Swap() {
     }
 	
     static GLuint src_texture = 0;
-    static int src_w_last = 0, src_h_last = 0;
-    static int last_w = 0, last_h = 0;
+    static int src_w_last = 0, src_h_last = 0, src_fmt_last = -1;
+    static int src_filter = -1; // set by whichever pass samples it first
 
     if (!src_texture || reloadShaderTextures) {
         // if (src_texture) {
@@ -2117,107 +2739,98 @@ void PLAT_GL_Swap() {
         // }
 		if (src_texture==0)
         	glGenTextures(1, &src_texture);
-        glBindTexture(GL_TEXTURE_2D, src_texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, nrofshaders > 0 ? shaders[0]->filter : finalScaleFilter);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, nrofshaders > 0 ? shaders[0]->filter : finalScaleFilter);
+        GL_bindTexture(src_texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        src_filter = -1;
     }
 
-    glBindTexture(GL_TEXTURE_2D, src_texture);
-    if (vid.blit->src_w != src_w_last || vid.blit->src_h != src_h_last || reloadShaderTextures) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, vid.blit->src_w, vid.blit->src_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid.blit->src);
+    GL_bindTexture(src_texture);
+
+    // RGB565 frames are uploaded as-is, the GPU does the expansion for free
+    GLenum src_format = GL_RGBA;
+    GLenum src_type = GL_UNSIGNED_BYTE;
+    int src_bpp = 4;
+    if (vid.blit->src_fmt == RENDERER_SRC_RGB565) {
+        src_format = GL_RGB;
+        src_type = GL_UNSIGNED_SHORT_5_6_5;
+        src_bpp = 2;
+    }
+    // honour the source pitch so cores with padded lines don't need a repack
+    if (vid.blit->src_p) GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, vid.blit->src_p / src_bpp));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, src_bpp));
+
+    uint64_t upload_start = getMicroseconds();
+    uint64_t trace_start = TRACE_begin();
+    if (!vid.blit->src) {
+        // a dupe frame, the texture still holds the last one
+    } else if (vid.blit->src_w != src_w_last || vid.blit->src_h != src_h_last || vid.blit->src_fmt != src_fmt_last || reloadShaderTextures) {
+        uploadSourceTexture(src_format, src_type, src_bpp, 1);
         src_w_last = vid.blit->src_w;
         src_h_last = vid.blit->src_h;
+        src_fmt_last = vid.blit->src_fmt;
     } else {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vid.blit->src_w, vid.blit->src_h, GL_RGBA, GL_UNSIGNED_BYTE, vid.blit->src);
-    }
-
-    if (nrofshaders < 1) {
-        runShaderPass(src_texture, g_shader_default, NULL, dst_rect.x, dst_rect.y,
-            dst_rect.w, dst_rect.h,
-            &(Shader){.srcw = vid.blit->src_w, .srch = vid.blit->src_h, .texw = vid.blit->src_w, .texh = vid.blit->src_h},
-            0, GL_NONE);
+        uploadSourceTexture(src_format, src_type, src_bpp, 0);
     }
+    TRACE_end(TRACE_UPLOAD, 0, trace_start);
+    // rolling average so the debug overlay is readable
+    currentuploadms = currentuploadms * 0.9 + (getMicroseconds() - upload_start) / 1000.0 * 0.1;
 
-    last_w = vid.blit->src_w;
-    last_h = vid.blit->src_h;
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
 
+    int rebuild = reloadShaderTextures || vid.blit->src_w != graph.src_w || vid.blit->src_h != graph.src_h ||
+        memcmp(&dst_rect, &graph.dst, sizeof(SDL_Rect)) != 0;
     for (int i = 0; i < nrofshaders; i++) {
-        int src_w = last_w;
-        int src_h = last_h;
-        int dst_w = src_w * shaders[i]->scale;
-        int dst_h = src_h * shaders[i]->scale;
-
-        if (shaders[i]->scale == 9) {
-            dst_w = dst_rect.w;
-            dst_h = dst_rect.h;
+        if (shaders[i]->updated) rebuild = 1;
+    }
+    if (rebuild) buildShaderGraph(vid.blit->src_w, vid.blit->src_h, &dst_rect);
+
+    // traced passes are numbered by their place in the preset, the final scale is nrofshaders
+    for (int i = 0; i < graph.count; i++) {
+        ShaderPass* pass = &graph.passes[i];
+        GLuint input = pass->input < 0 ? src_texture : graph.targets[pass->input].texture;
+        int* filter = pass->input < 0 ? &src_filter : &graph.targets[pass->input].filter;
+        if (*filter != pass->filter) {
+            GL_bindTexture(input);
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pass->filter));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pass->filter));
+            *filter = pass->filter;
         }
 
-        if (reloadShaderTextures) {
-            for (int j = i; j < nrofshaders; j++) {
-                int real_input_w = (i == 0) ? vid.blit->src_w : last_w;
-                int real_input_h = (i == 0) ? vid.blit->src_h : last_h;
-
-                shaders[i]->srcw = shaders[i]->srctype == 0 ? vid.blit->src_w : shaders[i]->srctype == 2 ? dst_rect.w : real_input_w;
-                shaders[i]->srch = shaders[i]->srctype == 0 ? vid.blit->src_h : shaders[i]->srctype == 2 ? dst_rect.h : real_input_h;
-                shaders[i]->texw = shaders[i]->scaletype == 0 ? vid.blit->src_w : shaders[i]->scaletype == 2 ? dst_rect.w : real_input_w;
-                shaders[i]->texh = shaders[i]->scaletype == 0 ? vid.blit->src_h : shaders[i]->scaletype == 2 ? dst_rect.h : real_input_h;
+        GLuint program = g_shader_default;
+        if (pass->shader != &graph.final) {
+            program = pass->shader->shader_p ? pass->shader->shader_p : g_noshader;
+
+            static int shaderinfocount = 0;
+            static int shaderinfoscreen = 0;
+            if (shaderinfocount > 600 && shaderinfoscreen == i) {
+                currentshaderpass = pass->index + 1;
+                currentshadertexw = pass->shader->texw;
+                currentshadertexh = pass->shader->texh;
+                currentshadersrcw = pass->shader->srcw;
+                currentshadersrch = pass->shader->srch;
+                currentshaderdstw = pass->w;
+                currentshaderdsth = pass->h;
+                shaderinfocount = 0;
+                shaderinfoscreen++;
             }
-        }
-
-        static int shaderinfocount = 0;
-        static int shaderinfoscreen = 0;
-        if (shaderinfocount > 600 && shaderinfoscreen == i) {
-            currentshaderpass = i + 1;
-            currentshadertexw = shaders[i]->texw;
-            currentshadertexh = shaders[i]->texh;
-            currentshadersrcw = shaders[i]->srcw;
-            currentshadersrch = shaders[i]->srch;
-            currentshaderdstw = dst_w;
-            currentshaderdsth = dst_h;
-            shaderinfocount = 0;
-            shaderinfoscreen++;
-            if (shaderinfoscreen >= nrofshaders)
+            if (shaderinfoscreen >= graph.count || graph.passes[shaderinfoscreen].shader == &graph.final)
                 shaderinfoscreen = 0;
-        }
-        shaderinfocount++;
-
-        if (shaders[i]->shader_p) {
-            runShaderPass(
-                (i == 0) ? src_texture : shaders[i - 1]->texture,
-                shaders[i]->shader_p,
-                &shaders[i]->texture,
-                0, 0, dst_w, dst_h,
-                shaders[i],
-                0,
-                (i == nrofshaders - 1) ? finalScaleFilter : shaders[i + 1]->filter
-            );
-        } else {
-            runShaderPass(
-                (i == 0) ? src_texture : shaders[i - 1]->texture,
-                g_noshader,
-                &shaders[i]->texture,
-                0, 0, dst_w, dst_h,
-                shaders[i],
-                0,
-                (i == nrofshaders - 1) ? finalScaleFilter : shaders[i + 1]->filter
-            );
+            shaderinfocount++;
         }
 
-        last_w = dst_w;
-        last_h = dst_h;
-    }
-
-    if (nrofshaders > 0) {
+        uint64_t pass_start = TRACE_begin();
         runShaderPass(
-            shaders[nrofshaders - 1]->texture,
-            g_shader_default,
-            NULL,
-            dst_rect.x, dst_rect.y, dst_rect.w, dst_rect.h,
-            &(Shader){.srcw = last_w, .srch = last_h, .texw = last_w, .texh = last_h},
-            0, GL_NONE
+            input,
+            program,
+            pass->output < 0 ? NULL : &graph.targets[pass->output],
+            pass->x, pass->y, pass->w, pass->h,
+            pass->shader,
+            0,
+            pass->flip
         );
+        TRACE_end(TRACE_SHADER_PASS, pass->index, pass_start);
     }
 
     if (effect_tex) {
@@ -2227,7 +2840,7 @@ void PLAT_GL_Swap() {
             NULL,
 			dst_rect.x, dst_rect.y, effect_w, effect_h,
             &(Shader){.srcw = effect_w, .srch = effect_h, .texw = effect_w, .texh = effect_h},
-            1, GL_NONE
+            1, 0
         );
     }
 
@@ -2238,11 +2851,15 @@ void PLAT_GL_Swap() {
             NULL,
             0, 0, device_width, device_height,
             &(Shader){.srcw = vid.blit->src_w, .srch = vid.blit->src_h, .texw = overlay_w, .texh = overlay_h},
-            1, GL_NONE
+            1, 0
         );
     }
 
+    GL_endFrame();
+
+    uint64_t swap_start = TRACE_begin();
     SDL_GL_SwapWindow(vid.window);
+    TRACE_end(TRACE_SWAP, 0, swap_start);
     frame_count++;
     reloadShaderTextures = 0;
 }
@@ -2276,7 +2893,8 @@ void PLAT_pixelFlipper(uint8_t* pixels, int width, int height) {
 }
 
 unsigned char* PLAT_GL_screenCapture(int* outWidth, int* outHeight) {
-    glViewport(0, 0, device_width, device_height);
+    GL_bindFramebuffer(0);
+    GL_viewport(0, 0, device_width, device_height);
     GLint viewport[4];
     glGetIntegerv(GL_VIEWPORT, viewport);
 	
@@ -2429,6 +3047,12 @@ static pthread_mutex_t currentcpuinfo;
 // a roling average for the display values of about 2 frames, otherwise they are unreadable jumping too fast up and down and stuff to read
 #define ROLLING_WINDOW 120  
 
+static const int cpu_frequencies[] = {408,450,500,550,  600,650,700,750, 800,850,900,950, 1000,1050,1100,1150, 1200,1250,1300,1350, 1400,1450,1500,1550, 1600,1650,1700,1750, 1800,1850,1900,1950, 2000};
+int PLAT_getCPUFrequencies(const int** freqs) {
+	*freqs = cpu_frequencies;
+	return sizeof(cpu_frequencies) / sizeof(cpu_frequencies[0]);
+}
+
 volatile int useAutoCpu = 1;
 void *PLAT_cpu_monitor(void *arg) {
     struct timespec start_time, curr_time;
@@ -2439,7 +3063,6 @@ void *PLAT_cpu_monitor(void *arg) {
     double prev_real_time = get_time_sec();
     double prev_cpu_time = get_process_cpu_time_sec();
 
-	const int cpu_frequencies[] = {408,450,500,550,  600,650,700,750, 800,850,900,950, 1000,1050,1100,1150, 1200,1250,1300,1350, 1400,1450,1500,1550, 1600,1650,1700,1750, 1800,1850,1900,1950, 2000};
     const int num_freqs = sizeof(cpu_frequencies) / sizeof(cpu_frequencies[0]);
     int current_index = 5; 
 
@@ -2544,15 +3167,44 @@ void *PLAT_cpu_monitor(void *arg) {
 
 
 #define GOVERNOR_PATH "/sys/devices/system/cpu/cpu0/cpufreq/scaling_setspeed"
+// kept open, the governors can change speed every frame. nextui's cpu
+// monitor thread sets speeds too so both go through governor_lock
+static pthread_mutex_t governor_lock = PTHREAD_MUTEX_INITIALIZER;
+static int governor_fd = -1;
+static int governor_speed = 0;
 void PLAT_setCustomCPUSpeed(int speed) {
-    FILE *fp = fopen(GOVERNOR_PATH, "w");
-    if (fp == NULL) {
-        perror("Failed to open scaling_setspeed");
-        return;
-    }
+	pthread_mutex_lock(&governor_lock);
+	if (speed==governor_speed) {
+		pthread_mutex_unlock(&governor_lock);
+		return;
+	}
+
+	if (governor_fd<0) {
+		governor_fd = open(GOVERNOR_PATH, O_WRONLY | O_CLOEXEC);
+		if (governor_fd<0) {
+			perror("Failed to open scaling_setspeed");
+			pthread_mutex_unlock(&governor_lock);
+			return;
+		}
+	}
 
-    fprintf(fp, "%d\n", speed);
-    fclose(fp);
+	char value[16];
+	int len = snprintf(value, sizeof(value), "%d\n", speed);
+	if (pwrite(governor_fd, value, len, 0)!=len) {
+		perror("Failed to write scaling_setspeed");
+		close(governor_fd);
+		governor_fd = -1;
+		governor_speed = 0;
+	}
+	else {
+		governor_speed = speed;
+	}
+	pthread_mutex_unlock(&governor_lock);
+}
+void PLAT_resetCPUSpeed(void) {
+	pthread_mutex_lock(&governor_lock);
+	governor_speed = 0; // someone else wrote scaling_setspeed, the next set has to go through
+	pthread_mutex_unlock(&governor_lock);
 }
 void PLAT_setCPUSpeed(int speed) {
 	int freq = 0;
@@ -2562,7 +3214,7 @@ void PLAT_setCPUSpeed(int speed) {
 		case CPU_SPEED_NORMAL: 		freq = 1608000; currentcpuspeed = 1600; break;
 		case CPU_SPEED_PERFORMANCE: freq = 2000000; currentcpuspeed = 2000; break;
 	}
-	putInt(GOVERNOR_PATH, freq);
+	PLAT_setCustomCPUSpeed(freq);
 }
 
 #define MAX_STRENGTH 0xFFFF